@@ -0,0 +1,76 @@
+#include "chase_lev_deque.h"
+
+chase_lev_deque::array* chase_lev_deque::newArray(long size)
+{
+    auto* a = new array;
+    a->size = size;
+    a->items = new std::atomic<uint64_t>[size];
+    _arrays.push_back(a);
+    return a;
+}
+
+chase_lev_deque::chase_lev_deque(long capacity): _top(0), _topPadding(), _bottom(0), _array(nullptr), _arrays()
+{
+    long size = 1;
+    while (size < capacity)
+    {
+        size *= 2;
+    }
+    _array.store(newArray(size), std::memory_order_relaxed);
+}
+
+chase_lev_deque::~chase_lev_deque()
+{
+    for (array* a : _arrays)
+    {
+        delete[] a->items;
+        delete a;
+    }
+}
+
+void chase_lev_deque::push(uint64_t item)
+{
+    long b = _bottom.load(std::memory_order_relaxed);
+    long t = _top.load(std::memory_order_acquire);
+    array* a = _array.load(std::memory_order_relaxed);
+    if (b - t > a->size - 1) // full, copies the items to an array twice as large:
+    {
+        array* grown = newArray(a->size * 2);
+        for (long i = t; i < b; ++i)
+        {
+            grown->items[i & (grown->size - 1)].store(a->items[i & (a->size - 1)].load(std::memory_order_relaxed),
+                                                      std::memory_order_relaxed);
+        }
+        _array.store(grown, std::memory_order_release);
+        a = grown;
+    }
+    a->items[b & (a->size - 1)].store(item, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    _bottom.store(b + 1, std::memory_order_relaxed);
+}
+
+bool chase_lev_deque::steal(uint64_t& item)
+{
+    long t = _top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    long b = _bottom.load(std::memory_order_acquire);
+    if (t >= b)
+    {
+        return false;
+    }
+    array* a = _array.load(std::memory_order_acquire);
+    item = a->items[t & (a->size - 1)].load(std::memory_order_relaxed);
+    return _top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+bool chase_lev_deque::take(uint64_t& item)
+{
+    while (_top.load(std::memory_order_acquire) < _bottom.load(std::memory_order_acquire))
+    {
+        if (steal(item))
+        {
+            return true;
+        }
+    }
+    return false;
+}
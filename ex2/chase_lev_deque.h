@@ -0,0 +1,64 @@
+#ifndef EX2_CHASE_LEV_DEQUE_H
+#define EX2_CHASE_LEV_DEQUE_H
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+
+/**
+ * A work stealing deque (Chase and Lev, in the C11 formulation of Le et al.): its owner pushes at the bottom without
+ * locking, and items are taken from the top with a single compare and swap, by the owner as well, so that the
+ * threads it holds are run in the order they were made ready, as the round robin of the single worker does.
+ * It grows as needed; the arrays it outgrows are kept until it's destructed, since a thief may still read them.
+ */
+class chase_lev_deque
+{
+    struct array
+    {
+        long size; // a power of 2.
+        std::atomic<uint64_t>* items;
+    };
+
+    std::atomic<long> _top;
+    char _topPadding[64 - sizeof(std::atomic<long>)]; // keeps the thieves' _top and the owner's _bottom apart.
+    std::atomic<long> _bottom;
+    std::atomic<array*> _array;
+    std::vector<array*> _arrays; // every array the deque had, only touched by the owner.
+
+    /**
+     * Allocates an array of size items.
+     */
+    array* newArray(long size);
+
+public:
+    /**
+     * Creates an empty deque.
+     * @param capacity: the number of items it has room for before it grows, rounded up to a power of 2.
+     */
+    explicit chase_lev_deque(long capacity);
+
+    /**
+     * destructs this deque and its arrays.
+     */
+    ~chase_lev_deque();
+
+    /**
+     * Pushes an item at the bottom, only called by the owner.
+     */
+    void push(uint64_t item);
+
+    /**
+     * Steals the item at the top, called by any kernel thread.
+     * @return false if the deque is empty, or if another kernel thread took the item first.
+     */
+    bool steal(uint64_t& item);
+
+    /**
+     * Takes the item at the top like steal, trying again if another kernel thread took it first.
+     * @return false if the deque is empty.
+     */
+    bool take(uint64_t& item);
+};
+
+
+#endif //EX2_CHASE_LEV_DEQUE_H
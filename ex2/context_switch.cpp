@@ -0,0 +1,72 @@
+#include <cstdint>
+#include "context_switch.h"
+
+#ifndef __x86_64__
+#error "the uthreads context switch is written for x86-64"
+#endif
+
+// the frame switchContext leaves on a stack, from the stack pointer up:
+// the x87 control word, MXCSR, r15, r14, r13, r12, rbx, rbp and the address to return to.
+static const int FRAME_WORDS = 9;
+static const int FRAME_R13 = 4;
+static const int FRAME_R12 = 5;
+static const int FRAME_RETURN = 8;
+
+static const uint64_t DEFAULT_FPU_CONTROL = 0x037F; // the x87 control word set by finit.
+static const uint64_t DEFAULT_MXCSR = 0x1F80;       // all SSE exceptions masked, rounding to nearest.
+
+extern "C" void contextEntry();
+
+asm(R"(
+    .text
+    .globl switchContext
+    .type switchContext, @function
+switchContext:
+    pushq %rbp
+    pushq %rbx
+    pushq %r12
+    pushq %r13
+    pushq %r14
+    pushq %r15
+    subq $16, %rsp
+    stmxcsr 8(%rsp)
+    fnstcw (%rsp)
+    movq %rsp, (%rdi)
+    movq %rsi, %rsp
+    fldcw (%rsp)
+    ldmxcsr 8(%rsp)
+    addq $16, %rsp
+    popq %r15
+    popq %r14
+    popq %r13
+    popq %r12
+    popq %rbx
+    popq %rbp
+    ret
+    .size switchContext, .-switchContext
+
+    .globl contextEntry
+    .type contextEntry, @function
+contextEntry:
+    movq %r13, %rdi
+    callq *%r12
+    ud2
+    .size contextEntry, .-contextEntry
+)");
+
+void* makeContext(char* stack, size_t stackSize, void (*start)(void*), void* arg)
+{
+    // contextEntry is returned to with a 16 byte aligned stack pointer, as a call to start expects:
+    auto top = (uintptr_t)(stack + stackSize) & ~(uintptr_t)15;
+    auto* frame = (uint64_t*)(top - FRAME_WORDS * 8);
+    for (int i = 0; i < FRAME_WORDS; ++i)
+    {
+        frame[i] = 0;
+    }
+    frame[0] = DEFAULT_FPU_CONTROL;
+    frame[1] = DEFAULT_MXCSR;
+    frame[FRAME_R13] = (uint64_t)arg;
+    frame[FRAME_R12] = (uint64_t)start;
+    frame[FRAME_RETURN] = (uint64_t)&contextEntry;
+    return frame;
+}
@@ -0,0 +1,35 @@
+#ifndef EX2_CONTEXT_SWITCH_H
+#define EX2_CONTEXT_SWITCH_H
+
+#include <cstddef>
+
+/*
+ * The context of a thread that isn't running is its stack pointer alone: switching out pushes the callee saved
+ * registers (and the x87 and SSE control words) on the thread's stack, and switching back in pops them.
+ * The signal mask is neither saved nor restored, so a switch makes no system call. The library never blocks its
+ * signals: it only switches between enterLibrary and leaveLibrary (see uthreads.cpp), where its handlers only note
+ * a signal for leaveLibrary to act on, and every thread calls the leaveLibrary of the section it was switched in to
+ * (or, on its first run, its start function does).
+ */
+
+/**
+ * Saves the registers of the running code on its stack, stores its stack pointer in fromSp and resumes the context
+ * whose stack pointer is toSp. Returns once a switch is made back to fromSp.
+ * @param fromSp: where to keep the stack pointer of the running code.
+ * @param toSp: the stack pointer of the context to resume, made by makeContext or stored by a switch.
+ */
+extern "C" void switchContext(void** fromSp, void* toSp);
+
+/**
+ * Lays out a new context on a stack, which starts by calling start(arg) once it's switched to.
+ * start should never return, since there is nothing to return to.
+ * @param stack: the lowest address of the stack.
+ * @param stackSize: the size of the stack in bytes.
+ * @param start: the function the context starts in.
+ * @param arg: the argument of start.
+ * @return the stack pointer of the context, to switch to.
+ */
+void* makeContext(char* stack, size_t stackSize, void (*start)(void*), void* arg);
+
+
+#endif //EX2_CONTEXT_SWITCH_H
@@ -8,6 +8,379 @@
 #include "thread_manager.h"
 #include "thread.h"
 
+// READY QUEUE BENCHMARK-------------------------------------------------------------------------------------------------
+// Drives the scheduler alone with 10k threads through storms of blocks and resumes, the way uthread_block and
+// uthread_resume do, and prints the time per scheduler operation.
+
+//#include <chrono>
+//#include <cstdlib>
+//#include "scheduler.h"
+//
+//int main()
+//{
+//    const int threads = 10000;
+//    const int rounds = 200;
+//    thread_manager manager(100000, threads + 1, 4096);
+//    manager.threadManagerSetup();
+//    scheduler sched(&manager);
+//    for (int i = 1; i <= threads; ++i)
+//    {
+//        sched.addThread(manager.createThread(nullptr));
+//    }
+//
+//    srand(0);
+//    long ops = 0;
+//    auto start = std::chrono::steady_clock::now();
+//    for (int round = 0; round < rounds; ++round)
+//    {
+//        // Blocks a random half of the threads, wherever they are in the queue, then resumes them:
+//        for (int i = 0; i < threads / 2; ++i)
+//        {
+//            int tid = 1 + rand() % threads;
+//            sched.whosNextBlock(tid);
+//            sched.addThread(tid);
+//            sched.whosNextTimeout();
+//            ops += 3;
+//        }
+//    }
+//    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+//    std::cout << threads << " threads, " << ops << " scheduler operations: " << secs * 1e9 / ops << " ns each"
+//              << std::endl;
+//    return 0;
+//}
+
+// THREAD TABLE BENCHMARK------------------------------------------------------------------------------------------------
+// Drives the thread manager alone with 100k threads, and prints the time of a spawn, of a lookup of a random tid,
+// and of killing a random thread and spawning another in its tid.
+
+//#include <chrono>
+//#include <cstdlib>
+//#include "thread_manager.h"
+//
+//void f() {}
+//
+//int main()
+//{
+//    const int threads = 100000;
+//    thread_manager manager(100000, threads + 1, 256);
+//    manager.threadManagerSetup();
+//    auto start = std::chrono::steady_clock::now();
+//    for (int i = 1; i <= threads; ++i) manager.createThread(f);
+//    double spawnSecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+//    srand(0);
+//    long sum = 0;
+//    start = std::chrono::steady_clock::now();
+//    for (int i = 0; i < 10000000; ++i) sum += manager.getThreadQuants(1 + rand() % threads);
+//    double lookupSecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+//    start = std::chrono::steady_clock::now();
+//    for (int i = 0; i < 1000000; ++i) { manager.killThread(1 + rand() % threads); manager.createThread(f); }
+//    double churnSecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+//    std::cout << "spawn " << spawnSecs * 1e9 / threads << " ns, lookup " << lookupSecs * 1e9 / 10000000
+//              << " ns, kill+spawn " << churnSecs * 1e9 / 1000000 << " ns (" << sum << ")" << std::endl;
+//}
+
+// CONTEXT SWITCH BENCHMARK----------------------------------------------------------------------------------------------
+// Ping-pongs between the main thread and another one through the thread manager, and prints the time per switch.
+
+//#include <chrono>
+//#include "thread_manager.h"
+//
+//static thread_manager* manager;
+//static const int switches = 1000000;
+//
+//void pingPong()
+//{
+//    while (true) manager->switchContext(1, 0);
+//}
+//
+//int main()
+//{
+//    manager = new thread_manager(100000, 2, 16384);
+//    manager->threadManagerSetup();
+//    manager->createThread(pingPong);
+//    auto start = std::chrono::steady_clock::now();
+//    for (int i = 0; i < switches; ++i) manager->switchContext(0, 1);
+//    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+//    std::cout << 2 * switches << " context switches: " << secs * 1e9 / (2 * switches) << " ns each" << std::endl;
+//}
+
+// API CALL BENCHMARK----------------------------------------------------------------------------------------------------
+// Prints the time of a uthread_get_tid and of a uthread_resume (of a thread that isn't blocked), in the common case
+// of no preemption during the call.
+
+//#include <chrono>
+//#include <iostream>
+//
+//void spin()
+//{
+//    while (true) {}
+//}
+//
+//int main()
+//{
+//    const int calls = 1000000;
+//    uthread_init(10 * 1000000); // a long quantum, so the main thread isn't preempted while measured.
+//    int tid = uthread_spawn(spin);
+//    long sum = 0;
+//    auto start = std::chrono::steady_clock::now();
+//    for (int i = 0; i < calls; ++i) sum += uthread_get_tid();
+//    double tidSecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+//    start = std::chrono::steady_clock::now();
+//    for (int i = 0; i < calls; ++i) sum += uthread_resume(tid);
+//    double resumeSecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+//    std::cout << "uthread_get_tid " << tidSecs * 1e9 / calls << " ns, uthread_resume " << resumeSecs * 1e9 / calls
+//              << " ns (" << sum << ")" << std::endl;
+//    uthread_terminate(0);
+//}
+
+// M:N SCHEDULER BENCHMARK----------------------------------------------------------------------------------------------
+// Prints the time 64 CPU bound threads take to finish the same work, run by the calling kernel thread alone and by
+// one worker per core.
+
+//#include <atomic>
+//#include <chrono>
+//#include <iostream>
+//
+//std::atomic<int> finished(0);
+//
+//void work()
+//{
+//    for (volatile long i = 0; i < 20000000; ++i) {}
+//    finished++;
+//    uthread_block(uthread_get_tid());
+//}
+//
+//int main(int argc, char** argv)
+//{
+//    const int threads = 64;
+//    uthread_options options = {threads + 1, 65536, argc > 1 ? -1 : 0};
+//    uthread_init_with_options(10000, &options);
+//    auto start = std::chrono::steady_clock::now();
+//    for (int i = 0; i < threads; ++i) uthread_spawn(work);
+//    while (finished < threads) {}
+//    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+//    std::cout << (argc > 1 ? "a worker per core: " : "a single worker: ") << secs << " s, "
+//              << uthread_get_total_quantums() << " quantums" << std::endl;
+//    uthread_terminate(0);
+//}
+
+// SLEEP QUEUE BENCHMARK-------------------------------------------------------------------------------------------------
+// Prints the time to wake the first of 10000 sleeping threads and put it back to sleep, as uthread_sleep and the sleep
+// timer do.
+
+//#include <chrono>
+//#include <iostream>
+//#include <cstdlib>
+//#include "sleeping_threads_list.h"
+//
+//int main()
+//{
+//    const int sleepers = 10000, rounds = 100000;
+//    SleepingThreadsList list;
+//    unsigned seed = 1;
+//    for (int tid = 1; tid <= sleepers; ++tid) list.add(tid, rand_r(&seed) % 1000000000);
+//    auto start = std::chrono::steady_clock::now();
+//    for (int i = 0; i < rounds; ++i)
+//    {
+//        int tid = list.peek()->id;
+//        list.pop();
+//        list.add(tid, rand_r(&seed) % 1000000000);
+//    }
+//    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+//    std::cout << "pop and add with " << sleepers << " sleeping threads: " << secs * 1e9 / rounds << " ns" << std::endl;
+//}
+
+// SLEEP ACCURACY BENCHMARK----------------------------------------------------------------------------------------------
+// Prints the percentiles of how late a thread sleeping 100 to 2100 microseconds at a time is woken up, by the calling
+// kernel thread alone, or by two workers given an argument.
+
+//#include <algorithm>
+//#include <atomic>
+//#include <cstdlib>
+//#include <ctime>
+//#include <iostream>
+//#include <vector>
+//#include "uthreads.h"
+//
+//const int sleeps = 1000;
+//std::vector<long long> lateness;
+//std::atomic<bool> finished(false);
+//
+//long long monotonicNsecs()
+//{
+//    timespec now;
+//    clock_gettime(CLOCK_MONOTONIC, &now);
+//    return now.tv_sec * 1000000000LL + now.tv_nsec;
+//}
+//
+//void sleeper()
+//{
+//    unsigned seed = 1;
+//    for (int i = 0; i < sleeps; ++i)
+//    {
+//        unsigned usecs = 100 + rand_r(&seed) % 2000;
+//        long long wakeUp = monotonicNsecs() + usecs * 1000LL;
+//        uthread_sleep(usecs);
+//        lateness.push_back(monotonicNsecs() - wakeUp);
+//    }
+//    finished = true;
+//    uthread_block(uthread_get_tid());
+//}
+//
+//int main(int argc, char** argv)
+//{
+//    // with a second worker, the woken thread needn't wait for the main thread's quantum to end:
+//    uthread_options options = {2, 65536, argc > 1 ? 2 : 0, SLEEP_SLACK_NSECS};
+//    uthread_init_with_options(1000, &options);
+//    uthread_spawn(sleeper);
+//    while (!finished) {}
+//    std::sort(lateness.begin(), lateness.end());
+//    std::cout << "wake up lateness (us): p50 " << lateness[sleeps / 2] / 1000 << ", p90 "
+//              << lateness[sleeps * 9 / 10] / 1000 << ", p99 " << lateness[sleeps * 99 / 100] / 1000 << ", max "
+//              << lateness.back() / 1000 << std::endl;
+//    uthread_terminate(0);
+//}
+
+// TICKLESS BENCHMARK----------------------------------------------------------------------------------------------------
+// Prints the quantums the main thread runs alone in a second of CPU time, and the quantum timer's signals it takes,
+// ticking every quantum, or tickless given an argument.
+
+//#include <csignal>
+//#include <cstdlib>
+//#include <ctime>
+//#include <iostream>
+//#include "uthreads.h"
+//
+//struct sigaction library;
+//volatile long signals = 0;
+//
+//void countSignal(int sig)
+//{
+//    signals++;
+//    library.sa_handler(sig);
+//}
+//
+//double cpuSecs()
+//{
+//    timespec now;
+//    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+//    return now.tv_sec + now.tv_nsec * 1e-9;
+//}
+//
+//int main(int argc, char** argv)
+//{
+//    uthread_options options = {MAX_THREAD_NUM, STACK_SIZE, 0, SLEEP_SLACK_NSECS, argc > 1 ? 1 : 0};
+//    uthread_init_with_options(10000, &options);
+//    struct sigaction counting;
+//    sigaction(SIGVTALRM, nullptr, &library);
+//    counting = library;
+//    counting.sa_handler = countSignal;
+//    sigaction(SIGVTALRM, &counting, nullptr);
+//    double start = cpuSecs();
+//    while (cpuSecs() - start < 1) {}
+//    std::cout << (argc > 1 ? "tickless: " : "ticking: ") << uthread_get_total_quantums() << " quantums, " << signals
+//              << " signals" << std::endl;
+//    uthread_terminate(0);
+//}
+
+// STACK POOL BENCHMARK--------------------------------------------------------------------------------------------------
+// Prints the time to spawn a thread and terminate it before it runs, which reuses the stacks of the pool.
+
+//#include <chrono>
+//#include <iostream>
+//#include "uthreads.h"
+//
+//void nothing()
+//{
+//    while (true) {}
+//}
+//
+//int main()
+//{
+//    const int cycles = 200000;
+//    uthread_init(10 * 1000000); // a long quantum, so the main thread isn't preempted while measured.
+//    auto start = std::chrono::steady_clock::now();
+//    for (int i = 0; i < cycles; ++i) uthread_terminate(uthread_spawn(nothing));
+//    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+//    std::cout << "uthread_spawn and uthread_terminate: " << secs * 1e9 / cycles << " ns" << std::endl;
+//    uthread_terminate(0);
+//}
+
+// SHARED STACK BENCHMARK------------------------------------------------------------------------------------------------
+// Prints the memory a blocked thread takes with a stack of its own and with the shared stack, and the time a switch
+// between blocked threads takes in either mode, each mode in a child process of its own.
+
+//#include <cstdio>
+//#include <cstdlib>
+//#include <ctime>
+//#include <unistd.h>
+//#include <sys/wait.h>
+//#include "uthreads.h"
+//
+//static const int IDLE_THREADS = 10000;
+//static volatile int idleRan = 0;
+//static timespec firstRan, lastRan;
+//
+//static long residentBytes()
+//{
+//    long pages = 0, resident = 0;
+//    FILE* statm = fopen("/proc/self/statm", "r");
+//    if (fscanf(statm, "%ld %ld", &pages, &resident) != 2) resident = 0;
+//    fclose(statm);
+//    return resident * sysconf(_SC_PAGESIZE);
+//}
+//
+//static void idleThread()
+//{
+//    volatile char scratch[512]; // a frame of some size, as a real thread would have.
+//    for (int i = 0; i < 512; ++i) scratch[i] = (char)i;
+//    while (true)
+//    {
+//        clock_gettime(CLOCK_MONOTONIC, idleRan == 0 ? &firstRan : &lastRan);
+//        idleRan++;
+//        uthread_block(uthread_get_tid()); // switches straight to the next idle thread.
+//    }
+//}
+//
+//// The idle threads all run, one after the other, once the quantum of the main thread ends:
+//static double runIdleThreads()
+//{
+//    while (idleRan < IDLE_THREADS) {}
+//    return ((lastRan.tv_sec - firstRan.tv_sec) * 1e9 + (lastRan.tv_nsec - firstRan.tv_nsec)) / (IDLE_THREADS - 1);
+//}
+//
+//static void measureIdleThreads(int sharedStack)
+//{
+//    uthread_options options = {IDLE_THREADS + 1, 64 * 1024, 0, SLEEP_SLACK_NSECS, 0, sharedStack};
+//    uthread_init_with_options(100000, &options);
+//    long before = residentBytes();
+//    for (int i = 0; i < IDLE_THREADS; ++i) uthread_spawn(idleThread);
+//    double firstRunNs = runIdleThreads();
+//    long after = residentBytes();
+//    idleRan = 0;
+//    for (int i = 1; i <= IDLE_THREADS; ++i) uthread_resume(i);
+//    double switchNs = runIdleThreads();
+//    printf("%s stacks: %ld bytes per blocked thread, %.0f ns per first run, %.0f ns per switch\n",
+//           sharedStack ? "shared   " : "dedicated", (after - before) / IDLE_THREADS, firstRunNs, switchNs);
+//    uthread_terminate(0);
+//}
+//
+//int main()
+//{
+//    // uthread_init_with_options may only be called once a process, so each mode is measured in a child:
+//    for (int sharedStack = 0; sharedStack <= 1; ++sharedStack)
+//    {
+//        fflush(stdout);
+//        pid_t child = fork();
+//        if (child == 0)
+//        {
+//            measureIdleThreads(sharedStack);
+//        }
+//        waitpid(child, nullptr, 0);
+//    }
+//    return 0;
+//}
+
 // THE ULTIMATE TEST-----------------------------------------------------------------------------------------------------------------
 
 //void g()
@@ -1750,6 +2123,9 @@
 /**********************************************
  * Test 132: thread's signal mask is saved between switches (not including VTALRM)
  *
+ * no longer holds: the threads share the signal mask, which a switch doesn't save (see uthreads.h), so a thread
+ * sees the sets the other threads blocked too.
+ *
  * steps:
  * create three global sets of different signals (not including VTALRM) - set1, set2, set3
  * spawn threads 1,2,3
@@ -0,0 +1,521 @@
+#include <iostream>
+#include <csignal>
+#include <sched.h>
+#include <time.h>
+#include "mn_scheduler.h"
+#include "context_switch.h"
+
+// the word of a tid: the state's flags, the worker running it and the generation, which changes every time the
+// thread is made ready, so the entries of the run queues that were made for an earlier time can be told apart.
+static const uint64_t STATE_EXISTS = 1;
+static const uint64_t STATE_READY = 2;    // there is a run queue entry of the current generation.
+static const uint64_t STATE_RUNNING = 4;  // a worker runs it, or hasn't finished switching out of it.
+static const uint64_t STATE_BLOCKED = 8;
+static const uint64_t STATE_SLEEPING = 16;
+static const uint64_t STATE_DEAD = 32;    // terminated while it was running, destructed once it's switched out of.
+static const int STATE_WORKER_SHIFT = 8;
+static const uint64_t STATE_WORKER_MASK = 0xFFFFULL << STATE_WORKER_SHIFT;
+static const int STATE_GENERATION_SHIFT = 32;
+static const uint64_t STATE_GENERATION_MASK = ~0ULL << STATE_GENERATION_SHIFT;
+
+static const long RUN_QUEUE_CAPACITY = 1024;
+static const int IDLE_STACK_SIZE = 65536;
+static const int IDLE_YIELDS = 64; // an idle worker yields between its attempts to steal, and naps every IDLE_YIELDS.
+static const long IDLE_NAP_NSECS = 100000;
+
+static thread_local mn_worker* currentWorker = nullptr;
+
+static bool isRunnable(uint64_t state)
+{
+    return (state & (STATE_BLOCKED | STATE_SLEEPING | STATE_DEAD)) == 0;
+}
+
+/**
+ * Gives the state a new generation and marks it READY.
+ */
+static uint64_t makeReady(uint64_t state)
+{
+    return (state + (1ULL << STATE_GENERATION_SHIFT)) | STATE_READY;
+}
+
+static int workerOf(uint64_t state)
+{
+    return (int)((state & STATE_WORKER_MASK) >> STATE_WORKER_SHIFT);
+}
+
+/**
+ * Prints a system error and exits, as the library does.
+ */
+static void systemError(const char* msg)
+{
+    std::cerr << "system error: " << msg << std::endl;
+    exit(1);
+}
+
+//--- Constructors --------------------------------------------------------------------------------------------------
+
+mn_worker::mn_worker(mn_scheduler* scheduler, int index, long capacity, int quantumUsecs)
+        : scheduler(scheduler), index(index), pthread(), ready(capacity), running(-1), prev(-1), idleSp(nullptr),
+          idleStack(nullptr), timer(quantumUsecs), seed((unsigned)index + 1), kicked(false) {}
+
+mn_scheduler::mn_scheduler(thread_manager* manager, int maxThreadNum, int quantumUsecs, int workers,
+                           void (*enterLibrary)(), void (*idle)(), void (*destroyed)(int tid))
+        : _manager(manager), _maxThreadNum(maxThreadNum), _workers(),
+          _states(new std::atomic<uint64_t>[maxThreadNum]), _totalQuants(0), _enterLibrary(enterLibrary), _idle(idle),
+          _destroyed(destroyed)
+{
+    _lock.clear();
+    for (int tid = 0; tid < maxThreadNum; ++tid)
+    {
+        _states[tid].store(0, std::memory_order_relaxed);
+    }
+    for (int i = 0; i < workers; ++i)
+    {
+        _workers.push_back(new mn_worker(this, i, RUN_QUEUE_CAPACITY, quantumUsecs));
+    }
+}
+
+//--- Private helpers -----------------------------------------------------------------------------------------------
+
+__attribute__((noinline)) mn_worker* mn_scheduler::current()
+{
+    // not inlined, so the address of currentWorker isn't kept across a context switch, which may move the calling
+    // thread to another kernel thread.
+    return currentWorker;
+}
+
+void mn_scheduler::pushReady(mn_worker* w, int tid, uint64_t state)
+{
+    w->ready.push(((uint64_t)tid << STATE_GENERATION_SHIFT) | (state >> STATE_GENERATION_SHIFT));
+}
+
+int mn_scheduler::claim(mn_worker* w, uint64_t entry)
+{
+    int tid = (int)(entry >> STATE_GENERATION_SHIFT);
+    uint64_t generation = entry << STATE_GENERATION_SHIFT;
+    uint64_t state = _states[tid].load();
+    while ((state & STATE_GENERATION_MASK) == generation && (state & STATE_READY))
+    {
+        uint64_t running = (state & ~(STATE_READY | STATE_WORKER_MASK)) | STATE_RUNNING |
+                           ((uint64_t)w->index << STATE_WORKER_SHIFT);
+        if (_states[tid].compare_exchange_weak(state, running))
+        {
+            return tid;
+        }
+    }
+    return -1;
+}
+
+int mn_scheduler::takeReady(mn_worker* w, bool steal)
+{
+    uint64_t entry;
+    while (w->ready.take(entry))
+    {
+        int tid = claim(w, entry);
+        if (tid != -1)
+        {
+            return tid;
+        }
+    }
+    int others = (int)_workers.size() - 1;
+    if (!steal || others == 0)
+    {
+        return -1;
+    }
+    // the other workers, from a random one on:
+    int first = (int)(rand_r(&w->seed) % (unsigned)others);
+    for (int i = 0; i < others; ++i)
+    {
+        mn_worker* victim = _workers[(w->index + 1 + (first + i) % others) % (others + 1)];
+        while (victim->ready.steal(entry))
+        {
+            int tid = claim(w, entry);
+            if (tid != -1)
+            {
+                return tid;
+            }
+        }
+    }
+    return -1;
+}
+
+void mn_scheduler::switchTo(mn_worker* w, int nextTid)
+{
+    int currTid = w->running;
+    w->prev = currTid;
+    w->running = nextTid;
+    void** save = currTid == -1 ? &w->idleSp : &_manager->getThread(currTid)->_sp;
+    void* load = w->idleSp;
+    if (nextTid != -1)
+    {
+        thread* next = _manager->getThread(nextTid);
+        next->updateQuants();
+        _totalQuants++;
+        if (w->timer.start() < 0)
+        {
+            systemError("Failed to start _timer.");
+        }
+        load = next->_sp;
+    }
+    else if (w->timer.stop() < 0) // an idle worker takes no signals.
+    {
+        systemError("Failed to stop _timer.");
+    }
+    ::switchContext(save, load);
+    finishSwitch();
+}
+
+void mn_scheduler::switchOut(mn_worker* w)
+{
+    switchTo(w, takeReady(w, true));
+}
+
+void mn_scheduler::kick(int workerIndex)
+{
+    _workers[workerIndex]->kicked.store(true);
+    pthread_kill(_workers[workerIndex]->pthread, SIGVTALRM);
+}
+
+void mn_scheduler::destroy(int tid)
+{
+    lock();
+    _states[tid].store(_states[tid].load() & STATE_GENERATION_MASK);
+    _destroyed(tid);
+    _manager->killThread(tid);
+    unlock();
+}
+
+void mn_scheduler::idleLoop(mn_worker* w)
+{
+    int misses = 0;
+    while (true)
+    {
+        finishSwitch();
+        _idle();
+        int next = takeReady(w, true);
+        if (next != -1)
+        {
+            misses = 0;
+            switchTo(w, next);
+        }
+        else if (++misses % IDLE_YIELDS != 0)
+        {
+            sched_yield();
+        }
+        else
+        {
+            timespec nap = {0, IDLE_NAP_NSECS};
+            nanosleep(&nap, nullptr);
+        }
+    }
+}
+
+void mn_scheduler::idleEntry(void* self)
+{
+    auto* w = static_cast<mn_worker*>(self);
+    w->scheduler->idleLoop(w);
+}
+
+void* mn_scheduler::workerEntry(void* self)
+{
+    auto* w = static_cast<mn_worker*>(self);
+    currentWorker = w;
+    w->pthread = pthread_self();
+    w->scheduler->_enterLibrary();
+    w->scheduler->idleLoop(w);
+    return nullptr;
+}
+
+//--- Class functionality -------------------------------------------------------------------------------------------
+
+int mn_scheduler::start()
+{
+    mn_worker* first = _workers[0];
+    first->pthread = pthread_self();
+    currentWorker = first;
+
+    // the main thread runs on the calling kernel thread's stack, so its idle loop gets a stack of its own:
+    try{
+        first->idleStack = new char[IDLE_STACK_SIZE];
+    }
+    catch (std::bad_alloc& e)
+    {
+        std::cerr << "system error: bad memory allocation when creating a worker." << std::endl;
+        return -1;
+    }
+    first->idleSp = makeContext(first->idleStack, IDLE_STACK_SIZE, &mn_scheduler::idleEntry, first);
+    first->running = 0;
+    _states[0].store(STATE_EXISTS | STATE_RUNNING | (1ULL << STATE_GENERATION_SHIFT));
+    _totalQuants = 1;
+    if (first->timer.start() < 0)
+    {
+        std::cerr << "system error: Failed to start _timer." << std::endl;
+        return -1;
+    }
+
+    for (size_t i = 1; i < _workers.size(); ++i)
+    {
+        if (pthread_create(&_workers[i]->pthread, nullptr, &mn_scheduler::workerEntry, _workers[i]) != 0)
+        {
+            std::cerr << "system error: Failed to create a worker." << std::endl;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void mn_scheduler::lock()
+{
+    while (_lock.test_and_set(std::memory_order_acquire))
+    {
+        sched_yield(); // the holder may be off the CPU, it can't be waiting for a signal.
+    }
+}
+
+void mn_scheduler::unlock()
+{
+    _lock.clear(std::memory_order_release);
+}
+
+int mn_scheduler::spawn(void (*f)(), int stackSize)
+{
+    lock();
+    int tid = _manager->createThread(f, stackSize);
+    if (tid < 0)
+    {
+        unlock();
+        return tid;
+    }
+    uint64_t state = makeReady((_states[tid].load() & STATE_GENERATION_MASK) | STATE_EXISTS);
+    _states[tid].store(state);
+    unlock();
+    pushReady(current(), tid, state);
+    return tid;
+}
+
+int mn_scheduler::terminate(int tid)
+{
+    if (tid < 0 || tid >= _maxThreadNum)
+    {
+        return -1;
+    }
+    uint64_t state = _states[tid].load();
+    do
+    {
+        if (!(state & STATE_EXISTS) || (state & STATE_DEAD))
+        {
+            return -1;
+        }
+    } while (!_states[tid].compare_exchange_weak(state, (state | STATE_DEAD) & ~STATE_READY));
+
+    if (state & STATE_RUNNING)
+    {
+        mn_worker* w = current();
+        if (w->running == tid)
+        {
+            switchOut(w); // never returns, the thread is destructed by the context switched to.
+        }
+        kick(workerOf(state));
+        return 0;
+    }
+    destroy(tid);
+    return 0;
+}
+
+int mn_scheduler::block(int tid)
+{
+    if (tid < 0 || tid >= _maxThreadNum)
+    {
+        return -1;
+    }
+    uint64_t state = _states[tid].load();
+    do
+    {
+        if (!(state & STATE_EXISTS) || (state & STATE_DEAD))
+        {
+            return -1;
+        }
+        if (state & STATE_BLOCKED)
+        {
+            return 0;
+        }
+    } while (!_states[tid].compare_exchange_weak(state, (state | STATE_BLOCKED) & ~STATE_READY));
+
+    if (state & STATE_RUNNING)
+    {
+        mn_worker* w = current();
+        if (w->running == tid)
+        {
+            switchOut(w);
+        }
+        else
+        {
+            kick(workerOf(state));
+        }
+    }
+    return 0;
+}
+
+int mn_scheduler::resume(int tid)
+{
+    if (tid < 0 || tid >= _maxThreadNum)
+    {
+        return -1;
+    }
+    uint64_t state = _states[tid].load();
+    uint64_t resumed;
+    do
+    {
+        if (!(state & STATE_EXISTS) || (state & STATE_DEAD))
+        {
+            return -1;
+        }
+        if (!(state & STATE_BLOCKED))
+        {
+            return 0;
+        }
+        resumed = state & ~STATE_BLOCKED;
+        // a thread still RUNNING is made ready by finishSwitch:
+        if (isRunnable(resumed) && !(resumed & STATE_RUNNING))
+        {
+            resumed = makeReady(resumed);
+        }
+    } while (!_states[tid].compare_exchange_weak(state, resumed));
+
+    if (resumed & STATE_READY)
+    {
+        pushReady(current(), tid, resumed);
+    }
+    return 0;
+}
+
+void mn_scheduler::markSleeping()
+{
+    _states[current()->running] |= STATE_SLEEPING;
+}
+
+void mn_scheduler::sleep()
+{
+    switchOut(current());
+}
+
+int mn_scheduler::wake(int tid)
+{
+    if (tid < 0 || tid >= _maxThreadNum)
+    {
+        return -1;
+    }
+    uint64_t state = _states[tid].load();
+    uint64_t woken;
+    do
+    {
+        if (!(state & STATE_EXISTS) || (state & STATE_DEAD))
+        {
+            return -1;
+        }
+        if (!(state & STATE_SLEEPING))
+        {
+            return 0;
+        }
+        woken = state & ~STATE_SLEEPING;
+        if (isRunnable(woken) && !(woken & STATE_RUNNING))
+        {
+            woken = makeReady(woken);
+        }
+    } while (!_states[tid].compare_exchange_weak(state, woken));
+
+    if (woken & STATE_READY)
+    {
+        pushReady(current(), tid, woken);
+    }
+    return 0;
+}
+
+void mn_scheduler::preempt()
+{
+    mn_worker* w = current();
+    bool kicked = w->kicked.exchange(false);
+    int currTid = w->running;
+    if (currTid == -1) // idle, the timer went off before the worker had switched out.
+    {
+        return;
+    }
+    if (!isRunnable(_states[currTid].load())) // blocked or terminated by another worker, which kicked us.
+    {
+        switchOut(w);
+        return;
+    }
+    // A kick that came after the thread it was meant for had switched out ends no quantum of the running thread.
+    // An expiry that came along with it is taken for the kick too, and the thread is preempted at the next one:
+    if (kicked)
+    {
+        return;
+    }
+    int nextTid = takeReady(w, false);
+    if (nextTid == -1) // nothing else to run here, the thread goes on with a new quantum, which the timer counts.
+    {
+        _manager->getThread(currTid)->updateQuants();
+        _totalQuants++;
+        return;
+    }
+    switchTo(w, nextTid);
+}
+
+void mn_scheduler::finishSwitch()
+{
+    mn_worker* w = current();
+    int prevTid = w->prev;
+    if (prevTid == -1)
+    {
+        return;
+    }
+    w->prev = -1;
+    uint64_t state = _states[prevTid].load();
+    uint64_t switchedOut;
+    do
+    {
+        if (state & STATE_DEAD)
+        {
+            destroy(prevTid);
+            return;
+        }
+        switchedOut = state & ~(STATE_RUNNING | STATE_WORKER_MASK);
+        if (isRunnable(switchedOut))
+        {
+            switchedOut = makeReady(switchedOut);
+        }
+    } while (!_states[prevTid].compare_exchange_weak(state, switchedOut));
+
+    if (switchedOut & STATE_READY)
+    {
+        pushReady(w, prevTid, switchedOut);
+    }
+}
+
+bool mn_scheduler::forwardSignal(int sig)
+{
+    if (current() != nullptr)
+    {
+        return false;
+    }
+    pthread_kill(_workers[0]->pthread, sig);
+    return true;
+}
+
+int mn_scheduler::getRunning()
+{
+    return current()->running;
+}
+
+int mn_scheduler::getTotalQuants()
+{
+    return _totalQuants.load();
+}
+
+int mn_scheduler::getQuants(int tid)
+{
+    lock();
+    int quants = _manager->getThreadQuants(tid);
+    unlock();
+    return quants;
+}
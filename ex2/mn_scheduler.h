@@ -0,0 +1,207 @@
+#ifndef EX2_MN_SCHEDULER_H
+#define EX2_MN_SCHEDULER_H
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <pthread.h>
+
+#include "thread.h"
+#include "thread_manager.h"
+#include "chase_lev_deque.h"
+#include "virtual_timer.h"
+
+class mn_scheduler;
+
+/**
+ * A kernel thread running uthreads, with a run queue of its own.
+ */
+struct mn_worker
+{
+    mn_scheduler* scheduler;
+    int index;
+    pthread_t pthread;
+    chase_lev_deque ready;  // entries of the threads it made ready, see mn_scheduler.
+    int running;            // the tid of the thread it runs, -1 while it's idle.
+    int prev;               // the thread it switched from, for the context switched to to finish with, -1 for none.
+    void* idleSp;           // the context of its idle loop while it runs a thread.
+    char* idleStack;        // the stack of the idle loop, nullptr if it's the kernel thread's own stack.
+    virtual_timer timer;    // its quantum timer, on its own CPU time.
+    unsigned seed;          // picks the workers to steal from.
+    std::atomic<bool> kicked; // a SIGVTALRM was sent by kick, rather than by the timer.
+
+    mn_worker(mn_scheduler* scheduler, int index, long capacity, int quantumUsecs);
+};
+
+/**
+ * Schedules the threads on several kernel threads (workers), for uthread_init_with_options with workers.
+ *
+ * Every worker has its own run queue, a work stealing deque, and a worker with nothing to run steals the threads
+ * other workers made ready. Whether a thread exists, runs, is ready, blocked, sleeping or terminated is kept in a
+ * single word per tid, changed by compare and swap only, so the workers need no lock to schedule. A run queue never
+ * has threads removed from it: its entries are a tid and the generation of the tid's word at the time it was made
+ * ready, and an entry whose thread has been blocked or run since is dropped when it's taken.
+ *
+ * A thread stays RUNNING until the context switched to has finished switching out of it (see finishSwitch), so
+ * no worker runs it again before its registers are saved. The manager's threads and tids are kept under the
+ * runtime lock, which is only taken inside the library, where signals are deferred.
+ *
+ * The member functions are called inside the library (see uthreads.cpp), on the worker the calling thread runs on.
+ */
+class mn_scheduler
+{
+    thread_manager* _manager;
+    int _maxThreadNum;
+    std::vector<mn_worker*> _workers;
+    std::atomic<uint64_t>* _states; // the word of every tid, see the STATE_ constants in mn_scheduler.cpp.
+    std::atomic<int> _totalQuants;
+    std::atomic_flag _lock;
+    void (*_enterLibrary)();
+    void (*_idle)();
+    void (*_destroyed)(int tid);
+
+    /**
+     * The worker running the calling code.
+     */
+    static mn_worker* current();
+
+    /**
+     * Makes the thread with tid ready, given its word was set READY with a new generation.
+     */
+    void pushReady(mn_worker* w, int tid, uint64_t state);
+
+    /**
+     * Marks the thread of a run queue entry RUNNING on the worker, unless the entry is stale: the thread was blocked,
+     * run or terminated since it was made.
+     * @return the thread's tid, -1 if the entry is stale.
+     */
+    int claim(mn_worker* w, uint64_t entry);
+
+    /**
+     * Takes a thread from the run queue of the worker, or from the other workers' if steal, and marks it RUNNING.
+     * @return its tid, -1 if there is none.
+     */
+    int takeReady(mn_worker* w, bool steal);
+
+    /**
+     * Switches the worker from its running thread (or idle loop) to the thread with nextTid (or the idle loop for -1).
+     * Returns once the switched out context is switched back to, possibly on another worker.
+     */
+    void switchTo(mn_worker* w, int nextTid);
+
+    /**
+     * Switches the running thread, which can't go on, to the next ready thread or to the idle loop.
+     */
+    void switchOut(mn_worker* w);
+
+    /**
+     * Asks a worker to reschedule, since the thread it runs was blocked or terminated. The worker's preempt takes
+     * the signal for a kick, not for the end of a quantum.
+     */
+    void kick(int workerIndex);
+
+    /**
+     * Destructs a thread once no worker runs it.
+     */
+    void destroy(int tid);
+
+    /**
+     * The loop a worker runs with no thread to run, stealing from the others.
+     */
+    void idleLoop(mn_worker* w);
+
+    static void idleEntry(void* self);
+    static void* workerEntry(void* self);
+
+public:
+    /**
+     * Creates a scheduler, whose threads are kept by manager.
+     * @param workers: the number of workers.
+     * @param enterLibrary: called by every worker before it starts scheduling.
+     * @param idle: called by idle workers between attempts to steal, to act on the signals they deferred.
+     * @param destroyed: called under the runtime lock when a thread is destructed.
+     */
+    mn_scheduler(thread_manager* manager, int maxThreadNum, int quantumUsecs, int workers,
+                 void (*enterLibrary)(), void (*idle)(), void (*destroyed)(int tid));
+
+    /**
+     * Starts the workers, the calling kernel thread being the first, running the main thread.
+     * @return 0 on success, -1 on system failure.
+     */
+    int start();
+
+    /** Takes and frees the runtime lock, which guards the manager and the sleeping threads. */
+    void lock();
+    void unlock();
+
+    /**
+     * Creates a thread with a stack of stackSize bytes (0 for the manager's size) and makes it ready.
+     * @return its tid, -1 if there are too many threads, -2 on system failure.
+     */
+    int spawn(void (*f)(), int stackSize);
+
+    /**
+     * Terminates a thread, which is not the main thread. Doesn't return if it's the calling thread.
+     * A thread running on another worker is terminated once that worker reschedules, promptly.
+     * @return 0 on success, -1 if it doesn't exist.
+     */
+    int terminate(int tid);
+
+    /**
+     * Blocks a thread, the calling one switches out right away, one on another worker promptly.
+     * @return 0 on success, -1 if it doesn't exist.
+     */
+    int block(int tid);
+
+    /**
+     * Unblocks a thread, which becomes ready unless it sleeps.
+     * @return 0 on success, -1 if it doesn't exist.
+     */
+    int resume(int tid);
+
+    /**
+     * Marks the calling thread as sleeping, before it's added to the sleeping threads.
+     */
+    void markSleeping();
+
+    /**
+     * Switches out of the calling thread once it's marked as sleeping.
+     */
+    void sleep();
+
+    /**
+     * Wakes a sleeping thread, which becomes ready unless it's blocked.
+     * @return 0 on success, -1 if it doesn't exist.
+     */
+    int wake(int tid);
+
+    /**
+     * Ends the quantum of the calling worker's thread, called by its quantum timer.
+     */
+    void preempt();
+
+    /**
+     * Completes the switch into the calling context, see the class's documentation.
+     * Called by the library's thread start function, before the thread first runs.
+     */
+    void finishSwitch();
+
+    /**
+     * Passes a signal that was delivered to a kernel thread which isn't a worker, as a signal sent to the
+     * process may be, on to the first worker.
+     * @return true if it was passed on, false if the calling kernel thread is a worker which should handle it.
+     */
+    bool forwardSignal(int sig);
+
+    /** @return the tid of the calling thread. */
+    int getRunning();
+
+    /** @return the number of quantums started on all the workers, the first one included. */
+    int getTotalQuants();
+
+    /** @return the number of quantums of the thread, -1 if it doesn't exist. */
+    int getQuants(int tid);
+};
+
+
+#endif //EX2_MN_SCHEDULER_H
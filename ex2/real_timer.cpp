@@ -1,23 +1,44 @@
+#include <csignal>
+#include <unistd.h>
+#include <sys/syscall.h>
 #include "real_timer.h"
-static const int CONVERTION_CONST_MSEC_SEC = 1000000;
+static const long long CONVERTION_CONST_SEC_NSEC = 1000000000;
 
-int real_timer::start(int expTime) {
+real_timer::real_timer(long long slack): _slack(slack), _timer(), _created(false) {}
 
-    // Zero timer:
-    _timer.it_value.tv_sec = 0;
-    _timer.it_value.tv_usec = 0;
-    if (setitimer (ITIMER_REAL, &_timer, nullptr)) {
-        return -1;
+real_timer::~real_timer() {
+    if (_created) {
+        timer_delete(_timer);
     }
+}
 
-    // Set Timer
-    int secondsPart = expTime / CONVERTION_CONST_MSEC_SEC;   // down round.
-    int microSecondsPart = expTime - (secondsPart * CONVERTION_CONST_MSEC_SEC);
-    _timer.it_value.tv_sec = secondsPart;
-    _timer.it_value.tv_usec = microSecondsPart;
+int real_timer::start(long long expTime) {
+
+    // Create the timer, signalling the calling kernel thread, the one running the threads:
+    if (!_created) {
+        sigevent event = {};
+        event.sigev_notify = SIGEV_THREAD_ID;
+        event.sigev_signo = SIGALRM;
+        event._sigev_un._tid = (pid_t)syscall(SYS_gettid);
+        if (timer_create(CLOCK_MONOTONIC, &event, &_timer)) {
+            return -1;
+        }
+        _created = true;
+    }
 
-    // Start timer:
-    if (setitimer (ITIMER_REAL, &_timer, nullptr)) {
+    // Coalesce with the expiry times close to it:
+    if (_slack > 0) {
+        expTime = (expTime + _slack - 1) / _slack * _slack;
+    }
+
+    // Set and start the timer, at an absolute time so it never expires early:
+    itimerspec expiry = {};
+    expiry.it_value.tv_sec = expTime / CONVERTION_CONST_SEC_NSEC;
+    expiry.it_value.tv_nsec = expTime % CONVERTION_CONST_SEC_NSEC;
+    if (expiry.it_value.tv_sec == 0 && expiry.it_value.tv_nsec == 0) {
+        expiry.it_value.tv_nsec = 1; // zero would disarm it.
+    }
+    if (timer_settime(_timer, TIMER_ABSTIME, &expiry, nullptr)) {
         return -1;
     }
     return 0;
@@ -4,18 +4,32 @@
 
 #ifndef EX2_REALTIMER_H
 #define EX2_REALTIMER_H
-#include <sys/time.h>
+#include <time.h>
 
 class real_timer {
-    struct itimerval _timer;
+    long long _slack; // in nanoseconds.
+    timer_t _timer;
+    bool _created;
 
 public:
     /**
-     * Starts the timer to run expTime microseconds.
-     * @param expTime: the number of microseconds the timer should count.
+     * Creates a timer on CLOCK_MONOTONIC.
+     * @param slack: the nanoseconds the timer may expire late by, so that close expiry times share one expiry.
+     */
+    explicit real_timer(long long slack);
+
+    /**
+     * Deletes the timer.
+     */
+    ~real_timer();
+
+    /**
+     * Starts the timer to expire at expTime, and to send SIGALRM to the kernel thread that first starts it.
+     * The expiry is rounded up to a multiple of the slack, so all the times within a slack share it.
+     * @param expTime: nanoseconds on CLOCK_MONOTONIC.
      * @return -1 in case of a system error.
      */
-    int start(int expTime);
+    int start(long long expTime);
 
 };
 
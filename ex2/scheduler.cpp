@@ -1,16 +1,51 @@
-
 //#define NDEBUG
 #include <csignal>
 #include "scheduler.h"
 
 /*------------- CONSTRUCTORS ------------*/
-scheduler::scheduler(): _running(MAIN_THREAD_ID) {}
+scheduler::scheduler(thread_manager* manager): _manager(manager), _readyHead(nullptr), _readyTail(nullptr),
+                                               _running(MAIN_THREAD_ID) {}
 
 /*------------- PRIVATE -------------*/
+void scheduler::_pushReady(thread* t) {
+    t->_readyPrev = _readyTail;
+    t->_readyNext = nullptr;
+    if(_readyTail != nullptr){
+        _readyTail->_readyNext = t;
+    }
+    else{
+        _readyHead = t;
+    }
+    _readyTail = t;
+    t->_inReady = true;
+}
+
+void scheduler::_removeReady(thread* t) {
+    if(!t->_inReady){
+        return;
+    }
+    if(t->_readyPrev != nullptr){
+        t->_readyPrev->_readyNext = t->_readyNext;
+    }
+    else{
+        _readyHead = t->_readyNext;
+    }
+    if(t->_readyNext != nullptr){
+        t->_readyNext->_readyPrev = t->_readyPrev;
+    }
+    else{
+        _readyTail = t->_readyPrev;
+    }
+    t->_readyPrev = nullptr;
+    t->_readyNext = nullptr;
+    t->_inReady = false;
+}
+
 void scheduler::_replaceRunning() {
-    assert(!_ready.empty());
-    _running = _ready.front();
-    _ready.pop_front();
+    assert(_readyHead != nullptr);
+    thread* next = _readyHead;
+    _removeReady(next);
+    _running = next->getTid();
 }
 
 void scheduler::_handleBlockOrTermination(int tid) {
@@ -19,7 +54,10 @@ void scheduler::_handleBlockOrTermination(int tid) {
     }
     else{
         // If tid is in _ready, remove it from there:
-        _ready.remove(tid);
+        thread* t = _manager->getThread(tid);
+        if(t != nullptr){
+            _removeReady(t);
+        }
     }
 }
 
@@ -34,7 +72,7 @@ int scheduler::whosNextBlock(int tid) {
 }
 
 int scheduler::whosNextTimeout() {
-    _ready.push_back(_running);
+    _pushReady(_manager->getThread(_running));
     _replaceRunning();
     return _running;
 }
@@ -53,16 +91,16 @@ int scheduler::whosNextSleep() {
 void scheduler::addThread(int tid) {
 
     // If tid is not already in _ready or _running, add it to the end of _ready:
-    auto findIter = std::find(_ready.begin(), _ready.end(), tid);
-    if((tid != _running) && (findIter ==_ready.end())){
-        _ready.push_back(tid);
+    thread* t = _manager->getThread(tid);
+    if((tid != _running) && (t != nullptr) && !t->_inReady){
+        _pushReady(t);
     }
 
 }
 
 void scheduler::printReady() {
-    for(auto & iter : _ready){
-        std::cout << iter << "; ";
+    for(thread* t = _readyHead; t != nullptr; t = t->_readyNext){
+        std::cout << t->getTid() << "; ";
     }
     std::cout << std::endl;
 }
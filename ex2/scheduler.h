@@ -2,9 +2,9 @@
 #ifndef TEMPEX2_SCHEDULER_H
 #define TEMPEX2_SCHEDULER_H
 #include <iostream>
-#include <list>
-#include <algorithm>
 #include <cassert>
+#include "thread.h"
+#include "thread_manager.h"
 
 static const int MAIN_THREAD_ID = 0;
 
@@ -13,9 +13,22 @@ static const int MAIN_THREAD_ID = 0;
  */
 class scheduler
 {
-    std::list<int> _ready;
+    thread_manager* _manager;
+    // the ready queue, a doubly linked list threaded through the threads, so every operation on it is O(1):
+    thread* _readyHead;
+    thread* _readyTail;
     int _running;
 
+    /**
+     * Adds a thread to the end of _ready.
+     */
+    void _pushReady(thread* t);
+
+    /**
+     * Removes a thread from _ready, wherever it is.
+     */
+    void _removeReady(thread* t);
+
     /**
      * Pops the next thread to run from _ready and puts it in _running.
      */
@@ -32,8 +45,9 @@ public:
 
     /**
      * Initializes a new scheduler object with an empty ready queue and _running=0.
+     * @param manager: keeps the threads the scheduler schedules.
      */
-    scheduler();
+    explicit scheduler(thread_manager* manager);
 
     /**
      * Decides who will be the next thread to run in the case the thread with tid got blocked. This method also
@@ -52,6 +66,7 @@ public:
     /**
      * Decides who will be the next thread to run in the case the thread with this tid has terminated. This method also
      * updates the scheduler's internal state according to the decision, and sets _running and ready accordingly.
+     * Should be called before the thread is deleted, since _ready is threaded through it.
      * @return the next tid to run.
      */
     int whosNextTermination(int tid);
@@ -0,0 +1,76 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstdint>
+#include "shared_stack.h"
+#include "context_switch.h"
+
+shared_stack::shared_stack(thread_stack stack, thread_stack switcherStack)
+        : _stack(stack), _switcherStack(switcherStack), _switcherSp(nullptr), _occupant(nullptr), _next(nullptr)
+{
+    _switcherSp = makeContext(_switcherStack.base, _switcherStack.size, &shared_stack::switcherEntry, this);
+}
+
+void shared_stack::switcherEntry(void* self)
+{
+    static_cast<shared_stack*>(self)->switcher();
+}
+
+void shared_stack::switcher()
+{
+    while (true)
+    {
+        moveIn(_next);
+        ::switchContext(&_switcherSp, _next->_sp);
+    }
+}
+
+void shared_stack::moveIn(thread* next)
+{
+    if (_occupant != nullptr && !_occupant->saveStack())
+    {
+        std::cerr << "system error: bad memory allocation when saving the stack of a thread." << std::endl;
+        exit(1);
+    }
+    next->restoreStack();
+    _occupant = next;
+}
+
+thread_stack shared_stack::getStack()
+{
+    return _stack;
+}
+
+thread_stack shared_stack::getSwitcherStack()
+{
+    return _switcherStack;
+}
+
+void shared_stack::switchTo(void** fromSp, thread* next)
+{
+    if (next == _occupant) // its frames are where it left them.
+    {
+        ::switchContext(fromSp, next->_sp);
+        return;
+    }
+    char here;
+    auto sp = (uintptr_t)&here;
+    if (sp >= (uintptr_t)_stack.base && sp < (uintptr_t)(_stack.base + _stack.size))
+    {
+        // The running thread's frames, this one included, are about to be overwritten, so the switcher moves them:
+        _next = next;
+        ::switchContext(fromSp, _switcherSp);
+    }
+    else
+    {
+        moveIn(next);
+        ::switchContext(fromSp, next->_sp);
+    }
+}
+
+void shared_stack::vacate(thread* t)
+{
+    if (_occupant == t)
+    {
+        _occupant = nullptr;
+    }
+}
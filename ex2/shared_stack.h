@@ -0,0 +1,66 @@
+#ifndef EX2_SHARED_STACK_H
+#define EX2_SHARED_STACK_H
+
+#include "thread.h"
+#include "stack_pool.h"
+
+/**
+ * A stack all the threads run on, for the shared stack mode of uthread_init_with_options: a thread keeps its frames
+ * on the stack until another thread is switched to it, which copies the part the thread used aside, to a buffer of
+ * the thread's as large as that part (see thread::saveStack), and copies the other thread's part back in. A thread
+ * that is switched out to the main thread, which runs on the process's stack, keeps its frames in place, so
+ * switching back to it copies nothing.
+ *
+ * The copying is done on a stack of its own, the switcher's, since it overwrites the frames of the running thread.
+ */
+class shared_stack
+{
+    thread_stack _stack;
+    thread_stack _switcherStack;
+    void* _switcherSp; // the context of the switcher, see switcher().
+    thread* _occupant; // the thread whose frames are on the stack, nullptr for none.
+    thread* _next;     // the thread the switcher switches to.
+
+    /**
+     * Copies the frames of the occupant aside and those of next in, next becoming the occupant.
+     * Prints an error and exits if there's no memory to copy the occupant's frames to.
+     */
+    void moveIn(thread* next);
+
+    /**
+     * The loop of the switcher, which moves _next in and switches to it every time it's switched to.
+     */
+    void switcher();
+
+    static void switcherEntry(void* self);
+
+public:
+    /**
+     * Creates a shared stack, on which no thread runs yet.
+     * @param stack: the stack the threads share.
+     * @param switcherStack: the stack of the switcher, which takes the library's signals as any other stack.
+     */
+    shared_stack(thread_stack stack, thread_stack switcherStack);
+
+    /** @return the stack the threads share. */
+    thread_stack getStack();
+
+    /** @return the stack of the switcher. */
+    thread_stack getSwitcherStack();
+
+    /**
+     * Switches the running code, a thread or the main thread, to a thread that runs on the shared stack, as
+     * ::switchContext does. Should be called with the library's signals deferred.
+     * @param fromSp: where to keep the stack pointer of the running code.
+     * @param next: the thread to switch to.
+     */
+    void switchTo(void** fromSp, thread* next);
+
+    /**
+     * Forgets the frames of a thread that is destructed, if they are on the stack.
+     */
+    void vacate(thread* t);
+};
+
+
+#endif //EX2_SHARED_STACK_H
@@ -1,34 +1,82 @@
 #include "sleeping_threads_list.h"
 
+static const size_t ARITY = 4;
+
 SleepingThreadsList::SleepingThreadsList() {
 }
 
+void SleepingThreadsList::place(size_t index, const wake_up_info& info) {
+    sleeping_threads[index] = info;
+    positions[info.id] = (int)index;
+}
+
+void SleepingThreadsList::sift_up(size_t index, wake_up_info info) {
+    while (index > 0) {
+        size_t parent = (index - 1) / ARITY;
+        if (sleeping_threads[parent].awaken_ns <= info.awaken_ns) {
+            break;
+        }
+        place(index, sleeping_threads[parent]);
+        index = parent;
+    }
+    place(index, info);
+}
+
+void SleepingThreadsList::sift_down(size_t index, wake_up_info info) {
+    size_t size = sleeping_threads.size();
+    while (true) {
+        size_t first = index * ARITY + 1;
+        if (first >= size) {
+            break;
+        }
+        size_t last = first + ARITY < size ? first + ARITY : size;
+        size_t earliest = first;
+        for (size_t child = first + 1; child < last; ++child) {
+            if (sleeping_threads[child].awaken_ns < sleeping_threads[earliest].awaken_ns) {
+                earliest = child;
+            }
+        }
+        if (info.awaken_ns <= sleeping_threads[earliest].awaken_ns) {
+            break;
+        }
+        place(index, sleeping_threads[earliest]);
+        index = earliest;
+    }
+    place(index, info);
+}
+
+void SleepingThreadsList::remove_at(size_t index) {
+    positions[sleeping_threads[index].id] = -1;
+    wake_up_info last = sleeping_threads.back();
+    sleeping_threads.pop_back();
+    if (index == sleeping_threads.size()) {
+        return;
+    }
+    // the last entry takes the removed one's place, and moves up or down from there:
+    if (index > 0 && last.awaken_ns < sleeping_threads[(index - 1) / ARITY].awaken_ns) {
+        sift_up(index, last);
+    } else {
+        sift_down(index, last);
+    }
+}
 
 /*
  * Description: This method adds a new element to the list of sleeping
- * threads. It gets the thread's id, and the time when it needs to wake up.
- * The wakeup_tv is a struct timeval (as specified in <sys/time.h>) which
- * contains the number of seconds and microseconds since the Epoch.
- * The method keeps the list sorted by the threads' wake up time.
+ * threads. It gets the thread's id, and the time when it needs to wake up,
+ * in nanoseconds on CLOCK_MONOTONIC. A thread that is already in the list
+ * is moved to its new time.
 */
-void SleepingThreadsList::add(int thread_id, timeval wakeup_tv) {
+void SleepingThreadsList::add(int thread_id, long long wakeup_ns) {
+    if ((size_t)thread_id >= positions.size()) {
+        positions.resize((size_t)thread_id + 1, -1);
+    }
+    remove(thread_id);
 
     wake_up_info new_thread;
     new_thread.id = thread_id;
-    new_thread.awaken_tv = wakeup_tv;
-
-    if(sleeping_threads.empty()){
-        sleeping_threads.push_front(new_thread);
-    }
-    else {
-        for (deque<wake_up_info>::iterator it = sleeping_threads.begin(); it != sleeping_threads.end(); ++it){
-            if(timercmp(&it->awaken_tv, &wakeup_tv, >=)){
-                sleeping_threads.insert(it, new_thread);
-                return;
-            }
-        }
-        sleeping_threads.push_back(new_thread);
-    }
+    new_thread.awaken_ns = wakeup_ns;
+    sleeping_threads.push_back(new_thread);
+    sift_up(sleeping_threads.size() - 1, new_thread);
 }
 
 /*
@@ -37,16 +85,27 @@ void SleepingThreadsList::add(int thread_id, timeval wakeup_tv) {
 */
 void SleepingThreadsList::pop() {
     if(!sleeping_threads.empty())
-        sleeping_threads.pop_front();
+        remove_at(0);
+}
+
+/*
+ * Description: This method removes the thread with the given id from this
+ * list, when it's terminated while it sleeps.
+ * If it isn't in the list, it does nothing.
+*/
+void SleepingThreadsList::remove(int thread_id) {
+    if (thread_id < 0 || (size_t)thread_id >= positions.size() || positions[thread_id] == -1)
+        return;
+    remove_at((size_t)positions[thread_id]);
 }
 
 /*
  * Description: This method returns the information about the thread (id and time it needs to wake up)
- * at the top of this list without removing it from the list.
+ * with the earliest wake up time, without removing it from the list.
  * If the list is empty, it returns null.
 */
 wake_up_info* SleepingThreadsList::peek(){
     if (sleeping_threads.empty())
         return nullptr;
-    return &sleeping_threads.at(0);
+    return &sleeping_threads[0];
 }
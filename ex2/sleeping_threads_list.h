@@ -1,19 +1,29 @@
 #ifndef SLEEPING_THREADS_LIST_H
 #define SLEEPING_THREADS_LIST_H
 
-#include <deque>
-#include <sys/time.h>
+#include <vector>
 
 using namespace std;
 
 struct wake_up_info {
     int id;
-    timeval awaken_tv;
+    long long awaken_ns; // on CLOCK_MONOTONIC.
 };
 
 class SleepingThreadsList {
 
-    deque<wake_up_info> sleeping_threads;
+    // A 4-ary min heap on the wake up times, shallower than a binary one and with a node's children on one cache line.
+    vector<wake_up_info> sleeping_threads;
+    vector<int> positions; // the index of every tid's entry in sleeping_threads, -1 for a tid that isn't in it.
+
+    void place(size_t index, const wake_up_info& info);
+    void sift_up(size_t index, wake_up_info info);
+    void sift_down(size_t index, wake_up_info info);
+
+    /*
+     * Removes the entry at index, keeping the heap order.
+     */
+    void remove_at(size_t index);
 
 public:
 
@@ -21,12 +31,11 @@ public:
 
     /*
      * Description: This method adds a new element to the list of sleeping
-     * threads. It gets the thread's id, and the time when it needs to wake up.
-     * The wakeup_tv is a struct timeval (as specified in <sys/time.h>) which
-     * contains the number of seconds and microseconds since the Epoch.
-     * The method keeps the list sorted by the threads' wake up time.
+     * threads. It gets the thread's id, and the time when it needs to wake up,
+     * in nanoseconds on CLOCK_MONOTONIC. A thread that is already in the list
+     * is moved to its new time.
     */
-    void add(int thread_id, timeval timestamp);
+    void add(int thread_id, long long wakeup_ns);
 
     /*
      * Description: This method removes the thread at the top of this list.
@@ -34,9 +43,17 @@ public:
     */
     void pop();
 
+    /*
+     * Description: This method removes the thread with the given id from this
+     * list, when it's terminated while it sleeps.
+     * If it isn't in the list, it does nothing.
+    */
+    void remove(int thread_id);
+
     /*
      * Description: This method returns the information about the thread (id and time it needs to wake up)
-     * at the top of this list without removing it from the list.
+     * with the earliest wake up time, without removing it from the list.
+     * The pointer is valid until the list is changed.
      * If the list is empty, it returns null.
     */
     wake_up_info* peek();
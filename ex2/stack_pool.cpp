@@ -0,0 +1,90 @@
+#include <unistd.h>
+#include <sys/auxv.h>
+#include <sys/mman.h>
+#include "stack_pool.h"
+
+#ifndef MADV_FREE
+#define MADV_FREE MADV_DONTNEED // kernels before 4.5 only have the eager version.
+#endif
+#ifndef MADV_GUARD_INSTALL
+#define MADV_GUARD_INSTALL 102 // Linux 6.13, newer than most headers.
+#endif
+
+static const size_t HOT_STACKS = 16;            // released stacks per size whose pages are kept, to be reused first.
+static const size_t HANDLER_RESERVE = 8 * 1024; // the library's signal handling, on top of the kernel's frame.
+static const size_t DEFAULT_SIGNAL_FRAME = 4096;
+
+stack_pool::stack_pool() : _pageSize((size_t)sysconf(_SC_PAGESIZE)), _minSize(0), _free()
+{
+    // The kernel's signal frame grows with the CPU's register state, which it tells the size of:
+    size_t signalFrame = getauxval(AT_MINSIGSTKSZ);
+    if (signalFrame == 0)
+    {
+        signalFrame = DEFAULT_SIGNAL_FRAME;
+    }
+    _minSize = (signalFrame + HANDLER_RESERVE + _pageSize - 1) / _pageSize * _pageSize;
+}
+
+stack_pool::~stack_pool()
+{
+    for (auto& sizeAndList : _free)
+    {
+        for (char* mapping : sizeAndList.second.stacks)
+        {
+            munmap(mapping, sizeAndList.first + _pageSize);
+        }
+    }
+}
+
+thread_stack stack_pool::allocate(size_t size)
+{
+    size = (size + _pageSize - 1) / _pageSize * _pageSize;
+    if (size < _minSize)
+    {
+        size = _minSize;
+    }
+
+    auto found = _free.find(size);
+    if (found != _free.end() && !found->second.stacks.empty())
+    {
+        free_list& list = found->second;
+        char* mapping = list.stacks.back();
+        list.stacks.pop_back();
+        if (list.advised > list.stacks.size())
+        {
+            list.advised = list.stacks.size();
+        }
+        return {mapping + _pageSize, size};
+    }
+
+    void* mapping = mmap(nullptr, size + _pageSize, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_NORESERVE, -1, 0);
+    if (mapping == MAP_FAILED)
+    {
+        return {nullptr, 0};
+    }
+    // A guard page made by mprotect splits the mapping in two, and a process may only have vm.max_map_count
+    // (65530 by default) mappings, so the kernel's guard regions, which don't, are used where it has them. Past the
+    // limit, a stack goes without a guard page rather than the thread without a stack.
+    if (madvise(mapping, _pageSize, MADV_GUARD_INSTALL))
+    {
+        mprotect(mapping, _pageSize, PROT_NONE);
+    }
+    return {static_cast<char*>(mapping) + _pageSize, size};
+}
+
+void stack_pool::release(thread_stack stack)
+{
+    if (stack.base == nullptr)
+    {
+        return;
+    }
+    free_list& list = _free[stack.size];
+    list.stacks.push_back(stack.base - _pageSize);
+    // the stack that sank below the hot ones gives its pages back:
+    if (list.stacks.size() - list.advised > HOT_STACKS)
+    {
+        madvise(list.stacks[list.advised] + _pageSize, stack.size, MADV_FREE);
+        list.advised++;
+    }
+}
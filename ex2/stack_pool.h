@@ -0,0 +1,62 @@
+#ifndef EX2_STACK_POOL_H
+#define EX2_STACK_POOL_H
+
+#include <map>
+#include <vector>
+#include <cstddef>
+
+/**
+ * A stack of a thread: the memory it may use, right above a guard page.
+ */
+struct thread_stack
+{
+    char* base;  // the lowest usable address, nullptr for no stack.
+    size_t size; // the usable bytes, a whole number of pages.
+};
+
+/**
+ * Hands out the threads' stacks, each mapped with an inaccessible guard page below it, so a thread that overflows its
+ * stack faults rather than overwriting whatever lies below. Released stacks are kept for the next thread of the same
+ * size, so spawning and terminating threads makes no system call once the pool has the stacks it needs. The stacks
+ * released most recently are reused first; the pages of those below them are handed back to the kernel with
+ * MADV_FREE, which only reclaims them if memory runs short.
+ */
+class stack_pool
+{
+    struct free_list
+    {
+        std::vector<char*> stacks; // the mappings, their guard page first, most recently released last.
+        size_t advised;            // stacks[0] to stacks[advised-1] have had their pages freed.
+    };
+
+    size_t _pageSize;
+    size_t _minSize;
+    std::map<size_t, free_list> _free; // by the usable size of their stacks.
+
+public:
+    /**
+     * Creates an empty pool.
+     */
+    stack_pool();
+
+    /**
+     * Unmaps the stacks in the pool. Stacks that weren't released are left mapped.
+     */
+    ~stack_pool();
+
+    /**
+     * Takes a stack of at least size bytes: rounded up to whole pages, and to the least a thread needs to take a
+     * signal, whose frame is written on the stack of the thread it interrupts.
+     * @param size: the requested size in bytes.
+     * @return the stack, whose base is nullptr if it couldn't be mapped.
+     */
+    thread_stack allocate(size_t size);
+
+    /**
+     * Returns a stack taken by allocate to the pool. A stack with a nullptr base is ignored.
+     */
+    void release(thread_stack stack);
+};
+
+
+#endif //EX2_STACK_POOL_H
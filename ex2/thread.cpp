@@ -1,86 +1,74 @@
 #include <iostream>
+#include <cstdlib>
 #include "thread.h"
+#include "context_switch.h"
 
+static const size_t SAVED_GRANULE = 256; // the copies of the shared stack are sized in multiples of it.
 
 
 //-------------------helpers--------------------------------------------------------------------------------------------
-#ifdef __x86_64__
-/* code for 64 bit Intel arch */
 
-typedef unsigned long address_t;
-#define JB_SP 6
-#define JB_PC 7
-
-/* A translation is required when using an address of a variable.
-   Use this as a black box in your code. */
-address_t thread::translateAddress(address_t addr)
-{
-    address_t ret;
-    asm volatile("xor    %%fs:0x30,%0\n"
-                 "rol    $0x11,%0\n"
-    : "=g" (ret)
-    : "0" (addr));
-    return ret;
-}
-
-#else
-/* code for 32 bit Intel arch */
-
-typedef unsigned int address_t;
-#define JB_SP 4
-#define JB_PC 5
-
-/* A translation is required when using an address of a variable.
-   Use this as a black box in your code. */
-address_t thread::translateAddress(address_t addr)
+void thread::start(void* self)
 {
-    address_t ret;
-    asm volatile("xor    %%gs:0x18,%0\n"
-		"rol    $0x9,%0\n"
-                 : "=g" (ret)
-                 : "0" (addr));
-    return ret;
+    auto* t = static_cast<thread*>(self);
+    if (t->_onStart != nullptr)
+    {
+        t->_onStart();
+    }
+    t->_func();
 }
 
-#endif
-
 //-----------------Constructor & Destructor ----------------------------------------------------------------------------
 
-thread::thread()
-        :_quants(0), _isBlocked(false), _isSleeping(false) {}
+thread::thread(int tid)
+        :_tid(tid), _stack{nullptr, 0}, _func(nullptr), _onStart(nullptr), _sharesStack(false),
+         _saved(nullptr), _savedSize(0), _savedCapacity(0), _quants(0), _isBlocked(false),
+         _isSleeping(false), _sp(nullptr), _readyPrev(nullptr), _readyNext(nullptr), _inReady(false) {}
 
 
-thread::~thread()
-{
-    //will not be called foe the main thread so will not cause an error.
-    delete _stack;
+thread::~thread(){
+    free(_saved); // the stack belongs to the thread_manager, see releaseStack.
 }
 
 //----------------- general functionality-------------------------------------------------------------------------------
 
-int thread::setupThread(void(*f)(), int stackSize)
+void thread::setupThread(void(*f)(), thread_stack stack, void(*onStart)(), bool shared)
 {
-    try{
-        _stack = new char[stackSize];
-    }
-    catch (std::bad_alloc& e)
+    _stack = stack;
+    _func = f;
+    _onStart = onStart;
+    _sharesStack = shared;
+    _sp = shared ? nullptr : makeContext(_stack.base, _stack.size, &thread::start, this);
+}
+
+bool thread::saveStack()
+{
+    size_t size = _stack.base + _stack.size - static_cast<char*>(_sp);
+    // grows the copy as needed, and shrinks it once the thread uses far less, so an idle thread keeps little:
+    if (size > _savedCapacity || size < _savedCapacity / 4)
     {
-        std::cerr << "system error: bad memory allocation when creating thread." << std::endl;
-        return -2;
+        size_t capacity = (size + SAVED_GRANULE - 1) / SAVED_GRANULE * SAVED_GRANULE;
+        auto* saved = static_cast<char*>(realloc(_saved, capacity));
+        if (saved == nullptr)
+        {
+            return false;
+        }
+        _saved = saved;
+        _savedCapacity = capacity;
     }
-    address_t sp = (address_t) _stack + stackSize - sizeof(address_t);
-    auto pc = (address_t)f;
-    auto translatedSp = translateAddress(sp);
-    auto translatedPc = translateAddress(pc);
-    sigsetjmp(_env, 1);
-    (_env->__jmpbuf)[JB_SP] = translatedSp;
-    (_env->__jmpbuf)[JB_PC] = translatedPc;
-    if (sigemptyset(&_env->__saved_mask) == -1)
+    memcpy(_saved, _sp, size);
+    _savedSize = size;
+    return true;
+}
+
+void thread::restoreStack()
+{
+    if (_sp == nullptr)
     {
-        std::cerr << "system error: " << strerror(errno) << std::endl;
-        return -2;
+        _sp = makeContext(_stack.base, _stack.size, &thread::start, this);
+        return;
     }
-    return 0;
+    memcpy(_sp, _saved, _savedSize);
 }
 
 void thread::setBlocked(bool isBlocked){
@@ -99,11 +87,21 @@ bool thread::getSleep(){
     return _isSleeping;
 }
 
-void thread::updateQuants(){
-    _quants++;
+thread_stack thread::releaseStack(){
+    thread_stack stack = _sharesStack ? thread_stack{nullptr, 0} : _stack;
+    _stack = {nullptr, 0};
+    return stack;
+}
+
+int thread::getTid(){
+    return _tid;
+}
+
+void thread::updateQuants(int quants){
+    _quants.fetch_add(quants, std::memory_order_relaxed);
 }
 
 int thread::getQuants(){
-    return _quants;
+    return _quants.load(std::memory_order_relaxed);
 }
 
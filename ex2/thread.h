@@ -2,14 +2,13 @@
 #define TEMPEX2_THREAD_H
 
 #include <stdio.h>
-#include <setjmp.h>
 #include <signal.h>
 #include <unistd.h>
 #include <sys/time.h>
 #include <errno.h>
 #include <cstring>
-
-typedef unsigned long address_t;
+#include <atomic>
+#include "stack_pool.h"
 
 /**
  * This class is a "ticket" which saves on it the thread's information. It is supposed to be
@@ -17,28 +16,40 @@ typedef unsigned long address_t;
  */
 class thread
 {
-    char* _stack;
-    int _quants; // holds the number of quantums this thread spent as RUNNING.
+    int _tid;
+    thread_stack _stack;
+    void (*_func)();    // the function the thread executes.
+    void (*_onStart)(); // called on the thread's stack before _func, nullptr for none.
+    bool _sharesStack;  // _stack is shared with other threads, see shared_stack.h.
+    char* _saved;       // the thread's part of the shared stack while another thread runs on it.
+    size_t _savedSize;
+    size_t _savedCapacity;
+    std::atomic<int> _quants; // holds the number of quantums this thread spent as RUNNING, read by other workers.
     bool _isBlocked;
     bool _isSleeping;
 
-    /** translates the address of a variable, Used as a black box in our code.
-     * @param addr the address of a variable.
-     * @return the translation of the address of the variable.
+    /**
+     * The start of every thread but the main one, on its own stack.
+     * @param self: the thread.
      */
-    address_t translateAddress(address_t addr);
+    static void start(void* self);
 
 public:
-    sigjmp_buf _env;
+    void* _sp; // the stack pointer the thread was switched out at, see context_switch.h.
+
+    // links of the scheduler's ready queue, which is threaded through the threads themselves:
+    thread* _readyPrev;
+    thread* _readyNext;
+    bool _inReady;
 
     /**
      * Creates a new thread object.
-     * @param env : the address of the thread's environment.
+     * @param tid : the thread's id.
      */
-    explicit thread();
+    explicit thread(int tid);
 
     /**
-     * destructs this thread object.
+     * destructs this thread object, and the copy of its part of the shared stack.
      */
     ~thread();
 
@@ -46,10 +57,24 @@ public:
     /**
      * sets up the thread context
      * @param f : The function the thread should execute.
-     * @param stackSize: The size of the thread's size.
-     * @return 0 on success. if failed: prints the error and returns -1.
+     * @param stack: The thread's stack, which it keeps until releaseStack.
+     * @param onStart: called by the thread before f, once it's first switched to, nullptr for none.
+     * @param shared: the stack is shared with other threads (see shared_stack.h), so the thread's first context is
+     * only laid out on it by restoreStack, and releaseStack gives nothing back.
+     */
+    void setupThread(void(*f)(), thread_stack stack, void(*onStart)() = nullptr, bool shared = false);
+
+    /**
+     * Copies the thread's part of the shared stack, from _sp to its top, aside, resizing the copy to fit.
+     * @return false if there is no memory for the copy.
+     */
+    bool saveStack();
+
+    /**
+     * Copies the thread's part of the shared stack back from the copy saveStack made, or lays out the thread's first
+     * context on it if it hasn't run yet.
      */
-    int setupThread(void(*f)(), int stackSize);
+    void restoreStack();
 
     /**
      * Updates the _setBlocked parameter.
@@ -75,6 +100,18 @@ public:
      */
     bool getSleep();
 
+    /**
+     * Hands the thread's stack over to the caller, the thread is left with no stack.
+     * @return the stack, whose base is nullptr for the main thread and the threads of a shared stack.
+     */
+    thread_stack releaseStack();
+
+    /**
+     * Returns the thread's id.
+     * @return
+     */
+    int getTid();
+
     /**
      * Returns the number of quantums in which the thread had been active.
      * @return
@@ -82,9 +119,9 @@ public:
     int getQuants();
 
     /**
-     * Increments the value of _quants in 1.
+     * Increments the value of _quants in quants, 1 by default.
      */
-    void updateQuants();
+    void updateQuants(int quants = 1);
 
 
 };
@@ -1,89 +1,161 @@
 
 #include <iostream>
+#include <new>
 #include "thread.h"
 #include "thread_manager.h"
+#include "context_switch.h"
 
-typedef unsigned long address_t;
+static const int TCB_SLAB_SIZE = 1024; // the number of threads every slab of the threads' storage holds.
 
 //-----Private helpers-----------------------------------------------------------------------------
 
 thread *thread_manager::findThread(const int tid)
 {
-    auto pairTidThread = _threads.find(tid);
-    if (pairTidThread != _threads.end())
+    if (tid >= 0 && tid < _maxThreadNum)
     {
-        return pairTidThread->second;
+        return _threads[tid];
     }
     return nullptr;
 }
 
-int thread_manager::getSmallestTid()
+thread *thread_manager::constructThread(const int tid)
 {
-    if (!_usedIds.empty())
+    size_t slab = tid / TCB_SLAB_SIZE;
+    if (_slabs[slab] == nullptr)
     {
-        int smallestId = _usedIds.top();
-        _usedIds.pop();
-        return smallestId;
+        try{
+            _slabs[slab] = static_cast<thread*>(::operator new(TCB_SLAB_SIZE * sizeof(thread)));
+        }
+        catch (std::bad_alloc& e)
+        {
+            std::cerr << "system error: bad memory allocation when creating thread." << std::endl;
+            return nullptr;
+        }
+    }
+    return new (&_slabs[slab][tid % TCB_SLAB_SIZE]) thread(tid);
+}
+
+void thread_manager::destructThread(const int tid)
+{
+    if (_sharedStack != nullptr)
+    {
+        _sharedStack->vacate(_threads[tid]);
     }
-    return ++_largestId;
+    _stacks.release(_deadStack);
+    _deadStack = _threads[tid]->releaseStack();
+    _threads[tid]->~thread();
+    _threads[tid] = nullptr;
+    _tids.release(tid); //recycles this tid
 }
 
 
 //--- Constructor& Destructor--------------------------------------------------------------------------------
 
 thread_manager::thread_manager(const int quantum_usecs, const int maxThreadNum,
-                               const int stackSize):
-                               _maxThreadNum(maxThreadNum),_stackSize(stackSize),
-                               _quantumUsecs(quantum_usecs), _largestId(0), _usedIds(), _threads()
+                               const int stackSize, void (*threadStart)(), const bool sharesStack):
+                               _maxThreadNum(maxThreadNum),_stackSize(stackSize), _threadStart(threadStart),
+                               _quantumUsecs(quantum_usecs), _tids(maxThreadNum), _threads(maxThreadNum, nullptr),
+                               _slabs((maxThreadNum + TCB_SLAB_SIZE - 1) / TCB_SLAB_SIZE, nullptr),
+                               _stacks(), _deadStack{nullptr, 0}, _sharesStack(sharesStack), _sharedStack(nullptr)
                                {}
 
 thread_manager::~thread_manager()
 {
-    thread *threadWithTid = findThread(0);
-    delete threadWithTid;
+    for (int tid = 0; tid < _maxThreadNum; ++tid)
+    {
+        if (_threads[tid] != nullptr)
+        {
+            destructThread(tid);
+        }
+    }
+    _stacks.release(_deadStack);
+    if (_sharedStack != nullptr)
+    {
+        _stacks.release(_sharedStack->getStack());
+        _stacks.release(_sharedStack->getSwitcherStack());
+        delete _sharedStack;
+    }
+    for (thread *slab : _slabs)
+    {
+        ::operator delete(slab);
+    }
 }
 
 //----Class functionality--------------------------------------------------------------------------
 
+thread *thread_manager::getThread(const int tid)
+{
+    return findThread(tid);
+}
+
 int thread_manager::threadManagerSetup()
 {
-    //creates representation of main thread:
-    thread *mainThread;
-    try{
-         mainThread = new thread();
-    }
-    catch (std::bad_alloc& e)
+    //creates representation of main thread, which takes the tid 0:
+    int mainTid = _tids.allocate();
+    thread *mainThread = constructThread(mainTid);
+    if (mainThread == nullptr)
     {
-        std::cerr << "system error: bad memory allocation when creating thread." << std::endl;
+        _tids.release(mainTid);
         return -2;
     }
     mainThread->updateQuants();
-    if (_threads.insert({0, mainThread}).second) // if the insertion took place successfully
+    _threads[mainTid] = mainThread;
+
+    if (_sharesStack)
     {
-        return 0;
+        thread_stack stack = _stacks.allocate(_stackSize);
+        thread_stack switcherStack = _stacks.allocate(0); // the least a stack may have, for the switcher's signals.
+        if (stack.base == nullptr || switcherStack.base == nullptr)
+        {
+            std::cerr << "system error: failed to map the shared stack." << std::endl;
+            _stacks.release(stack);
+            _stacks.release(switcherStack);
+            return -2;
+        }
+        try{
+            _sharedStack = new shared_stack(stack, switcherStack);
+        }
+        catch (std::bad_alloc& e)
+        {
+            std::cerr << "system error: bad memory allocation when creating the shared stack." << std::endl;
+            _stacks.release(stack);
+            _stacks.release(switcherStack);
+            return -2;
+        }
     }
-    std::cerr << "system error: couldn't insert new thread to threads list." << std::endl;
-    return -2;
-
+    return 0;
 }
 
-int thread_manager::createThread(void (*f)())
+int thread_manager::createThread(void (*f)(), int stackSize)
 {
-    if ((int)_threads.size() < _maxThreadNum)
+    int newTid = _tids.allocate();
+    if (newTid == -1) // all the tids are taken
     {
-        int newTid = getSmallestTid();
-        auto *newThread = new thread();
-        if (!newThread->setupThread(f, _stackSize))
-        {
-            if (_threads.insert({newTid, newThread}).second) // if the insertion took place successfully
-            {
-                return newTid;
-            }
-            std::cerr << "system error: couldn't insert new thread to threads list." << std::endl;
-        }
+        return -1;
+    }
+    thread *newThread = constructThread(newTid);
+    if (newThread == nullptr)
+    {
+        _tids.release(newTid);
         return -2;
     }
-    return -1;
+    if (_sharedStack != nullptr)
+    {
+        _threads[newTid] = newThread;
+        newThread->setupThread(f, _sharedStack->getStack(), _threadStart, true);
+        return newTid;
+    }
+    thread_stack stack = _stacks.allocate(stackSize > 0 ? stackSize : _stackSize);
+    if (stack.base == nullptr)
+    {
+        std::cerr << "system error: failed to map the stack of a thread." << std::endl;
+        newThread->~thread();
+        _tids.release(newTid);
+        return -2;
+    }
+    _threads[newTid] = newThread;
+    newThread->setupThread(f, stack, _threadStart);
+    return newTid;
 }
 
 int thread_manager::killThread(const int tid)
@@ -91,9 +163,7 @@ int thread_manager::killThread(const int tid)
     thread *threadWithTid = findThread(tid);
     if (threadWithTid != nullptr)
     {
-        delete threadWithTid;
-        _threads.erase(tid);
-        _usedIds.push(tid); //recycles this tid
+        destructThread(tid);
         return 0;
     }
     return -1;
@@ -176,18 +246,19 @@ void thread_manager::switchContext(int currTid, int nextTid)
 
     assert(nextThread != nullptr);
 
-    _threads[nextTid]->updateQuants();
+    nextThread->updateQuants();
 
     if (currTid != nextTid)
     {
-        if(currThread == nullptr) // currThread terminated itself, can't save it's context, just jmp to nextThread
+        void *discardedSp; // currThread terminated itself, there is no need to save it's context
+        void **currSp = currThread == nullptr ? &discardedSp : &currThread->_sp;
+        if (_sharedStack != nullptr && nextTid != 0) // the main thread runs on the process's stack.
         {
-            siglongjmp(nextThread->_env, 1);
+            _sharedStack->switchTo(currSp, nextThread);
         }
-        int retVal = sigsetjmp(currThread->_env, 1);
-        if (retVal == 0)
+        else
         {
-            siglongjmp(nextThread->_env, 1);
+            ::switchContext(currSp, nextThread->_sp);
         }
     }
-}
\ No newline at end of file
+}
@@ -6,28 +6,33 @@
 #include <cassert>
 
 //data structures:
-#include <queue>
-#include <unordered_map>
-#include <cassert>
+#include <vector>
 
 //context switch handling:
-#include <setjmp.h>
 #include <signal.h>
 #include <unistd.h>
 #include <sys/time.h>
 
 //classes:
 #include "thread.h"
+#include "tid_allocator.h"
+#include "stack_pool.h"
+#include "shared_stack.h"
 
 
 class thread_manager
 {
     int _maxThreadNum;
     int _stackSize;
+    void (*_threadStart)();
     int _quantumUsecs;
-    int _largestId;
-    std::priority_queue<int, std::vector<int>, std::greater<int>> _usedIds;
-    std::unordered_map<int, thread*> _threads;
+    tid_allocator _tids;
+    std::vector<thread*> _threads; // indexed by tid, nullptr for the tids of no thread.
+    std::vector<thread*> _slabs;   // the storage of the threads, TCB_SLAB_SIZE per slab, allocated as tids reach it.
+    stack_pool _stacks;
+    thread_stack _deadStack;       // the stack of the last destructed thread, which may still be running on it.
+    bool _sharesStack;
+    shared_stack* _sharedStack;    // the stack of every thread but the main one if _sharesStack, nullptr otherwise.
 
 
     /**
@@ -39,23 +44,41 @@ class thread_manager
     thread *findThread(int tid);
 
     /**
-     * handles the tid assignments.
-     * @return the smallest tid available for assignment.
+     * constructs a thread object in the slot of the supplied tid, allocating the slot's slab if needed.
+     * @param tid the tid of the new thread.
+     * @return the new thread, nullptr if its slab couldn't be allocated.
+     */
+    thread *constructThread(int tid);
+
+    /**
+     * destructs the thread with the supplied tid and frees its tid, leaving its slot for the next thread.
+     * a thread that terminates itself runs on its stack until the context switch, so the stack is only returned to
+     * the pool once the next thread is destructed.
+     * @param tid the tid of an existing thread.
      */
-    int getSmallestTid();
+    void destructThread(int tid);
 
 
 public:
 
-    /** constructs a thread_manager object*/
+    /** constructs a thread_manager object, of at most maxThreadNum threads (the main thread included).
+     * threadStart is called by every new thread when it first runs, nullptr for nothing.
+     * if sharesStack, the threads but the main one all run on a single stack of stackSize bytes (see shared_stack.h)
+     * rather than on stacks of their own.*/
     thread_manager(int quantum_usecs, int maxThreadNum,
-                   int stackSize);
+                   int stackSize, void (*threadStart)() = nullptr, bool sharesStack = false);
 
     /** destructs this thread_manager object*/
     ~thread_manager();
 
     /**
-     * initializes the thread_manager object: creates representation of main thread.
+    * @param tid the tid to search by.
+    * @return the thread whose tid is the supplied one, nullptr if no such thread exists.
+    */
+    thread *getThread(int tid);
+
+    /**
+     * initializes the thread_manager object: creates representation of main thread, and the shared stack if any.
      * @return 0 on success, prints error and returns -2 on system fail.
      */
     int threadManagerSetup();
@@ -63,11 +86,13 @@ public:
     /**
      * Creates a new thread object.
      * @param f : The function the thread should execute.
+     * @param stackSize : The size of the thread's stack, 0 for the size the manager was constructed with.
+     * ignored if the threads share a stack.
      * @return the new thread's tid, a non negative int.
       * -1 if the new thread could not be created.
       * prints an error and returns -2 if a system error occurred.
      */
-    int createThread(void (*f)());
+    int createThread(void (*f)(), int stackSize = 0);
 
     /**
     * deletes the thread with the supplied tid, if exists.
@@ -124,7 +149,9 @@ public:
     int getThreadQuants(int tid);
 
     /**
-     * switches the context of the
+     * switches the context of the running thread to another one, without saving or restoring the signal mask (see
+     * context_switch.h), so it should be called between enterLibrary and leaveLibrary, with the library's signals
+     * deferred.
      * @param currTid : the tid of the thread we want to switch from
      * @param nextTid : the tid of the thread we want to switch to.
      */
@@ -0,0 +1,49 @@
+#include "tid_allocator.h"
+
+static const int WORD_BITS = 64;
+
+tid_allocator::tid_allocator(int capacity)
+        : _capacity(capacity), _free((capacity + WORD_BITS - 1) / WORD_BITS, ~0ULL),
+          _summary((_free.size() + WORD_BITS - 1) / WORD_BITS, 0), _firstSummary(0)
+{
+    // The last word may hold bits past the capacity, which are never free:
+    if (_capacity % WORD_BITS != 0)
+    {
+        _free.back() = (1ULL << (_capacity % WORD_BITS)) - 1;
+    }
+    for (size_t w = 0; w < _free.size(); ++w)
+    {
+        _summary[w / WORD_BITS] |= 1ULL << (w % WORD_BITS);
+    }
+}
+
+int tid_allocator::allocate()
+{
+    while (_firstSummary < _summary.size() && _summary[_firstSummary] == 0)
+    {
+        ++_firstSummary;
+    }
+    if (_firstSummary == _summary.size())
+    {
+        return -1;
+    }
+    size_t w = _firstSummary * WORD_BITS + __builtin_ctzll(_summary[_firstSummary]);
+    int bit = __builtin_ctzll(_free[w]);
+    _free[w] &= _free[w] - 1; // clears the lowest set bit.
+    if (_free[w] == 0)
+    {
+        _summary[w / WORD_BITS] &= ~(1ULL << (w % WORD_BITS));
+    }
+    return (int)(w * WORD_BITS) + bit;
+}
+
+void tid_allocator::release(int tid)
+{
+    size_t w = tid / WORD_BITS;
+    _free[w] |= 1ULL << (tid % WORD_BITS);
+    _summary[w / WORD_BITS] |= 1ULL << (w % WORD_BITS);
+    if (w / WORD_BITS < _firstSummary)
+    {
+        _firstSummary = w / WORD_BITS;
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef EX2_TID_ALLOCATOR_H
+#define EX2_TID_ALLOCATOR_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Hands out the tids of the library, always the smallest free one, from a bitmap of the free tids.
+ * A second bitmap marks the words of the first one that have a free tid, so finding the smallest free tid takes a
+ * find-first-set on a summary word and on the word it points to, rather than a scan of every tid.
+ */
+class tid_allocator
+{
+    int _capacity;
+    std::vector<uint64_t> _free;    // bit i of word w is set iff the tid 64*w+i is free.
+    std::vector<uint64_t> _summary; // bit i of word s is set iff the word 64*s+i of _free has a free tid.
+    size_t _firstSummary;           // no summary word before this one has a set bit.
+
+public:
+    /**
+     * Creates an allocator of the tids 0 to capacity-1, all of them free.
+     * @param capacity: the number of tids.
+     */
+    explicit tid_allocator(int capacity);
+
+    /**
+     * Takes the smallest free tid.
+     * @return the tid, or -1 if all the tids are taken.
+     */
+    int allocate();
+
+    /**
+     * Frees a tid taken by allocate, so it may be handed out again.
+     * @param tid: the tid to free.
+     */
+    void release(int tid);
+};
+
+
+#endif //EX2_TID_ALLOCATOR_H
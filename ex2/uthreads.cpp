@@ -5,13 +5,16 @@
 #include "virtual_timer.h"
 #include "real_timer.h"
 #include "sleeping_threads_list.h"
+#include "mn_scheduler.h"
 
 #include <signal.h>
+#include <time.h>
+#include <atomic>
 
 
 //--------------Consts:
-static const int CONVERT_CONST_SEC_TO_NSEC = 1000000000;
-static const int CONVERT_CONST_MSEC_TO_NSEC = 1000;
+static const long long CONVERT_CONST_SEC_TO_NSEC = 1000000000;
+static const long long CONVERT_CONST_USEC_TO_NSEC = 1000;
 
 //-------------Error Massages:
 static const int sysError = -2;
@@ -28,22 +31,47 @@ static scheduler* scheduler;
 static virtual_timer* vTimer;
 static real_timer* rTimer;
 static int totalQuants = 0;
-static sigset_t toBlock;        // A set of signals to block where critical code is executed.
+static bool tickless = false;    // stop the quantum timer while the running thread is the only one ready to run.
+static bool tickStopped = false; // the quantum timer is stopped, the running thread starts quantums uncounted.
+static mn_scheduler* mnScheduler = nullptr; // schedules the threads instead of scheduler with options->workers.
+
+// The flags of a kernel thread, see enterLibrary. inLibrary is set while the running thread is inside the library,
+// where the signal handlers only leave a note for it to act on once it leaves:
+struct library_flags {
+    volatile sig_atomic_t inLibrary;
+    volatile sig_atomic_t pendingPreempt; // the quantum ended inside the library.
+    volatile sig_atomic_t pendingWake;    // the sleep timer expired inside the library.
+};
+static thread_local library_flags kernelThreadFlags = {0, 0, 0};
+
+/**
+ * @return the flags of the kernel thread running the calling code. Not inlined, and opaque to the compiler, so the
+ * address of kernelThreadFlags isn't kept across a context switch, which may move the calling thread to another
+ * kernel thread with workers.
+ */
+static __attribute__((noinline)) library_flags* currentFlags(){
+    library_flags* flags = &kernelThreadFlags;
+    asm volatile("" : "+r"(flags));
+    return flags;
+}
 
 //-------------Sleep
 /**
- * Computes the time of day in which the thread is going to wake up.
+ * @return the time on CLOCK_MONOTONIC, in nanoseconds.
+ */
+static long long monotonicNsecs() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * CONVERT_CONST_SEC_TO_NSEC + now.tv_nsec;
+}
+
+/**
+ * Computes the time in which the thread is going to wake up.
  * @param usecs_to_sleep
- * @return
+ * @return the time on CLOCK_MONOTONIC, in nanoseconds.
  */
-static timeval calcWakUpTimeval(int usecs_to_sleep) {
-
-    timeval now, time_to_sleep, wake_up_timeval;
-    gettimeofday(&now, nullptr);
-    time_to_sleep.tv_sec = usecs_to_sleep / 1000000;
-    time_to_sleep.tv_usec = usecs_to_sleep % 1000000;
-    timeradd(&now, &time_to_sleep, &wake_up_timeval);
-    return wake_up_timeval;
+static long long calcWakeUpNsecs(unsigned int usecs_to_sleep) {
+    return monotonicNsecs() + usecs_to_sleep * CONVERT_CONST_USEC_TO_NSEC;
 }
 
 //------------Memory Management
@@ -51,8 +79,15 @@ static timeval calcWakUpTimeval(int usecs_to_sleep) {
  * Clears the library resources.
  */
 static void clearMem(){
+    if(mnScheduler != nullptr){
+        return; // the other workers may be using it all.
+    }
+    // A thread's stack is unmapped with the manager, which is left to the exit if it's the running one's:
+    bool onThreadStack = scheduler != nullptr && scheduler->getRunning() != 0;
     delete scheduler;
-    delete manager;
+    if(!onThreadStack){
+        delete manager;
+    }
     delete vTimer;
     delete sleepingThreads;
     delete rTimer;
@@ -68,16 +103,168 @@ static void exitProg(const std::string& errMsg){
     exit(1);
 }
 
-//-------------Masking:
-static void maskSignals(){
-    if(sigprocmask(SIG_BLOCK, &toBlock, nullptr) < 0){
-        exitProg("Failed to set signal masking.");
+//-------------Scheduling:
+
+/**
+ * Ends the quantum of the running thread and switches to the next one.
+ */
+static void preempt(){
+    if(mnScheduler != nullptr){
+        mnScheduler->preempt();
+        return;
+    }
+    if(tickStopped){ // the timer expired before it was stopped, inside the library.
+        return;
+    }
+    totalQuants++; // the timer is periodic, so it's already counting the next quantum.
+
+    // Do a context switch:
+    int currRun = scheduler->getRunning();
+    int nextToRun = scheduler->whosNextTimeout();
+    if(tickless && nextToRun == currRun){
+        // Nothing else can run until a thread is made ready, which resumes the timer:
+        if(vTimer->stop() < 0){
+            exitProg("Failed to stop _timer.");
+        }
+        tickStopped = true;
+    }
+    manager->switchContext(currRun, nextToRun);
+}
+
+/**
+ * Counts the quantums the running thread started while the quantum timer was stopped.
+ */
+static void countStoppedQuants(){
+    if(!tickStopped){
+        return;
+    }
+    int quants = vTimer->quantsSinceStop();
+    if(quants < 0){
+        exitProg("Failed to read the CPU time.");
+    }
+    totalQuants += quants;
+    manager->getThread(scheduler->getRunning())->updateQuants(quants);
+}
+
+/**
+ * Adds a thread to the ready threads, and resumes the quantum timer if it was stopped.
+ */
+static void addReady(int tid){
+    scheduler->addThread(tid);
+    if(tickStopped){
+        countStoppedQuants();
+        tickStopped = false;
+        if(vTimer->resume() < 0){
+            exitProg("Failed to start _timer.");
+        }
     }
 }
 
-static void unmaskSignals(){
-    if(sigprocmask(SIG_UNBLOCK, &toBlock, nullptr) < 0){
-        exitProg("Failed to undo signal masking.");
+/**
+ * Wakes up the sleeping threads whose time has come, all of them at once, and sets the timer for the next one.
+ */
+static void wakeDueSleepers(){
+    long long now = monotonicNsecs();
+    wake_up_info* threadToAwake;
+    while((threadToAwake = sleepingThreads->peek()) != nullptr && threadToAwake->awaken_ns <= now){
+        int toWakeTid = threadToAwake->id;
+
+        // Awake the relevant thread:
+        sleepingThreads->pop();
+        if(mnScheduler != nullptr){
+            mnScheduler->wake(toWakeTid);
+        }
+        else if(manager->wakeThread(toWakeTid) == 0){  // if thread exists (active, haven't been terminated while sleeping)
+            if(!(manager->isThreadBlocked(toWakeTid))) // if thread is not blocked
+            {
+                addReady(toWakeTid);
+            }
+        }
+    }
+
+    // if there are more sleeping threads, set a new timer for the head:
+    if(threadToAwake != nullptr){
+        if(rTimer->start(threadToAwake->awaken_ns) < 0){
+            exitProg("Failed to start the sleep timer.");
+        }
+    }
+}
+
+static void wakeSleepers(){
+    if(mnScheduler != nullptr){
+        mnScheduler->lock();
+        wakeDueSleepers();
+        mnScheduler->unlock();
+        return;
+    }
+    wakeDueSleepers();
+}
+
+//-------------Critical sections:
+
+/*
+ * The library's state is only changed inside enterLibrary/leaveLibrary, which are plain stores rather than system
+ * calls: the signals are never blocked, instead a handler that finds the flag set records what happened and returns,
+ * and the thread acts on it when it leaves the library. Every context switch is made inside the library, so a thread
+ * switched to always leaves it, either on its way out of a library call or a handler, or in startThread.
+ */
+static void enterLibrary(){
+    currentFlags()->inLibrary = 1;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+}
+
+static void leaveLibrary(){
+    while(true){
+        library_flags* flags = currentFlags(); // again every time, preempt() may return on another kernel thread.
+        if(flags->pendingWake){
+            flags->pendingWake = 0;
+            wakeSleepers();
+        }
+        else if(flags->pendingPreempt){
+            flags->pendingPreempt = 0;
+            preempt(); // returns once this thread is scheduled again.
+        }
+        else{
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+            flags->inLibrary = 0;
+            // A signal that came after the checks and before the flag was cleared has only been recorded, one that
+            // came after it was cleared was acted on, and may have moved this thread to another kernel thread:
+            flags = currentFlags();
+            if(!flags->pendingWake && !flags->pendingPreempt){
+                return;
+            }
+            flags->inLibrary = 1;
+        }
+    }
+}
+
+/**
+ * Runs first in every new thread: it's switched to inside the library, like every thread, but has no library call
+ * of its own to leave it on the way out.
+ */
+static void startThread(){
+    if(mnScheduler != nullptr){
+        mnScheduler->finishSwitch();
+    }
+    leaveLibrary();
+}
+
+/**
+ * Drops what the library keeps for a thread mnScheduler destructs, under its runtime lock.
+ */
+static void threadDestroyed(int tid){
+    sleepingThreads->remove(tid);
+}
+
+/**
+ * Runs by the idle workers of mnScheduler, which stay inside the library: acts on the signals they deferred.
+ */
+static void idleWorker(){
+    library_flags* flags = currentFlags();
+    flags->pendingPreempt = 0; // there is nothing to preempt.
+    if(flags->pendingWake){
+        flags->pendingWake = 0;
+        wakeSleepers();
     }
 }
 
@@ -88,20 +275,15 @@ static void unmaskSignals(){
  * @param sig
  */
 static void handleQuantumTimeout(int sig){
-    // Start the _timer again & update totalQuants:
-//    std::cerr <<"\n**ALARM- timeout**\n";
     if(sig == SIGVTALRM){
-        if(vTimer->start() < 0){
-            exitProg("Failed to start _timer.");
+        library_flags* flags = currentFlags();
+        if(flags->inLibrary){
+            flags->pendingPreempt = 1;
+            return;
         }
-
-        totalQuants++;
-//    std::cerr <<"\nTIME: " << totalQuants <<std::endl;
-
-        // Do a context switch:
-        int currRun = scheduler->getRunning();
-        int nextToRun = scheduler->whosNextTimeout();
-        manager->switchContext(currRun, nextToRun);
+        enterLibrary();
+        preempt();
+        leaveLibrary();
     }
 }
 
@@ -111,40 +293,17 @@ static void handleQuantumTimeout(int sig){
  */
 static void handleSleepTimeout(int sig){
     if(sig == SIGALRM){
-        int totalTime = 0;
-        int inLoop = 0;
-        do{
-            ++inLoop;
-            wake_up_info* threadToAwake = sleepingThreads->peek();
-            int toWakeTid = threadToAwake->id;
-
-            // Awake the relevant thread:
-            sleepingThreads->pop();
-            if(manager->wakeThread(toWakeTid) == 0){       // if thread exists (active, haven't been terminated while sleeping)
-                if(!(manager->isThreadBlocked(toWakeTid))) // if thread is not blocked
-                {
-                    scheduler->addThread(toWakeTid);
-                }
-            }
-
-            // calculate the time until the next waking:
-            wake_up_info* nextToWake = sleepingThreads->peek();
-
-            if(nextToWake != nullptr) //if there are more sleeping threads, set a new timer for the head
-            {
-                timeval now;
-                gettimeofday(&now, nullptr);
-                timeval nextWakingTime = nextToWake->awaken_tv;
-                totalTime = (nextWakingTime.tv_sec - now.tv_sec) * CONVERT_CONST_SEC_TO_NSEC +
-                            (nextWakingTime.tv_usec - now.tv_usec) * CONVERT_CONST_MSEC_TO_NSEC;
-            } else
-            {
-                return;
-            }
-        } while(totalTime <= 0);
-
-        // Reset the timer:
-        rTimer->start(totalTime);
+        if(mnScheduler != nullptr && mnScheduler->forwardSignal(sig)){
+            return;
+        }
+        library_flags* flags = currentFlags();
+        if(flags->inLibrary){
+            flags->pendingWake = 1;
+            return;
+        }
+        enterLibrary();
+        wakeSleepers();
+        leaveLibrary();
     }
 }
 
@@ -159,42 +318,99 @@ static void handleSleepTimeout(int sig){
 */
 int uthread_init(int quantum_usecs)
 {
+    uthread_options options = {MAX_THREAD_NUM, STACK_SIZE, 0, SLEEP_SLACK_NSECS, 0, 0};
+    return uthread_init_with_options(quantum_usecs, &options);
+}
+
+/*
+ * Description: This function initializes the thread library as uthread_init
+ * does, but with the limit of threads and their stack size taken from
+ * options rather than from MAX_THREAD_NUM and STACK_SIZE, so a program may
+ * run hundreds of thousands of threads. It is an error to call this function
+ * with non-positive quantum_usecs, max_threads or stack_size.
+ * With workers, the threads are run by several kernel threads, each with a
+ * run queue of its own, and a kernel thread with nothing to run takes
+ * threads from the others' queues. Every kernel thread has a quantum timer of
+ * its own, on its CPU time, and the total quantums count the quantums of all
+ * of them. A thread blocked or terminated by a thread on another kernel
+ * thread stops as soon as its kernel thread receives the signal it's sent,
+ * rather than within the call. Terminating the main thread exits without
+ * releasing the library's memory, which the other kernel threads may use.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_init_with_options(int quantum_usecs, const uthread_options* options)
+{
+    if (options == nullptr || options->max_threads <= 0 || options->stack_size <= 0)
+    {
+        std::cerr << libErrorSyntax << "max_threads and stack_size should be positive." << std::endl;
+        return -1;
+    }
+    if (options->workers < -1 || options->workers > MAX_WORKERS)
+    {
+        std::cerr << libErrorSyntax << "workers should be -1 to " << MAX_WORKERS << "." << std::endl;
+        return -1;
+    }
+    if (options->sleep_slack_nsecs < 0)
+    {
+        std::cerr << libErrorSyntax << "sleep_slack_nsecs should be non-negative." << std::endl;
+        return -1;
+    }
+    if (options->shared_stack != 0 && options->workers != 0)
+    {
+        std::cerr << libErrorSyntax << "shared_stack can't be used with workers." << std::endl;
+        return -1;
+    }
     if (quantum_usecs > 0)
     {
         // Create global functionality holders:
-        manager = new thread_manager(quantum_usecs, MAX_THREAD_NUM, STACK_SIZE);
+        manager = new thread_manager(quantum_usecs, options->max_threads, options->stack_size,
+                                     &startThread, options->shared_stack != 0);
         if (manager->threadManagerSetup() == sysError) // a sys error occurred in manager setup
         {
             clearMem();
             exit(1);
         }
-        vTimer = new virtual_timer(quantum_usecs);
-        rTimer = new real_timer;
-        scheduler = new class scheduler;
+        rTimer = new real_timer(options->sleep_slack_nsecs);
         sleepingThreads = new SleepingThreadsList;
+        int workers = options->workers == -1 ? (int)sysconf(_SC_NPROCESSORS_ONLN) : options->workers;
+        if(workers > 0){
+            mnScheduler = new mn_scheduler(manager, options->max_threads, quantum_usecs,
+                                           workers < MAX_WORKERS ? workers : MAX_WORKERS,
+                                           &enterLibrary, &idleWorker, &threadDestroyed);
+        }
+        else{
+            tickless = options->tickless != 0;
+            vTimer = new virtual_timer(quantum_usecs);
+            scheduler = new class scheduler(manager);
+        }
         saVTimer = {};
         saRTimer = {};
 
-        // Initialize the signal set to block:
-        if((sigaddset(&toBlock, SIGVTALRM) < 0)||(sigaddset(&toBlock, SIGALRM) < 0)) {
+        // Set signal handlers. They block no signals, not even their own, since a handler may switch to a thread that
+        // won't return from a handler to restore the mask; the library is guarded by inLibrary instead:
+        if((sigemptyset(&saVTimer.sa_mask) < 0)||(sigemptyset(&saRTimer.sa_mask) < 0)) {
             exitProg("Failed to initialize signal set to block.");
         }
-
-        // Set signal handlers:
         saVTimer.sa_handler = &handleQuantumTimeout;
-        saVTimer.sa_mask = toBlock;
-        saVTimer.sa_flags = 0; // Verifies that no flags are applied.
+        saVTimer.sa_flags = SA_NODEFER;
         if(sigaction(SIGVTALRM, &saVTimer, nullptr) < 0){
             exitProg("sigaction had failed.");
         }
 
         saRTimer.sa_handler = &handleSleepTimeout;
-        saRTimer.sa_mask = toBlock;
-        saRTimer.sa_flags = 0; // Verifies that no flags are applied.
+        saRTimer.sa_flags = SA_NODEFER;
         if(sigaction(SIGALRM, &saRTimer, nullptr) < 0){
             exitProg("sigaction had failed.");
         }
 
+        if(mnScheduler != nullptr){
+            // Starts the workers, each with its own timer:
+            if(mnScheduler->start() < 0){
+                exit(1);
+            }
+            return 0;
+        }
+
         // Start _timer & update the quantum counting:
         if(vTimer->start() < 0){
             exitProg("Failed to start _timer.");
@@ -207,6 +423,29 @@ int uthread_init(int quantum_usecs)
     return -1;
 }
 
+/**
+ * Creates a thread with a stack of stackSize bytes, 0 for the stack size of the library's options.
+ */
+static int spawnThread(void (*f)(), int stackSize){
+    enterLibrary();
+    int newTid = mnScheduler != nullptr ? mnScheduler->spawn(f, stackSize) : manager->createThread(f, stackSize);
+    if (newTid == sysError) // a sys error occurred in thread setup in manager
+    {
+        clearMem();
+        exit(1);
+    }
+    else if(newTid == -1){
+        std::cerr <<  libErrorSyntax << "Number of threads > MAX_THREAD_NUMBER." << std::endl;
+        leaveLibrary();
+        return  -1;
+    }
+    if(mnScheduler == nullptr){
+        addReady(newTid);
+    }
+    leaveLibrary();
+    return newTid;
+}
+
 /*
  * Description: This function creates a new thread, whose entry point is the
  * function f with the signature void f(void). The thread is added to the end
@@ -218,21 +457,26 @@ int uthread_init(int quantum_usecs)
  * On failure, return -1.
 */
 int uthread_spawn(void (*f)()){
-    maskSignals();
-    int newTid = manager->createThread(f);
-    if (newTid == sysError) // a sys error occurred in thread setup in manager
-    {
-        clearMem();
-        exit(1);
-    }
-    else if(newTid == -1){
-        std::cerr <<  libErrorSyntax << "Number of threads > MAX_THREAD_NUMBER." << std::endl;
-        unmaskSignals();
-        return  -1;
+    return spawnThread(f, 0);
+}
+
+
+/*
+ * Description: This function creates a new thread as uthread_spawn does, but
+ * with a stack of stack_size bytes rather than the stack size the library
+ * was initialized with. The size is rounded up to whole pages, and to the
+ * least a thread needs to take the library's signals. With a shared stack,
+ * stack_size is ignored. It is an error to call this function with a
+ * non-positive stack_size.
+ * Return value: On success, return the ID of the created thread.
+ * On failure, return -1.
+*/
+int uthread_spawn_with_stack(void (*f)(), int stack_size){
+    if(stack_size <= 0){
+        std::cerr <<  libErrorSyntax << "stack_size should be positive." << std::endl;
+        return -1;
     }
-    scheduler->addThread(newTid);
-    unmaskSignals();
-    return newTid;
+    return spawnThread(f, stack_size);
 }
 
 
@@ -249,15 +493,27 @@ int uthread_spawn(void (*f)()){
 */
 int uthread_terminate(int tid)
 {
-    maskSignals();
-    int currRunning = scheduler->getRunning();
+    enterLibrary();
+    if(mnScheduler != nullptr && tid != 0){
+        if(mnScheduler->terminate(tid) == 0){
+            leaveLibrary();
+            return 0;
+        }
+        std::cerr <<  libErrorSyntax << "Thread doesn't exit." << std::endl;
+        leaveLibrary();
+        return -1;
+    }
+    int currRunning = scheduler != nullptr ? scheduler->getRunning() : 0;
     int nextToRun;
 
     if(tid != 0)
     {
-        if (manager->killThread(tid) != -1)                        //If thread exists.
+        if (manager->getThread(tid) != nullptr)                    //If thread exists.
         {
+            // The scheduler unlinks the thread from its ready queue before the thread is deleted:
             nextToRun = scheduler->whosNextTermination(tid);
+            sleepingThreads->remove(tid);
+            manager->killThread(tid);
             if(nextToRun != currRunning){                          // If we should do a context switch.
                 if(vTimer->start() < 0){
                     exitProg("Failed to start _timer.");
@@ -265,16 +521,15 @@ int uthread_terminate(int tid)
                 totalQuants++;
                 manager->switchContext(currRunning, nextToRun);
             }
-            unmaskSignals();
+            leaveLibrary();
             return 0;
         }
         std::cerr <<  libErrorSyntax << "Thread doesn't exit." << std::endl;
-        unmaskSignals();
+        leaveLibrary();
         return -1;
     }
     clearMem();
-    unmaskSignals();
-    exit(0);
+    exit(0); // still inside the library, so a timer that expires now doesn't act on the freed resources.
 }
 
 
@@ -289,8 +544,17 @@ int uthread_terminate(int tid)
 */
 int uthread_block(int tid)
 {
-    maskSignals();
-    int currRunning = scheduler->getRunning();
+    enterLibrary();
+    if(mnScheduler != nullptr && tid != 0){
+        if(mnScheduler->block(tid) == 0){
+            leaveLibrary();
+            return 0;
+        }
+        std::cerr <<  libErrorSyntax << "Thread doesn't exit." << std::endl;
+        leaveLibrary();
+        return -1;
+    }
+    int currRunning = scheduler != nullptr ? scheduler->getRunning() : 0;
     int nextToRun;
 
     if (tid != 0)
@@ -304,15 +568,15 @@ int uthread_block(int tid)
                 totalQuants++;
                 manager->switchContext(currRunning, nextToRun);
             }
-            unmaskSignals();
+            leaveLibrary();
             return 0;
         }
         std::cerr <<  libErrorSyntax << "Thread doesn't exit." << std::endl;
-        unmaskSignals();
+        leaveLibrary();
         return -1;
     }
     std::cerr <<  libErrorSyntax << "Blocking the main thread is forbidden." << std::endl;
-    unmaskSignals();
+    leaveLibrary();
     return -1;
 }
 
@@ -326,17 +590,25 @@ int uthread_block(int tid)
 */
 int uthread_resume(int tid)
 {
-    maskSignals();
-    if (manager->unBlockThread(tid) != -1)
+    enterLibrary();
+    if (mnScheduler != nullptr)
+    {
+        if (mnScheduler->resume(tid) == 0)
+        {
+            leaveLibrary();
+            return 0;
+        }
+    }
+    else if (manager->unBlockThread(tid) != -1)
     {
        if(!manager->isThreadAsleep(tid)){
-           scheduler->addThread(tid);
+           addReady(tid);
        }
-       unmaskSignals();
+       leaveLibrary();
        return 0;
     }
     std::cerr <<  libErrorSyntax << "Thread doesn't exit." << std::endl;
-    unmaskSignals();
+    leaveLibrary();
     return -1;
 }
 
@@ -350,28 +622,33 @@ int uthread_resume(int tid)
 */
 int uthread_sleep(unsigned int usec)
 {
-    maskSignals();
-    int runningThreadTid = scheduler->getRunning();
-    wake_up_info* oldFirstToWake = sleepingThreads->peek(); // NULL if the list is empty.
+    enterLibrary();
+    int runningThreadTid = mnScheduler != nullptr ? mnScheduler->getRunning() : scheduler->getRunning();
 
     if(runningThreadTid != 0){ // You can't put to sleep the main process.
-
+        if(mnScheduler != nullptr){
+            // Marked before it's added to the list, which another worker may wake it from right away:
+            mnScheduler->markSleeping();
+            mnScheduler->lock();
+        }
         // Updating the sleeping threads list:
-        timeval t = calcWakUpTimeval(usec);
-        sleepingThreads->add(runningThreadTid, t);
-
-        // Reset timer:
-        wake_up_info* newFirstToWake = sleepingThreads->peek();
-        if(oldFirstToWake == nullptr) {
-            // If the list was empty before, the added thread is surly the head, and we should reset the timer:
-            rTimer->start(usec);
-        } else {
-            // If the head of the list was changed, we should update the timer according to the new head:
-            if(oldFirstToWake->id != newFirstToWake->id){
-                rTimer->start(usec);
+        long long wakeUpNsecs = calcWakeUpNsecs(usec);
+        sleepingThreads->add(runningThreadTid, wakeUpNsecs);
+
+        // If the added thread is the new head of the list, the timer should be reset for it:
+        if(sleepingThreads->peek()->id == runningThreadTid){
+            if(rTimer->start(wakeUpNsecs) < 0){
+                exitProg("Failed to start the sleep timer.");
             }
         }
 
+        if(mnScheduler != nullptr){
+            mnScheduler->unlock();
+            mnScheduler->sleep();
+            leaveLibrary();
+            return 0;
+        }
+
         // Now we update the manager and scheduler that the thread is sleeping:
         manager->putThreadToSleep(runningThreadTid);
         int nextToRun = scheduler->whosNextSleep();
@@ -382,11 +659,11 @@ int uthread_sleep(unsigned int usec)
         }
         totalQuants++;
         manager->switchContext(runningThreadTid, nextToRun);
-        unmaskSignals();
+        leaveLibrary();
         return 0;
     }
     std::cerr <<  libErrorSyntax << "The main thread can't sleep." << std::endl;
-    unmaskSignals();
+    leaveLibrary();
     return -1;
 }
 
@@ -396,9 +673,9 @@ int uthread_sleep(unsigned int usec)
 */
 int uthread_get_tid()
 {
-    maskSignals();
-    int retVal = scheduler->getRunning();
-    unmaskSignals();
+    enterLibrary();
+    int retVal = mnScheduler != nullptr ? mnScheduler->getRunning() : scheduler->getRunning();
+    leaveLibrary();
 
     return retVal;
 }
@@ -414,7 +691,14 @@ int uthread_get_tid()
 */
 int uthread_get_total_quantums()
 {
-    return totalQuants;
+    if(mnScheduler != nullptr){
+        return mnScheduler->getTotalQuants();
+    }
+    enterLibrary();
+    countStoppedQuants();
+    int retVal = totalQuants;
+    leaveLibrary();
+    return retVal;
 }
 
 
@@ -430,14 +714,17 @@ int uthread_get_total_quantums()
 */
 int uthread_get_quantums(int tid)
 {
-    maskSignals();
-    int threadQuants = manager->getThreadQuants(tid);
+    enterLibrary();
+    if(mnScheduler == nullptr){
+        countStoppedQuants();
+    }
+    int threadQuants = mnScheduler != nullptr ? mnScheduler->getQuants(tid) : manager->getThreadQuants(tid);
     if (threadQuants != -1)  // If thread exists.
     {
-        unmaskSignals();
+        leaveLibrary();
         return threadQuants;
     }
     std::cerr <<  libErrorSyntax << "Thread doesn't exit." << std::endl;
-    unmaskSignals();
+    leaveLibrary();
     return -1;
 }
\ No newline at end of file
@@ -8,9 +8,21 @@
 
 #define MAX_THREAD_NUM 100 /* maximal number of threads */
 #define STACK_SIZE 4096 /* stack size per thread (in bytes) */
+#define MAX_WORKERS 1024 /* maximal number of kernel threads running the threads */
+#define SLEEP_SLACK_NSECS 50000 /* time a sleeping thread may be woken late by, to share a timer expiry */
 
 /* External interface */
 
+/*
+ * The threads don't have signal masks of their own: a context switch
+ * neither saves nor restores the signal mask, so that it makes no system
+ * call. A mask a thread sets with sigprocmask stays in effect for the
+ * threads that run after it, until one of them sets it again; a thread
+ * that blocks SIGVTALRM keeps every thread from being preempted meanwhile.
+ * With workers, every kernel thread has a mask of its own, which the
+ * threads it runs share in the same way.
+ */
+
 
 /*
  * Description: This function initializes the thread library.
@@ -22,6 +34,56 @@
 */
 int uthread_init(int quantum_usecs);
 
+/*
+ * Settings of the thread library, for uthread_init_with_options.
+ */
+struct uthread_options {
+    int max_threads; /* maximal number of concurrent threads, the main thread included */
+    int stack_size;  /* stack size per thread (in bytes) */
+    int workers;     /* kernel threads running the threads: 0 for the calling
+                        thread alone, as uthread_init does, -1 for one per
+                        core (at most MAX_WORKERS) */
+    int sleep_slack_nsecs; /* time a sleeping thread may be woken late by,
+                              so that sleeps ending close together are woken
+                              by one timer expiry, 0 for none */
+    int tickless;          /* 1 to stop the quantum timer while the running
+                              thread is the only one that can run, rather
+                              than take a signal every quantum; the quantums
+                              it runs meanwhile are still counted */
+    int shared_stack;      /* 1 to run the threads (the main thread aside)
+                              on a single stack of stack_size bytes, copying
+                              the part a thread used aside when another
+                              thread is switched to, so an idle thread only
+                              keeps the stack it uses */
+};
+
+/*
+ * Description: This function initializes the thread library as uthread_init
+ * does, but with the limit of threads and their stack size taken from
+ * options rather than from MAX_THREAD_NUM and STACK_SIZE, so a program may
+ * run hundreds of thousands of threads. It is an error to call this function
+ * with non-positive quantum_usecs, max_threads or stack_size, or with
+ * negative sleep_slack_nsecs.
+ * With workers, the threads are run by several kernel threads, each with a
+ * run queue of its own, and a kernel thread with nothing to run takes
+ * threads from the others' queues. Every kernel thread has a quantum timer of
+ * its own, on its CPU time, and the total quantums count the quantums of all
+ * of them. A thread blocked or terminated by a thread on another kernel
+ * thread stops as soon as its kernel thread receives the signal it's sent,
+ * rather than within the call. Terminating the main thread exits without
+ * releasing the library's memory, which the other kernel threads may use.
+ * tickless only applies without workers: with workers, a kernel thread
+ * stops its quantum timer whenever it has no thread to run.
+ * With shared_stack, switching between two threads copies their stacks,
+ * with their signal frames if they were preempted, and a thread's stack
+ * variables are copied away while another thread runs, so other threads
+ * may not use them.
+ * It's an error to ask for a shared stack with workers, since a thread's
+ * stack is only valid at the address of its worker's shared stack.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_init_with_options(int quantum_usecs, const uthread_options* options);
+
 /*
  * Description: This function creates a new thread, whose entry point is the
  * function f with the signature void f(void). The thread is added to the end
@@ -34,6 +96,18 @@ int uthread_init(int quantum_usecs);
 */
 int uthread_spawn(void (*f)(void));
 
+/*
+ * Description: This function creates a new thread as uthread_spawn does, but
+ * with a stack of stack_size bytes rather than the stack size the library
+ * was initialized with. The size is rounded up to whole pages, and to the
+ * least a thread needs to take the library's signals. With a shared stack,
+ * stack_size is ignored. It is an error to call this function with a
+ * non-positive stack_size.
+ * Return value: On success, return the ID of the created thread.
+ * On failure, return -1.
+*/
+int uthread_spawn_with_stack(void (*f)(void), int stack_size);
+
 
 /*
  * Description: This function terminates the thread with ID tid and deletes
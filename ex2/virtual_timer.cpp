@@ -1,26 +1,86 @@
+#include <csignal>
+#include <unistd.h>
+#include <sys/syscall.h>
 #include "virtual_timer.h"
-static const int CONVERTION_CONST_MSEC_SEC = 1000000;
+static const long long CONVERTION_CONST_SEC_NSEC = 1000000000;
+static const long long CONVERTION_CONST_MSEC_NSEC = 1000;
 
-virtual_timer::virtual_timer(int quantum): _quantum(quantum), _timer(){}
-
-int virtual_timer::start() {
-    // Zero timer:
-    _timer.it_value.tv_sec = 0;
-    _timer.it_value.tv_usec = 0;
-    if (setitimer (ITIMER_VIRTUAL, &_timer, nullptr)) {
+/**
+ * @return the CPU time of the calling kernel thread in nanoseconds, -1 in case of a system error.
+ */
+static long long threadCpuNsecs() {
+    timespec now;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now)) {
         return -1;
     }
+    return now.tv_sec * CONVERTION_CONST_SEC_NSEC + now.tv_nsec;
+}
+
+virtual_timer::virtual_timer(int quantum): _quantum(quantum * CONVERTION_CONST_MSEC_NSEC), _timer(), _created(false),
+                                           _quantumStart(0){}
+
+virtual_timer::~virtual_timer() {
+    if (_created) {
+        timer_delete(_timer);
+    }
+}
+
+int virtual_timer::arm(long long first) {
+    // Create the timer, on the CPU time of the calling kernel thread and signalling it alone:
+    if (!_created) {
+        sigevent event = {};
+        event.sigev_notify = SIGEV_THREAD_ID;
+        event.sigev_signo = SIGVTALRM;
+        event._sigev_un._tid = (pid_t)syscall(SYS_gettid);
+        if (timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &_timer)) {
+            return -1;
+        }
+        _created = true;
+    }
 
-    // Set timer:
-    int secondsPart = _quantum / CONVERTION_CONST_MSEC_SEC;   // down round.
-    int microSecondsPart = _quantum - (secondsPart * CONVERTION_CONST_MSEC_SEC);
+    // Set and run the timer, which replaces the time left of the previous quantum:
+    itimerspec quantum = {};
+    quantum.it_value.tv_sec = first / CONVERTION_CONST_SEC_NSEC;
+    quantum.it_value.tv_nsec = first % CONVERTION_CONST_SEC_NSEC;
+    quantum.it_interval.tv_sec = _quantum / CONVERTION_CONST_SEC_NSEC;
+    quantum.it_interval.tv_nsec = _quantum % CONVERTION_CONST_SEC_NSEC;
+    if (timer_settime(_timer, 0, &quantum, nullptr)) {
+        return -1;
+    }
+    return 0;
+}
 
-    _timer.it_value.tv_sec = secondsPart;
-    _timer.it_value.tv_usec = microSecondsPart;
+int virtual_timer::start() {
+    return arm(_quantum);
+}
 
-    // Run timer:
-    if (setitimer (ITIMER_VIRTUAL, &_timer, nullptr)) {
+int virtual_timer::stop() {
+    if (!_created) {
+        return 0;
+    }
+    itimerspec stopped = {}, left;
+    long long now = threadCpuNsecs();
+    if (now < 0 || timer_settime(_timer, 0, &stopped, &left)) {
         return -1;
     }
+    _quantumStart = now - (_quantum - (left.it_value.tv_sec * CONVERTION_CONST_SEC_NSEC + left.it_value.tv_nsec));
     return 0;
 }
+
+int virtual_timer::quantsSinceStop() {
+    long long now = threadCpuNsecs();
+    if (now < 0) {
+        return -1;
+    }
+    long long quants = (now - _quantumStart) / _quantum;
+    _quantumStart += quants * _quantum;
+    return (int)quants;
+}
+
+int virtual_timer::resume() {
+    long long now = threadCpuNsecs();
+    if (now < 0) {
+        return -1;
+    }
+    return arm(_quantum - (now - _quantumStart) % _quantum);
+}
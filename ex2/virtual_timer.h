@@ -1,11 +1,19 @@
 #ifndef EX2_VIRTUAL_TIMER_H
 #define EX2_VIRTUAL_TIMER_H
 
-#include <sys/time.h>
+#include <time.h>
 
 class virtual_timer {
-    int _quantum;
-    struct itimerval _timer;
+    long long _quantum; // in nanoseconds.
+    timer_t _timer;
+    bool _created;
+    long long _quantumStart; // the CPU time the current quantum started at, while the timer is stopped.
+
+    /**
+     * Arms the timer to expire in first nanoseconds, and every quantum from then on.
+     * @return -1 in case of a system error.
+     */
+    int arm(long long first);
 
 public:
     /**
@@ -15,10 +23,35 @@ public:
     explicit virtual_timer(int quantum);
 
     /**
-     * Starts the timer to run quantum microseconds.
+     * Deletes the timer.
+     */
+    ~virtual_timer();
+
+    /**
+     * Starts the timer to run quantum microseconds of the calling kernel thread's CPU time, and to send it SIGVTALRM
+     * when they're over, and every quantum after that, until it's started again or stopped. The timer belongs to the
+     * kernel thread that first starts it.
      * @return -1 in case of a system error.
      */
     int start();
+
+    /**
+     * Stops the timer, remembering where in its quantum it was, for quantsSinceStop and resume.
+     * @return -1 in case of a system error.
+     */
+    int stop();
+
+    /**
+     * @return the number of quantums that started since the timer was stopped or this function was last called,
+     * or -1 in case of a system error.
+     */
+    int quantsSinceStop();
+
+    /**
+     * Runs a stopped timer again, from where in the quantum its kernel thread's CPU time has gotten to.
+     * @return -1 in case of a system error.
+     */
+    int resume();
 };
 
 
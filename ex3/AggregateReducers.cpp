@@ -0,0 +1,439 @@
+#include "AggregateReducers.h"
+#include <algorithm>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+//---------------------------------------------- SCALAR KERNELS ------------------------------------------------//
+
+static int64_t sumInt64Scalar(const int64_t* values, size_t n)
+{
+    int64_t sum = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        sum += values[i];
+    }
+    return sum;
+}
+
+static int64_t minInt64Scalar(const int64_t* values, size_t n)
+{
+    return *std::min_element(values, values + n);
+}
+
+static int64_t maxInt64Scalar(const int64_t* values, size_t n)
+{
+    return *std::max_element(values, values + n);
+}
+
+static double sumDoubleScalar(const double* values, size_t n)
+{
+    double sum = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        sum += values[i];
+    }
+    return sum;
+}
+
+static double minDoubleScalar(const double* values, size_t n)
+{
+    return *std::min_element(values, values + n);
+}
+
+static double maxDoubleScalar(const double* values, size_t n)
+{
+    return *std::max_element(values, values + n);
+}
+
+#if defined(__x86_64__)
+//---------------------------------------------- SSE KERNELS ------------------------------------------------//
+// SSE2 is part of x86-64, the 64 bit integer compare needs SSE4.2.
+
+static int64_t sumInt64Sse2(const int64_t* values, size_t n)
+{
+    __m128i acc = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        acc = _mm_add_epi64(acc, _mm_loadu_si128((const __m128i*)(values + i)));
+    }
+    int64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, acc);
+    return lanes[0] + lanes[1] + sumInt64Scalar(values + i, n - i);
+}
+
+__attribute__((target("sse4.2")))
+static int64_t minInt64Sse42(const int64_t* values, size_t n)
+{
+    if (n < 2)
+    {
+        return minInt64Scalar(values, n);
+    }
+    __m128i acc = _mm_loadu_si128((const __m128i*)values);
+    size_t i = 2;
+    for (; i + 2 <= n; i += 2)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(values + i));
+        acc = _mm_blendv_epi8(acc, v, _mm_cmpgt_epi64(acc, v));
+    }
+    int64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, acc);
+    int64_t result = std::min(lanes[0], lanes[1]);
+    return i < n ? std::min(result, minInt64Scalar(values + i, n - i)) : result;
+}
+
+__attribute__((target("sse4.2")))
+static int64_t maxInt64Sse42(const int64_t* values, size_t n)
+{
+    if (n < 2)
+    {
+        return maxInt64Scalar(values, n);
+    }
+    __m128i acc = _mm_loadu_si128((const __m128i*)values);
+    size_t i = 2;
+    for (; i + 2 <= n; i += 2)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(values + i));
+        acc = _mm_blendv_epi8(acc, v, _mm_cmpgt_epi64(v, acc));
+    }
+    int64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, acc);
+    int64_t result = std::max(lanes[0], lanes[1]);
+    return i < n ? std::max(result, maxInt64Scalar(values + i, n - i)) : result;
+}
+
+static double sumDoubleSse2(const double* values, size_t n)
+{
+    __m128d acc0 = _mm_setzero_pd();
+    __m128d acc1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        acc0 = _mm_add_pd(acc0, _mm_loadu_pd(values + i));
+        acc1 = _mm_add_pd(acc1, _mm_loadu_pd(values + i + 2));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+    return lanes[0] + lanes[1] + sumDoubleScalar(values + i, n - i);
+}
+
+static double minDoubleSse2(const double* values, size_t n)
+{
+    if (n < 2)
+    {
+        return minDoubleScalar(values, n);
+    }
+    __m128d acc = _mm_loadu_pd(values);
+    size_t i = 2;
+    for (; i + 2 <= n; i += 2)
+    {
+        acc = _mm_min_pd(acc, _mm_loadu_pd(values + i));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, acc);
+    double result = std::min(lanes[0], lanes[1]);
+    return i < n ? std::min(result, minDoubleScalar(values + i, n - i)) : result;
+}
+
+static double maxDoubleSse2(const double* values, size_t n)
+{
+    if (n < 2)
+    {
+        return maxDoubleScalar(values, n);
+    }
+    __m128d acc = _mm_loadu_pd(values);
+    size_t i = 2;
+    for (; i + 2 <= n; i += 2)
+    {
+        acc = _mm_max_pd(acc, _mm_loadu_pd(values + i));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, acc);
+    double result = std::max(lanes[0], lanes[1]);
+    return i < n ? std::max(result, maxDoubleScalar(values + i, n - i)) : result;
+}
+
+//---------------------------------------------- AVX2 KERNELS ------------------------------------------------//
+
+__attribute__((target("avx2")))
+static int64_t sumInt64Avx2(const int64_t* values, size_t n)
+{
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        acc0 = _mm256_add_epi64(acc0, _mm256_loadu_si256((const __m256i*)(values + i)));
+        acc1 = _mm256_add_epi64(acc1, _mm256_loadu_si256((const __m256i*)(values + i + 4)));
+    }
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, _mm256_add_epi64(acc0, acc1));
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sumInt64Scalar(values + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static int64_t minInt64Avx2(const int64_t* values, size_t n)
+{
+    if (n < 4)
+    {
+        return minInt64Scalar(values, n);
+    }
+    __m256i acc = _mm256_loadu_si256((const __m256i*)values);
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(values + i));
+        acc = _mm256_blendv_epi8(acc, v, _mm256_cmpgt_epi64(acc, v));
+    }
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, acc);
+    int64_t result = minInt64Scalar(lanes, 4);
+    return i < n ? std::min(result, minInt64Scalar(values + i, n - i)) : result;
+}
+
+__attribute__((target("avx2")))
+static int64_t maxInt64Avx2(const int64_t* values, size_t n)
+{
+    if (n < 4)
+    {
+        return maxInt64Scalar(values, n);
+    }
+    __m256i acc = _mm256_loadu_si256((const __m256i*)values);
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(values + i));
+        acc = _mm256_blendv_epi8(acc, v, _mm256_cmpgt_epi64(v, acc));
+    }
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, acc);
+    int64_t result = maxInt64Scalar(lanes, 4);
+    return i < n ? std::max(result, maxInt64Scalar(values + i, n - i)) : result;
+}
+
+__attribute__((target("avx2")))
+static double sumDoubleAvx2(const double* values, size_t n)
+{
+    __m256d acc0 = _mm256_setzero_pd();
+    __m256d acc1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        acc0 = _mm256_add_pd(acc0, _mm256_loadu_pd(values + i));
+        acc1 = _mm256_add_pd(acc1, _mm256_loadu_pd(values + i + 4));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sumDoubleScalar(values + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static double minDoubleAvx2(const double* values, size_t n)
+{
+    if (n < 4)
+    {
+        return minDoubleScalar(values, n);
+    }
+    __m256d acc = _mm256_loadu_pd(values);
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4)
+    {
+        acc = _mm256_min_pd(acc, _mm256_loadu_pd(values + i));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, acc);
+    double result = minDoubleScalar(lanes, 4);
+    return i < n ? std::min(result, minDoubleScalar(values + i, n - i)) : result;
+}
+
+__attribute__((target("avx2")))
+static double maxDoubleAvx2(const double* values, size_t n)
+{
+    if (n < 4)
+    {
+        return maxDoubleScalar(values, n);
+    }
+    __m256d acc = _mm256_loadu_pd(values);
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4)
+    {
+        acc = _mm256_max_pd(acc, _mm256_loadu_pd(values + i));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, acc);
+    double result = maxDoubleScalar(lanes, 4);
+    return i < n ? std::max(result, maxDoubleScalar(values + i, n - i)) : result;
+}
+#endif
+
+//---------------------------------------------- DISPATCH ------------------------------------------------//
+
+/**
+ * The kernels best suited for the CPU the process runs on.
+ */
+struct Kernels {
+    int64_t (*sumInt64)(const int64_t*, size_t);
+    int64_t (*minInt64)(const int64_t*, size_t);
+    int64_t (*maxInt64)(const int64_t*, size_t);
+    double (*sumDouble)(const double*, size_t);
+    double (*minDouble)(const double*, size_t);
+    double (*maxDouble)(const double*, size_t);
+};
+
+static Kernels pickKernels()
+{
+    Kernels k = {sumInt64Scalar, minInt64Scalar, maxInt64Scalar, sumDoubleScalar, minDoubleScalar, maxDoubleScalar};
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        k = {sumInt64Avx2, minInt64Avx2, maxInt64Avx2, sumDoubleAvx2, minDoubleAvx2, maxDoubleAvx2};
+    }
+    else
+    {
+        k = {sumInt64Sse2, minInt64Scalar, maxInt64Scalar, sumDoubleSse2, minDoubleSse2, maxDoubleSse2};
+        if (__builtin_cpu_supports("sse4.2"))
+        {
+            k.minInt64 = minInt64Sse42;
+            k.maxInt64 = maxInt64Sse42;
+        }
+    }
+#endif
+    return k;
+}
+
+static const Kernels& kernels()
+{
+    static const Kernels k = pickKernels();
+    return k;
+}
+
+int64_t sumInt64(const int64_t* values, size_t n)
+{
+    return kernels().sumInt64(values, n);
+}
+
+int64_t minInt64(const int64_t* values, size_t n)
+{
+    return kernels().minInt64(values, n);
+}
+
+int64_t maxInt64(const int64_t* values, size_t n)
+{
+    return kernels().maxInt64(values, n);
+}
+
+double sumDouble(const double* values, size_t n)
+{
+    return kernels().sumDouble(values, n);
+}
+
+double minDouble(const double* values, size_t n)
+{
+    return kernels().minDouble(values, n);
+}
+
+double maxDouble(const double* values, size_t n)
+{
+    return kernels().maxDouble(values, n);
+}
+
+//---------------------------------------------- AGGREGATING CLIENT ------------------------------------------------//
+
+AggregatingClient::AggregatingClient(AggregateOp op, AggregateType type) : _op(op), _type(type)
+{
+}
+
+/** values are gathered in blocks of this size, small enough for the buffer to stay in L1. */
+static const size_t GATHER_BLOCK = 256;
+
+/**
+ * Aggregates the values of the pairs, block by block: every block is gathered into a contiguous buffer and handed
+ * to the kernel. The values are known to be of type Value, so they are cast without a check.
+ * @param kernel: aggregates a block.
+ * @param combine: combines the results of two blocks.
+ */
+template <typename Value, typename T>
+static T aggregate(const IntermediateVec* pairs, T (*kernel)(const T*, size_t), T (*combine)(T, T))
+{
+    T buffer[GATHER_BLOCK];
+    T result = T();
+    for (size_t i = 0; i < pairs->size(); i += GATHER_BLOCK)
+    {
+        size_t n = std::min(GATHER_BLOCK, pairs->size() - i);
+        for (size_t j = 0; j < n; ++j)
+        {
+            buffer[j] = static_cast<const Value*>((*pairs)[i + j].second)->value;
+        }
+        T blockResult = kernel(buffer, n);
+        result = i == 0 ? blockResult : combine(result, blockResult);
+    }
+    return result;
+}
+
+template <typename T>
+static T add(T a, T b)
+{
+    return a + b;
+}
+
+template <typename T>
+static T min(T a, T b)
+{
+    return std::min(a, b);
+}
+
+template <typename T>
+static T max(T a, T b)
+{
+    return std::max(a, b);
+}
+
+void AggregatingClient::reduce(const IntermediateVec* pairs, void* context) const
+{
+    AggregateResult result = {pairs->size(), 0, 0};
+    if (_op == AGG_COUNT || pairs->empty())
+    {
+        emitAggregate(pairs, result, context);
+        return;
+    }
+
+    if (_type == AGG_INT64)
+    {
+        switch (_op)
+        {
+            case AGG_SUM:
+                result.intValue = aggregate<Int64Value>(pairs, sumInt64, add<int64_t>);
+                break;
+            case AGG_MIN:
+                result.intValue = aggregate<Int64Value>(pairs, minInt64, min<int64_t>);
+                break;
+            case AGG_MAX:
+                result.intValue = aggregate<Int64Value>(pairs, maxInt64, max<int64_t>);
+                break;
+            default: // AGG_MEAN
+                result.intValue = aggregate<Int64Value>(pairs, sumInt64, add<int64_t>);
+                result.doubleValue = (double)result.intValue / result.count;
+        }
+    }
+    else
+    {
+        switch (_op)
+        {
+            case AGG_SUM:
+                result.doubleValue = aggregate<DoubleValue>(pairs, sumDouble, add<double>);
+                break;
+            case AGG_MIN:
+                result.doubleValue = aggregate<DoubleValue>(pairs, minDouble, min<double>);
+                break;
+            case AGG_MAX:
+                result.doubleValue = aggregate<DoubleValue>(pairs, maxDouble, max<double>);
+                break;
+            default: // AGG_MEAN
+                result.doubleValue = aggregate<DoubleValue>(pairs, sumDouble, add<double>) / result.count;
+        }
+    }
+    emitAggregate(pairs, result, context);
+}
@@ -0,0 +1,66 @@
+#ifndef AGGREGATEREDUCERS_H
+#define AGGREGATEREDUCERS_H
+
+#include <cstdint>
+#include <cstddef>
+#include "MapReduceClient.h"
+
+// built in reducers for numeric aggregations.
+// a client whose map emits Int64Value or DoubleValue values can derive from AggregatingClient instead of
+// writing reduce: the values of every key are gathered, block by block, into a contiguous array and
+// aggregated by a vectorized kernel (AVX2 or SSE, picked at runtime, with a scalar fallback).
+
+// numeric intermediate values.
+class Int64Value : public V2 {
+public:
+    explicit Int64Value(int64_t value) : value(value) {}
+    int64_t value;
+};
+
+class DoubleValue : public V2 {
+public:
+    explicit DoubleValue(double value) : value(value) {}
+    double value;
+};
+
+enum AggregateOp {AGG_SUM=0, AGG_COUNT=1, AGG_MIN=2, AGG_MAX=3, AGG_MEAN=4};
+enum AggregateType {AGG_INT64=0, AGG_DOUBLE=1};
+
+typedef struct {
+    size_t count;        // the number of values aggregated.
+    int64_t intValue;    // the result of a sum, min or max over int64 values.
+    double doubleValue;  // the result of an aggregation over double values, or of a mean.
+} AggregateResult;
+
+// the kernels, over contiguous arrays. n must be positive for min and max.
+// sums of doubles are added in a different order than a plain loop would, so they may differ in the last bits.
+int64_t sumInt64(const int64_t* values, size_t n);
+int64_t minInt64(const int64_t* values, size_t n);
+int64_t maxInt64(const int64_t* values, size_t n);
+double sumDouble(const double* values, size_t n);
+double minDouble(const double* values, size_t n);
+double maxDouble(const double* values, size_t n);
+
+class AggregatingClient : public MapReduceClient {
+public:
+    /**
+     * @param op: The aggregation reduce applies to the values of every key.
+     * @param type: The type of the values map emits, Int64Value for AGG_INT64 or DoubleValue for AGG_DOUBLE.
+     */
+    AggregatingClient(AggregateOp op, AggregateType type);
+
+    // aggregates the values of the key and hands the result to emitAggregate.
+    void reduce(const IntermediateVec* pairs, void* context) const override;
+
+    // gets the pairs of a key and the aggregation of their values, calls emit3 with the result.
+    // the pairs are still owned by the client, as in reduce.
+    virtual void emitAggregate(const IntermediateVec* pairs, const AggregateResult& result,
+                               void* context) const = 0;
+
+private:
+    AggregateOp _op;
+    AggregateType _type;
+};
+
+
+#endif //AGGREGATEREDUCERS_H
@@ -0,0 +1,150 @@
+#include "CheckpointStore.h"
+#include <iostream>
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+/** the name of the job's description in the directory. */
+static const char* const DESCRIPTION = "job.meta";
+
+/** the prefix of the files the store writes, all the others in the directory are left alone. */
+static const char* const PREFIX = "ckpt-";
+
+/** the suffix of a checkpoint that is still being written. */
+static const char* const TEMPORARY = ".tmp";
+
+/**
+ * Prints the error and exits.
+ */
+static void systemError(const std::string& msg)
+{
+    std::cerr << "System Error: " << msg << std::endl;
+    exit(1);
+}
+
+/**
+ * Reads the whole file.
+ * @return false if the file can't be opened.
+ */
+static bool readFile(const std::string& path, std::string& data)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+    data.clear();
+    char buffer[1 << 16];
+    ssize_t bytes;
+    while ((bytes = read(fd, buffer, sizeof(buffer))) != 0)
+    {
+        if (bytes < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            close(fd);
+            return false;
+        }
+        data.append(buffer, bytes);
+    }
+    close(fd);
+    return true;
+}
+
+/**
+ * Writes the data to a temporary file, flushes it to the disk and renames it to path.
+ */
+static void writeFile(const std::string& path, const std::string& data)
+{
+    std::string temporary = path + TEMPORARY;
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        systemError("couldn't create the checkpoint " + temporary + ".");
+    }
+    const char* next = data.data();
+    size_t left = data.size();
+    while (left > 0)
+    {
+        ssize_t written = write(fd, next, left);
+        if (written < 0 && errno != EINTR)
+        {
+            systemError("couldn't write the checkpoint " + temporary + ".");
+        }
+        if (written > 0)
+        {
+            next += written;
+            left -= written;
+        }
+    }
+    if (fsync(fd) != 0 || close(fd) != 0 || rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        systemError("couldn't complete the checkpoint " + path + ".");
+    }
+}
+
+CheckpointStore::CheckpointStore(const std::string& dir) : _dir(dir)
+{
+}
+
+void CheckpointStore::open(const std::string& description, bool resume)
+{
+    if (mkdir(_dir.c_str(), 0755) != 0 && errno != EEXIST)
+    {
+        systemError("couldn't create the checkpoint directory " + _dir + ".");
+    }
+
+    std::string old;
+    if (resume && readFile(path(DESCRIPTION), old))
+    {
+        if (old != description)
+        {
+            std::cerr << "MapReduce error: the checkpoints in " << _dir << " belong to another job." << std::endl;
+            exit(1);
+        }
+        return;
+    }
+
+    // A new job, or one that was killed before it wrote its description:
+    clear();
+    writeFile(path(DESCRIPTION), description);
+}
+
+bool CheckpointStore::load(const std::string& name, std::string& data) const
+{
+    return readFile(path(name), data);
+}
+
+void CheckpointStore::store(const std::string& name, const std::string& data) const
+{
+    writeFile(path(name), data);
+}
+
+void CheckpointStore::clear() const
+{
+    DIR* dir = opendir(_dir.c_str());
+    if (dir == nullptr)
+    {
+        systemError("couldn't open the checkpoint directory " + _dir + ".");
+    }
+    std::string prefix = PREFIX;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr)
+    {
+        if (std::string(entry->d_name).compare(0, prefix.size(), prefix) == 0)
+        {
+            unlink((_dir + "/" + entry->d_name).c_str());
+        }
+    }
+    closedir(dir);
+}
+
+std::string CheckpointStore::path(const std::string& name) const
+{
+    return _dir + "/" + PREFIX + name;
+}
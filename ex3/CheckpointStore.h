@@ -0,0 +1,53 @@
+#ifndef CHECKPOINTSTORE_H
+#define CHECKPOINTSTORE_H
+
+#include <string>
+
+// keeps the checkpoints of a job as files in a local directory.
+// every checkpoint is written to a temporary file which is renamed over its name once it is complete,
+// so a checkpoint that exists was written whole, even if the job's process was killed in the middle.
+// a description of the job, kept along with the checkpoints, makes sure they are only resumed by a job with the
+// same description. the description is only as good as what the caller puts in it: checkpoints of another job that
+// is described the same are taken for the job's own.
+
+class CheckpointStore {
+public:
+    /**
+     * Creates a new checkpoint store object.
+     * @param dir: The directory to keep the checkpoints in, created if missing.
+     */
+    explicit CheckpointStore(const std::string& dir);
+
+    /**
+     * Prepares the directory for a job.
+     * @param description: Describes the job, a resumed job should have the same description.
+     * @param resume: If true, keeps the checkpoints of a job with the same description, and fails if the
+     * directory holds the checkpoints of another job. Otherwise, throws away the checkpoints in the directory.
+     */
+    void open(const std::string& description, bool resume);
+
+    /**
+     * Reads a checkpoint.
+     * @param name: The name of the checkpoint.
+     * @param data: set to the contents of the checkpoint.
+     * @return false if there is no such checkpoint.
+     */
+    bool load(const std::string& name, std::string& data) const;
+
+    /**
+     * Writes a checkpoint, replacing the old one with this name if it exists.
+     */
+    void store(const std::string& name, const std::string& data) const;
+
+private:
+    /**
+     * Removes all the checkpoints and temporary files in the directory.
+     */
+    void clear() const;
+
+    std::string path(const std::string& name) const;
+
+    std::string _dir;
+};
+
+#endif //CHECKPOINTSTORE_H
@@ -0,0 +1,247 @@
+#include "CompressedRun.h"
+#include "LzCodec.h"
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+
+/** the number of pairs in a block, the most that are decoded at once. */
+static const size_t BLOCK_PAIRS = 256;
+
+//---------------------------------------------- STATIC FUNCTIONS ------------------------------------------------//
+
+/**
+ * Appends an unsigned integer to out, 7 bits a byte with the high bit set on all bytes but the last.
+ */
+static void putVarint(std::string& out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back((char)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((char)value);
+}
+
+/**
+ * Reads a varint at pos, and advances pos.
+ * @return false if the varint exceeds the buffer.
+ */
+static bool getVarint(const std::string& data, size_t& pos, uint64_t& value)
+{
+    value = 0;
+    for (int shift = 0; pos < data.size() && shift < 64; shift += 7)
+    {
+        auto byte = (unsigned char)data[pos++];
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Prints the error and exits.
+ */
+static void systemError(const std::string& msg)
+{
+    std::cerr << "System Error: " << msg << std::endl;
+    exit(1);
+}
+
+//---------------------------------------------- COMPRESSED RUN ------------------------------------------------//
+
+CompressedRun::CompressedRun(const IntermediateSerializer& serializer, RunCompression compression)
+        : _serializer(serializer), _compression(compression), _reading(false), _size(0), _encodedBytes(0),
+          _rawBytes(0)
+{
+}
+
+CompressedRun::~CompressedRun()
+{
+    // Pairs decoded but never popped are still owned by the run:
+    for (Segment& segment : _segments)
+    {
+        for (const IntermediatePair& pair : segment.decoded)
+        {
+            delete pair.first;
+            delete pair.second;
+        }
+    }
+}
+
+void CompressedRun::append(const IntermediateVec& segment)
+{
+    append(segment.data(), segment.size());
+}
+
+void CompressedRun::append(const IntermediatePair* segment, size_t count)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    _segments.push_back(Segment());
+    for (size_t i = 0; i < count; i += BLOCK_PAIRS)
+    {
+        encodeBlock(_segments.back(), segment + i, segment + std::min(i + BLOCK_PAIRS, count));
+    }
+    _size += count;
+    if (_reading)
+    {
+        pushSegment((int)_segments.size() - 1);
+    }
+}
+
+void CompressedRun::encodeBlock(Segment& segment, const IntermediatePair* begin, const IntermediatePair* end)
+{
+    std::string packed;
+    std::string previous, key, value;
+    for (auto it = begin; it != end; ++it)
+    {
+        key.clear();
+        value.clear();
+        _serializer.writeKey(it->first, key);
+        _serializer.writeValue(it->second, value);
+        _rawBytes += key.size() + value.size();
+
+        size_t shared = 0;
+        size_t most = std::min(key.size(), previous.size());
+        while (shared < most && key[shared] == previous[shared])
+        {
+            ++shared;
+        }
+        putVarint(packed, shared);
+        putVarint(packed, key.size() - shared);
+        packed.append(key, shared, std::string::npos);
+        putVarint(packed, value.size());
+        packed.append(value);
+        previous.swap(key);
+    }
+
+    Block block;
+    block.pairs = end - begin;
+    block.rawSize = 0;
+    if (_compression == RUN_PACKED_LZ)
+    {
+        lzCompress(packed.data(), packed.size(), block.data);
+        block.rawSize = packed.size();
+        if (block.data.size() >= packed.size())
+        {
+            // Incompressible, keeps it packed only:
+            block.data.clear();
+            block.rawSize = 0;
+        }
+    }
+    if (block.rawSize == 0)
+    {
+        block.data.swap(packed);
+    }
+    block.data.shrink_to_fit();
+    _encodedBytes += block.data.size();
+    segment.blocks.push_back(std::move(block));
+}
+
+void CompressedRun::decodeLastBlock(Segment& segment)
+{
+    Block& block = segment.blocks.back();
+    std::string unpacked;
+    const std::string* packed = &block.data;
+    if (block.rawSize != 0)
+    {
+        if (!lzDecompress(block.data.data(), block.data.size(), block.rawSize, unpacked))
+        {
+            systemError("a compressed run is malformed.");
+        }
+        packed = &unpacked;
+    }
+
+    std::string key;
+    size_t pos = 0;
+    for (size_t i = 0; i < block.pairs; ++i)
+    {
+        uint64_t shared, suffix, valueSize;
+        if (!getVarint(*packed, pos, shared) || shared > key.size() || !getVarint(*packed, pos, suffix) ||
+            packed->size() - pos < suffix)
+        {
+            systemError("a compressed run is malformed.");
+        }
+        key.resize(shared);
+        key.append(*packed, pos, suffix);
+        pos += suffix;
+        if (!getVarint(*packed, pos, valueSize) || packed->size() - pos < valueSize)
+        {
+            systemError("a compressed run is malformed.");
+        }
+        segment.decoded.push_back(IntermediatePair(_serializer.readKey(key.data(), key.size()),
+                                                   _serializer.readValue(packed->data() + pos, valueSize)));
+        pos += valueSize;
+    }
+    segment.blocks.pop_back();
+}
+
+bool CompressedRun::empty()
+{
+    return _size == 0;
+}
+
+bool CompressedRun::LastPairOrder::operator()(int a, int b) const
+{
+    return *((*segments)[a].decoded.back().first) < *((*segments)[b].decoded.back().first);
+}
+
+void CompressedRun::pushSegment(int index)
+{
+    Segment& segment = _segments[index];
+    if (segment.decoded.empty() && !segment.blocks.empty())
+    {
+        decodeLastBlock(segment);
+    }
+    if (!segment.decoded.empty())
+    {
+        _heap.push_back(index);
+        std::push_heap(_heap.begin(), _heap.end(), LastPairOrder{&_segments});
+    }
+}
+
+const IntermediatePair& CompressedRun::back()
+{
+    if (!_reading)
+    {
+        _reading = true;
+        for (int i = 0; i < (int)_segments.size(); ++i)
+        {
+            pushSegment(i);
+        }
+    }
+    // The last pair of the run is the greatest of the last pairs of the segments:
+    return _segments[_heap.front()].decoded.back();
+}
+
+void CompressedRun::pop_back()
+{
+    back();
+    std::pop_heap(_heap.begin(), _heap.end(), LastPairOrder{&_segments});
+    int index = _heap.back();
+    _heap.pop_back();
+    _segments[index].decoded.pop_back();
+    pushSegment(index);
+    --_size;
+}
+
+size_t CompressedRun::size() const
+{
+    return _size;
+}
+
+size_t CompressedRun::encodedBytes() const
+{
+    return _encodedBytes;
+}
+
+size_t CompressedRun::rawBytes() const
+{
+    return _rawBytes;
+}
@@ -0,0 +1,100 @@
+#ifndef COMPRESSEDRUN_H
+#define COMPRESSEDRUN_H
+
+#include <string>
+#include <vector>
+#include "MapReduceClient.h"
+#include "MapReduceSerializer.h"
+
+// a sorted run of intermediate pairs kept encoded in memory. it is built from sorted segments, appended one by one
+// as the map stage produces them, and read from its back like the vector it replaces, merging the segments.
+// a segment is kept in blocks of consecutive pairs. in a block, every key is kept as the length of the prefix it
+// shares with the key before it and the rest of its bytes, all the lengths are varints, and the block may be
+// compressed with the LZ codec on top. a block is decoded only when its turn comes, and freed once it is decoded.
+
+enum RunCompression {RUN_PLAIN=0, RUN_PACKED=1, RUN_PACKED_LZ=2};
+
+class CompressedRun {
+public:
+    /**
+     * Creates a new, empty, compressed run object.
+     * @param serializer: Encodes the pairs of the run, and builds them back.
+     * @param compression: RUN_PACKED for prefix compressed keys and varints, RUN_PACKED_LZ to compress every
+     * block with the LZ codec as well, which saves more memory for more CPU.
+     */
+    CompressedRun(const IntermediateSerializer& serializer, RunCompression compression);
+
+    ~CompressedRun();
+
+    /**
+     * Encodes a sorted segment and adds it to the run. The pairs themselves are left to the caller.
+     */
+    void append(const IntermediateVec& segment);
+
+    /**
+     * Encodes a sorted segment of count pairs and adds it to the run. The pairs themselves are left to the caller.
+     */
+    void append(const IntermediatePair* segment, size_t count);
+
+    /** @return true if all the pairs were popped. */
+    bool empty();
+
+    /** @return The last pair of the run, built by the serializer. The caller owns its key and value. */
+    const IntermediatePair& back();
+
+    /** Removes the last pair of the run. */
+    void pop_back();
+
+    /** @return The number of pairs left in the run. */
+    size_t size() const;
+
+    /** @return The number of bytes the encoded run took once it was encoded. */
+    size_t encodedBytes() const;
+
+    /** @return The number of bytes the run's pairs take serialized, without the run's own compression. */
+    size_t rawBytes() const;
+
+private:
+    struct Block {
+        std::string data;
+        size_t rawSize; // the size of the data before the LZ codec, 0 if the block isn't compressed.
+        size_t pairs;
+    };
+
+    struct Segment {
+        std::vector<Block> blocks;
+        IntermediateVec decoded; // the pairs of the last block decoded that weren't popped yet.
+    };
+
+    /**
+     * Encodes the pairs in [begin, end) into a new block of the segment.
+     */
+    void encodeBlock(Segment& segment, const IntermediatePair* begin, const IntermediatePair* end);
+
+    /**
+     * Decodes the last block of the segment into its decoded pairs, and frees it.
+     */
+    void decodeLastBlock(Segment& segment);
+
+    /**
+     * Puts a segment that has pairs left in the heap, decoding its last block if it has none decoded.
+     */
+    void pushSegment(int index);
+
+    /** Orders the segments in the heap by their last pairs. */
+    struct LastPairOrder {
+        const std::vector<Segment>* segments;
+        bool operator()(int a, int b) const;
+    };
+
+    const IntermediateSerializer& _serializer;
+    RunCompression _compression;
+    std::vector<Segment> _segments;
+    std::vector<int> _heap; // the segments with pairs left, a max heap on their last pairs, once the run is read.
+    bool _reading;          // false until the first pair is read, the heap is built then.
+    size_t _size;
+    size_t _encodedBytes;
+    size_t _rawBytes;
+};
+
+#endif //COMPRESSEDRUN_H
@@ -0,0 +1,56 @@
+#include "HugePageAllocator.h"
+#include <cstdint>
+#include <sys/mman.h>
+
+/**
+ * @return The size rounded up to whole huge pages.
+ */
+static size_t hugePagesSize(size_t bytes)
+{
+    return (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+}
+
+void* mapHugePages(size_t bytes, HugePageMode mode)
+{
+    size_t size = hugePagesSize(bytes);
+#ifdef MAP_HUGETLB
+    if (mode == HUGE_PAGES_HUGETLB)
+    {
+        void* block = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (block != MAP_FAILED)
+        {
+            return block;
+        }
+        // The pool is empty or not configured, so transparent huge pages will do.
+    }
+#endif
+
+    // The kernel only backs whole aligned 2MB ranges with huge pages, so the block is carved out of a bigger one:
+    size_t mapped = size + HUGE_PAGE_SIZE;
+    void* area = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (area == MAP_FAILED)
+    {
+        return nullptr;
+    }
+    auto start = reinterpret_cast<uintptr_t>(area);
+    uintptr_t aligned = (start + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    if (aligned > start)
+    {
+        munmap(area, aligned - start);
+    }
+    if (start + mapped > aligned + size)
+    {
+        munmap(reinterpret_cast<void*>(aligned + size), start + mapped - (aligned + size));
+    }
+    auto block = reinterpret_cast<void*>(aligned);
+#ifdef MADV_HUGEPAGE
+    // Only a hint, the block works with small pages if the kernel won't give huge ones:
+    madvise(block, size, MADV_HUGEPAGE);
+#endif
+    return block;
+}
+
+void unmapHugePages(void* block, size_t bytes)
+{
+    munmap(block, hugePagesSize(bytes));
+}
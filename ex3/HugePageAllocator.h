@@ -0,0 +1,94 @@
+#ifndef HUGEPAGEALLOCATOR_H
+#define HUGEPAGEALLOCATOR_H
+
+#include <cstddef>
+#include <new>
+#include <vector>
+#include "MapReduceClient.h"
+
+// an allocator for big, randomly accessed vectors, such as the map results of a thread that are sorted and
+// merged, whose pages would otherwise miss the TLB all the time.
+// a block of at least HUGE_PAGE_SIZE bytes is mapped on its own and backed by 2MB pages: transparent huge pages
+// asked for with madvise, or pages of the hugetlbfs pool, falling back to transparent ones when the pool is
+// empty. smaller blocks come from the heap as usual.
+
+enum HugePageMode {HUGE_PAGES_OFF=0, HUGE_PAGES_TRANSPARENT=1, HUGE_PAGES_HUGETLB=2};
+
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+/**
+ * Maps a block of the given size, rounded up to whole huge pages, and aligned to them.
+ * @return The block, nullptr on failure.
+ */
+void* mapHugePages(size_t bytes, HugePageMode mode);
+
+/**
+ * Unmaps a block of mapHugePages, with the size it was asked for.
+ */
+void unmapHugePages(void* block, size_t bytes);
+
+template <typename T>
+class HugePageAllocator {
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    explicit HugePageAllocator(HugePageMode mode = HUGE_PAGES_OFF) : _mode(mode) {}
+
+    template <typename U>
+    HugePageAllocator(const HugePageAllocator<U>& other) : _mode(other.mode()) {}
+
+    T* allocate(size_t n)
+    {
+        size_t bytes = n * sizeof(T);
+        if (_mode == HUGE_PAGES_OFF || bytes < HUGE_PAGE_SIZE)
+        {
+            return static_cast<T*>(::operator new(bytes));
+        }
+        void* block = mapHugePages(bytes, _mode);
+        if (block == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(block);
+    }
+
+    void deallocate(T* block, size_t n)
+    {
+        size_t bytes = n * sizeof(T);
+        if (_mode == HUGE_PAGES_OFF || bytes < HUGE_PAGE_SIZE)
+        {
+            ::operator delete(block);
+        }
+        else
+        {
+            unmapHugePages(block, bytes);
+        }
+    }
+
+    HugePageMode mode() const
+    {
+        return _mode;
+    }
+
+private:
+    HugePageMode _mode;
+};
+
+template <typename T, typename U>
+bool operator==(const HugePageAllocator<T>& a, const HugePageAllocator<U>& b)
+{
+    return a.mode() == b.mode();
+}
+
+template <typename T, typename U>
+bool operator!=(const HugePageAllocator<T>& a, const HugePageAllocator<U>& b)
+{
+    return !(a == b);
+}
+
+// the intermediate pairs of a thread, with huge pages when its job asks for them.
+typedef std::vector<IntermediatePair, HugePageAllocator<IntermediatePair> > HugeIntermediateVec;
+
+#endif //HUGEPAGEALLOCATOR_H
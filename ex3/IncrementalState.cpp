@@ -0,0 +1,174 @@
+#include "IncrementalState.h"
+#include "IntermediateCodec.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+
+/**
+ * Compares two output pairs by their keys.
+ */
+static bool outputComparator(const OutputPair& p1, const OutputPair& p2)
+{
+    return *(p1.first) < *(p2.first);
+}
+
+/**
+ * @return true if the two keys are equal.
+ */
+static bool sameKey(const K3* k1, const K3* k2)
+{
+    return !(*k1 < *k2) && !(*k2 < *k1);
+}
+
+/**
+ * Combines the value of the delta pair into the value of the pair, deleting the delta pair.
+ */
+static void combineInto(OutputPair& pair, const OutputPair& delta, const IncrementalClient& client)
+{
+    V3* combined = client.combine(pair.first, pair.second, delta.second);
+    delete pair.second;
+    delete delta.first;
+    delete delta.second;
+    pair.second = combined;
+}
+
+IncrementalState::IncrementalState() : _processed(0)
+{
+}
+
+IncrementalState::~IncrementalState()
+{
+    clear();
+}
+
+unsigned long IncrementalState::processedElements() const
+{
+    return _processed;
+}
+
+const OutputVec& IncrementalState::pairs() const
+{
+    return _pairs;
+}
+
+void IncrementalState::merge(OutputVec& delta, const IncrementalClient& client, unsigned long elements)
+{
+    // The delta may hold a key more than once, when reduce emitted it for a few intermediate keys:
+    std::stable_sort(delta.begin(), delta.end(), outputComparator);
+    OutputVec unique;
+    for (const OutputPair& pair : delta)
+    {
+        if (!unique.empty() && sameKey(unique.back().first, pair.first))
+        {
+            combineInto(unique.back(), pair, client);
+        }
+        else
+        {
+            unique.push_back(pair);
+        }
+    }
+    delta.clear();
+
+    OutputVec merged;
+    try
+    {
+        merged.reserve(_pairs.size() + unique.size());
+    }
+    catch (std::bad_alloc &e)
+    {
+        std::cerr << "system error: couldn't merge the incremental state." << std::endl;
+        exit(1);
+    }
+    auto old = _pairs.begin();
+    auto added = unique.begin();
+    while (old != _pairs.end() || added != unique.end())
+    {
+        if (added == unique.end() || (old != _pairs.end() && *(old->first) < *(added->first)))
+        {
+            merged.push_back(*old++);
+        }
+        else if (old == _pairs.end() || *(added->first) < *(old->first))
+        {
+            merged.push_back(*added++);
+        }
+        else
+        {
+            merged.push_back(*old++);
+            combineInto(merged.back(), *added++, client);
+        }
+    }
+    _pairs.swap(merged);
+    _processed += elements;
+}
+
+bool IncrementalState::save(const std::string& path, const OutputSerializer& serializer) const
+{
+    std::string data;
+    uint64_t processed = _processed;
+    data.append(reinterpret_cast<const char*>(&processed), sizeof(processed));
+    encodeOutput(_pairs, serializer, data);
+
+    std::string temporary = path + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    bool written = fwrite(data.data(), 1, data.size(), file) == data.size() && fflush(file) == 0 &&
+                   fsync(fileno(file)) == 0;
+    written = fclose(file) == 0 && written;
+    return written && rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+bool IncrementalState::load(const std::string& path, const OutputSerializer& serializer)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    std::string data;
+    char buffer[1 << 16];
+    size_t bytes;
+    while ((bytes = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        data.append(buffer, bytes);
+    }
+    bool failed = ferror(file) != 0;
+    fclose(file);
+
+    uint64_t processed;
+    OutputVec pairs;
+    if (failed || data.size() < sizeof(processed))
+    {
+        return false;
+    }
+    memcpy(&processed, data.data(), sizeof(processed));
+    if (!decodeOutput(data.data() + sizeof(processed), data.size() - sizeof(processed), serializer, pairs))
+    {
+        for (const OutputPair& pair : pairs)
+        {
+            delete pair.first;
+            delete pair.second;
+        }
+        return false;
+    }
+    clear();
+    _pairs.swap(pairs);
+    _processed = processed;
+    return true;
+}
+
+void IncrementalState::clear()
+{
+    for (const OutputPair& pair : _pairs)
+    {
+        delete pair.first;
+        delete pair.second;
+    }
+    _pairs.clear();
+    _processed = 0;
+}
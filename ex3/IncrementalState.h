@@ -0,0 +1,67 @@
+#ifndef INCREMENTALSTATE_H
+#define INCREMENTALSTATE_H
+
+#include <string>
+#include "MapReduceClient.h"
+#include "MapReduceSerializer.h"
+
+// the state of a job that is run again and again over an input that only grows.
+// the state keeps the output of the runs so far, sorted by key, and the number of input elements they covered.
+// a run maps only the elements appended since, reduces their pairs into a delta output, and merges the delta into
+// the state: a key found in both gets its values combined by the client, any other key is added as is.
+// this only gives the output a full run would if the client's reduce is associative and commutative.
+
+class IncrementalClient : public MapReduceClient {
+public:
+    /**
+     * Combines the value a key had in the previous runs with the value reduce gave it from the new input.
+     * @return a new value, the framework deletes the two values it got.
+     */
+    virtual V3* combine(const K3* key, const V3* previous, const V3* delta) const = 0;
+};
+
+class IncrementalState {
+public:
+    IncrementalState();
+
+    /** Deletes the keys and values of the state. */
+    ~IncrementalState();
+
+    /** @return The number of input elements the runs so far covered. */
+    unsigned long processedElements() const;
+
+    /** @return The output of the runs so far, sorted by key. The keys and values are owned by the state. */
+    const OutputVec& pairs() const;
+
+    /**
+     * Merges the output of a run into the state.
+     * @param delta: the run's output, its keys and values are taken over by the state (or deleted).
+     * @param client: combines the values of a key.
+     * @param elements: the number of input elements the run covered.
+     */
+    void merge(OutputVec& delta, const IncrementalClient& client, unsigned long elements);
+
+    /**
+     * Writes the state to a file, replacing it once the state was written whole.
+     * @return false on failure.
+     */
+    bool save(const std::string& path, const OutputSerializer& serializer) const;
+
+    /**
+     * Replaces the state with one written by save.
+     * @return false if the file can't be read or is malformed, the state is left as it was in this case.
+     */
+    bool load(const std::string& path, const OutputSerializer& serializer);
+
+private:
+    IncrementalState(const IncrementalState&);
+    IncrementalState& operator=(const IncrementalState&);
+
+    /** Deletes the keys and values of the state, and empties it. */
+    void clear();
+
+    OutputVec _pairs;
+    unsigned long _processed;
+};
+
+#endif //INCREMENTALSTATE_H
@@ -0,0 +1,133 @@
+#include "IntermediateCodec.h"
+#include <cstdint>
+#include <cstring>
+
+//---------------------------------------------- STATIC FUNCTIONS ------------------------------------------------//
+
+/**
+ * Appends a fixed width integer to out.
+ */
+template <typename T>
+static void putInt(std::string& out, T value)
+{
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+/**
+ * Reads a fixed width integer at pos, if there is room for it, and advances pos.
+ * @return false if the integer exceeds the buffer.
+ */
+template <typename T>
+static bool getInt(const char* data, size_t size, size_t& pos, T& value)
+{
+    if (size - pos < sizeof(T))
+    {
+        return false;
+    }
+    memcpy(&value, data + pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+}
+
+/**
+ * Starts a length prefixed field by writing a placeholder length.
+ * @return the position of the length, to hand to endField once the field was appended.
+ */
+static size_t beginField(std::string& out)
+{
+    size_t lenPos = out.size();
+    putInt<uint32_t>(out, 0);
+    return lenPos;
+}
+
+/**
+ * Patches the length of a field started by beginField.
+ */
+static void endField(std::string& out, size_t lenPos)
+{
+    auto len = (uint32_t)(out.size() - lenPos - sizeof(uint32_t));
+    memcpy(&out[lenPos], &len, sizeof(len));
+}
+
+/**
+ * Encodes pairs of any of the key/value kinds, with a serializer for that kind.
+ */
+template <typename Pair, typename Serializer>
+static void encodePairs(const Pair* pairs, size_t count, const Serializer& serializer, std::string& out)
+{
+    putInt<uint64_t>(out, count);
+    for (const Pair* pair = pairs; pair != pairs + count; ++pair)
+    {
+        size_t lenPos = beginField(out);
+        serializer.writeKey(pair->first, out);
+        endField(out, lenPos);
+        lenPos = beginField(out);
+        serializer.writeValue(pair->second, out);
+        endField(out, lenPos);
+    }
+}
+
+/**
+ * Decodes pairs of any of the key/value kinds, with a serializer for that kind.
+ */
+template <typename Pair, typename Serializer>
+static bool decodePairs(const char* data, size_t size, const Serializer& serializer, std::vector<Pair>& out)
+{
+    size_t pos = 0;
+    uint64_t count;
+    if (!getInt(data, size, pos, count))
+    {
+        return false;
+    }
+    // Every pair takes at least its two lengths, so a larger count is malformed, and isn't reserved for:
+    if (count > (size - pos) / (2 * sizeof(uint32_t)))
+    {
+        return false;
+    }
+    out.reserve(out.size() + count);
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        uint32_t keyLen, valLen;
+        if (!getInt(data, size, pos, keyLen) || size - pos < keyLen)
+        {
+            return false;
+        }
+        const char* keyData = data + pos;
+        pos += keyLen;
+        if (!getInt(data, size, pos, valLen) || size - pos < valLen)
+        {
+            return false;
+        }
+        const char* valData = data + pos;
+        pos += valLen;
+        out.push_back(Pair(serializer.readKey(keyData, keyLen), serializer.readValue(valData, valLen)));
+    }
+    return true;
+}
+
+//--------------------------------------------------PUBLIC METHODS--------------------------------------------------//
+
+void encodeRun(const IntermediateVec& run, const IntermediateSerializer& serializer, std::string& out)
+{
+    encodePairs(run.data(), run.size(), serializer, out);
+}
+
+void encodeRun(const IntermediatePair* run, size_t count, const IntermediateSerializer& serializer, std::string& out)
+{
+    encodePairs(run, count, serializer, out);
+}
+
+bool decodeRun(const char* data, size_t size, const IntermediateSerializer& serializer, IntermediateVec& out)
+{
+    return decodePairs(data, size, serializer, out);
+}
+
+void encodeOutput(const OutputVec& pairs, const OutputSerializer& serializer, std::string& out)
+{
+    encodePairs(pairs.data(), pairs.size(), serializer, out);
+}
+
+bool decodeOutput(const char* data, size_t size, const OutputSerializer& serializer, OutputVec& out)
+{
+    return decodePairs(data, size, serializer, out);
+}
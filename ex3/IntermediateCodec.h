@@ -0,0 +1,48 @@
+#ifndef INTERMEDIATECODEC_H
+#define INTERMEDIATECODEC_H
+
+#include <string>
+#include "MapReduceClient.h"
+#include "MapReduceSerializer.h"
+
+// the byte layout of a run of pairs:
+// a 64 bit count of records, followed by the records, each is a
+// 32 bit key length, the key bytes, a 32 bit value length and the value bytes.
+
+/**
+ * Appends the encoding of the run to out.
+ * @param run: the pairs to encode, in the order they should be decoded.
+ * @param serializer: the client's serializer.
+ * @param out: the buffer to append to.
+ */
+void encodeRun(const IntermediateVec& run, const IntermediateSerializer& serializer, std::string& out);
+
+/**
+ * Appends the encoding of the count pairs at run to out, as the vector version does.
+ */
+void encodeRun(const IntermediatePair* run, size_t count, const IntermediateSerializer& serializer, std::string& out);
+
+/**
+ * Decodes a run written by encodeRun and appends its pairs to out. Keys and values are built by the
+ * serializer straight from data, without copying the run first.
+ * @param data: the start of the run.
+ * @param size: the number of bytes available at data.
+ * @param serializer: the client's serializer.
+ * @param out: the vector to append the decoded pairs to.
+ * @return false if the run is malformed (out may hold a prefix of the run in this case).
+ */
+bool decodeRun(const char* data, size_t size, const IntermediateSerializer& serializer, IntermediateVec& out);
+
+/**
+ * Appends the encoding of output pairs to out, in the same layout as a run of intermediate pairs.
+ */
+void encodeOutput(const OutputVec& pairs, const OutputSerializer& serializer, std::string& out);
+
+/**
+ * Decodes output pairs written by encodeOutput and appends them to out.
+ * @return false if the buffer is malformed.
+ */
+bool decodeOutput(const char* data, size_t size, const OutputSerializer& serializer, OutputVec& out);
+
+
+#endif //INTERMEDIATECODEC_H
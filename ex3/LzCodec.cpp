@@ -0,0 +1,166 @@
+#include "LzCodec.h"
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+static const size_t MIN_MATCH = 4;
+static const size_t MAX_OFFSET = 65535;
+static const int HASH_BITS = 12;
+static const unsigned int NIBBLE_MAX = 15;
+static const unsigned int BYTE_MAX = 255;
+
+//---------------------------------------------- STATIC FUNCTIONS ------------------------------------------------//
+
+static uint32_t read32(const char* p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t hash32(uint32_t value)
+{
+    return (value * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/**
+ * Writes the part of a length that doesn't fit its nibble.
+ */
+static void putLength(std::string& out, size_t len)
+{
+    while (len >= BYTE_MAX)
+    {
+        out.push_back((char)BYTE_MAX);
+        len -= BYTE_MAX;
+    }
+    out.push_back((char)len);
+}
+
+/**
+ * Reads the part of a length that didn't fit its nibble.
+ * @return false if the block ended in the middle of the length.
+ */
+static bool getLength(const unsigned char*& ip, const unsigned char* end, size_t& len)
+{
+    unsigned int byte;
+    do
+    {
+        if (ip == end)
+        {
+            return false;
+        }
+        byte = *ip++;
+        len += byte;
+    } while (byte == BYTE_MAX);
+    return true;
+}
+
+/**
+ * Writes a sequence: the literals in [literals, literals + numLiterals) followed by a match, if matchLen != 0.
+ */
+static void putSequence(std::string& out, const char* literals, size_t numLiterals, size_t offset, size_t matchLen)
+{
+    size_t matchCode = matchLen == 0 ? 0 : matchLen - MIN_MATCH;
+    unsigned int token = (numLiterals < NIBBLE_MAX ? numLiterals : NIBBLE_MAX) << 4 |
+                         (matchCode < NIBBLE_MAX ? matchCode : NIBBLE_MAX);
+    out.push_back((char)token);
+    if (numLiterals >= NIBBLE_MAX)
+    {
+        putLength(out, numLiterals - NIBBLE_MAX);
+    }
+    out.append(literals, numLiterals);
+    if (matchLen == 0)
+    {
+        return;
+    }
+    out.push_back((char)(offset & 0xff));
+    out.push_back((char)(offset >> 8));
+    if (matchCode >= NIBBLE_MAX)
+    {
+        putLength(out, matchCode - NIBBLE_MAX);
+    }
+}
+
+//--------------------------------------------------PUBLIC METHODS--------------------------------------------------//
+
+void lzCompress(const char* src, size_t size, std::string& out)
+{
+    std::vector<long> table(1u << HASH_BITS, -1);
+    size_t anchor = 0;
+    size_t i = 0;
+    while (i + MIN_MATCH <= size)
+    {
+        uint32_t seq = read32(src + i);
+        uint32_t h = hash32(seq);
+        long candidate = table[h];
+        table[h] = (long)i;
+        if (candidate >= 0 && i - candidate <= MAX_OFFSET && read32(src + candidate) == seq)
+        {
+            size_t matchLen = MIN_MATCH;
+            while (i + matchLen < size && src[candidate + matchLen] == src[i + matchLen])
+            {
+                ++matchLen;
+            }
+            putSequence(out, src + anchor, i - anchor, i - candidate, matchLen);
+            i += matchLen;
+            anchor = i;
+        }
+        else
+        {
+            ++i;
+        }
+    }
+    // the last sequence holds only literals, the decoder stops after it.
+    putSequence(out, src + anchor, size - anchor, 0, 0);
+}
+
+bool lzDecompress(const char* src, size_t size, size_t rawSize, std::string& out)
+{
+    const auto* ip = (const unsigned char*)src;
+    const unsigned char* end = ip + size;
+    size_t base = out.size();
+    out.reserve(base + rawSize);
+    while (ip < end)
+    {
+        unsigned int token = *ip++;
+        size_t numLiterals = token >> 4;
+        if (numLiterals == NIBBLE_MAX && !getLength(ip, end, numLiterals))
+        {
+            return false;
+        }
+        if ((size_t)(end - ip) < numLiterals || out.size() - base + numLiterals > rawSize)
+        {
+            return false;
+        }
+        out.append((const char*)ip, numLiterals);
+        ip += numLiterals;
+        if (ip == end)
+        {
+            break;
+        }
+
+        if (end - ip < 2)
+        {
+            return false;
+        }
+        size_t offset = ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        size_t matchLen = token & NIBBLE_MAX;
+        if (matchLen == NIBBLE_MAX && !getLength(ip, end, matchLen))
+        {
+            return false;
+        }
+        matchLen += MIN_MATCH;
+        if (offset == 0 || offset > out.size() - base || out.size() - base + matchLen > rawSize)
+        {
+            return false;
+        }
+        // the match may overlap the bytes it produces, so it is copied byte by byte:
+        size_t from = out.size() - offset;
+        for (size_t j = 0; j < matchLen; ++j)
+        {
+            out.push_back(out[from + j]);
+        }
+    }
+    return out.size() - base == rawSize;
+}
@@ -0,0 +1,27 @@
+#ifndef LZCODEC_H
+#define LZCODEC_H
+
+#include <string>
+#include <cstddef>
+
+// a small LZ77 codec in the spirit of LZ4: a compressed block is a list of sequences, each a token
+// (literal length nibble, match length nibble), the literals and a 16 bit back reference.
+// fast to compress and to decode, meant for the framework's own buffers and not for storage.
+
+/**
+ * Appends the compression of the size bytes at src to out.
+ */
+void lzCompress(const char* src, size_t size, std::string& out);
+
+/**
+ * Appends the decompression of a block written by lzCompress to out.
+ * @param src: the compressed block.
+ * @param size: the size of the compressed block.
+ * @param rawSize: the size of the block before compression.
+ * @param out: the buffer to append to.
+ * @return false if the block is malformed or doesn't decompress into exactly rawSize bytes.
+ */
+bool lzDecompress(const char* src, size_t size, size_t rawSize, std::string& out);
+
+
+#endif //LZCODEC_H
@@ -1792,3 +1792,251 @@ int main(int argc, char **argv) {
 //    std::cout << "AMOUNT OF BUCKETS" << oil.size() << std::endl;
 //    return 0;
 //}
+
+
+
+
+
+//// Tokenizer Client
+//#include "MapReduceFramework.h"
+//#include <cstdio>
+//#include <string>
+//#include <vector>
+//#include <chrono>
+//
+//// A word count over a tokenized text: every record is a line of space separated tokens, which map hashes into one
+//// of TOKENS keys. Runs the job once with emit2/emit3 per pair and once with emit2Batch/emit3Batch, and prints
+//// the times.
+//
+//static const int TOKENS = 4096;
+//
+//class VLine : public V1 {
+//public:
+//    std::string line;
+//};
+//
+//class KToken : public K2, public K3 {
+//public:
+//    KToken(int token = 0) : token(token) {}
+//    virtual bool operator<(const K2 &other) const {
+//        return token < static_cast<const KToken&>(other).token;
+//    }
+//    virtual bool operator<(const K3 &other) const {
+//        return token < static_cast<const KToken&>(other).token;
+//    }
+//    int token;
+//};
+//
+//class VOne : public V2, public V3 {};
+//
+//static KToken tokens[TOKENS]; // the keys are shared, so the client measures the emits rather than the allocator.
+//static VOne one;
+//
+//class TokenizerClient : public MapReduceClient {
+//public:
+//    bool batch;
+//
+//    explicit TokenizerClient(bool batch) : batch(batch) {}
+//
+//    void map(const K1* key, const V1* value, void* context) const {
+//        (void)key;
+//        std::vector<IntermediatePair> pairs;
+//        unsigned hash = 0;
+//        for (char c : static_cast<const VLine*>(value)->line) {
+//            if (c != ' ') {
+//                hash = hash * 31 + c;
+//                continue;
+//            }
+//            if (batch) {
+//                pairs.push_back({&tokens[hash % TOKENS], &one});
+//            } else {
+//                emit2(&tokens[hash % TOKENS], &one, context);
+//            }
+//            hash = 0;
+//        }
+//        if (batch) {
+//            emit2Batch(pairs.data(), pairs.size(), context);
+//        }
+//    }
+//
+//    virtual void reduce(const IntermediateVec* pairs, void* context) const {
+//        // every occurrence is emitted back out, as a reduce that filters or reshapes its pairs would:
+//        std::vector<OutputPair> out;
+//        for (const IntermediatePair& pair : *pairs) {
+//            if (batch) {
+//                out.push_back({static_cast<KToken*>(pair.first), &one});
+//            } else {
+//                emit3(static_cast<KToken*>(pair.first), &one, context);
+//            }
+//        }
+//        if (batch) {
+//            emit3Batch(out.data(), out.size(), context);
+//        }
+//    }
+//};
+//
+//int main() {
+//    for (int i = 0; i < TOKENS; ++i) {
+//        tokens[i].token = i;
+//    }
+//    InputVec inputVec;
+//    for (int i = 0; i < 4000; ++i) {
+//        auto* line = new VLine;
+//        for (int j = 0; j < 500; ++j) {
+//            line->line += std::to_string((i * 131 + j * 7) % 5000) + " ";
+//        }
+//        inputVec.push_back({nullptr, line});
+//    }
+//
+//    for (int batch = 0; batch <= 1; ++batch) {
+//        TokenizerClient client(batch != 0);
+//        OutputVec outputVec;
+//        auto start = std::chrono::steady_clock::now();
+//        JobHandle job = startMapReduceJob(client, inputVec, outputVec, 1);
+//        closeJobHandle(job);
+//        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+//        printf("%s: %zu pairs in %.1f ms\n", batch ? "emit2Batch/emit3Batch" : "emit2/emit3", outputVec.size(), ms);
+//    }
+//
+//    for (InputPair& pair : inputVec) {
+//        delete pair.second;
+//    }
+//    return 0;
+//}
+
+
+
+
+
+//// Huge Pages Client
+//#include "MapReduceFramework.h"
+//#include <linux/perf_event.h>
+//#include <sys/syscall.h>
+//#include <sys/ioctl.h>
+//#include <unistd.h>
+//#include <cstdio>
+//#include <cstdlib>
+//#include <cstring>
+//#include <cstdint>
+//#include <chrono>
+//
+//// Sorts 5M pairs on 2 threads with each JobConfig::hugePages mode, and prints the dTLB read misses the job took,
+//// counted by perf_event_open on the process and its threads, with the time and the huge pages the process got.
+//// Where the kernel or the VM exposes no hardware counters, the misses are printed as unavailable.
+//
+//class KInt : public K2, public K3 {
+//public:
+//    KInt(uint64_t value) : value(value) {}
+//    virtual bool operator<(const K2 &other) const {
+//        return value < static_cast<const KInt&>(other).value;
+//    }
+//    virtual bool operator<(const K3 &other) const {
+//        return value < static_cast<const KInt&>(other).value;
+//    }
+//    uint64_t value;
+//};
+//
+//class VSeed : public V1 {
+//public:
+//    VSeed(int seed) : seed(seed) {}
+//    int seed;
+//};
+//
+//class VOne : public V2, public V3 {};
+//
+//static VOne one;
+//
+//class ScatterClient : public MapReduceClient {
+//public:
+//    void map(const K1* key, const V1* value, void* context) const {
+//        (void)key;
+//        uint64_t x = static_cast<const VSeed*>(value)->seed * 0x9E3779B97F4A7C15ULL;
+//        for (int i = 0; i < 1000; ++i) {
+//            x ^= x >> 31;
+//            x *= 0xBF58476D1CE4E5B9ULL;
+//            emit2(new KInt(x % 1000003), &one, context);
+//        }
+//    }
+//
+//    virtual void reduce(const IntermediateVec* pairs, void* context) const {
+//        uint64_t value = static_cast<const KInt*>(pairs->at(0).first)->value;
+//        for (const IntermediatePair& pair : *pairs) {
+//            delete pair.first;
+//        }
+//        if (value % 1000 == 0) {
+//            emit3(new KInt(value), &one, context);
+//        }
+//    }
+//};
+//
+//static int openCounter(uint32_t type, uint64_t config) {
+//    perf_event_attr attr;
+//    memset(&attr, 0, sizeof(attr));
+//    attr.size = sizeof(attr);
+//    attr.type = type;
+//    attr.config = config;
+//    attr.disabled = 1;
+//    attr.exclude_kernel = 1;
+//    attr.exclude_hv = 1;
+//    attr.inherit = 1; // the job's threads are created after the counter is.
+//    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+//}
+//
+//static long anonHugePagesKb() {
+//    long kb = 0;
+//    char line[256];
+//    FILE* smaps = fopen("/proc/self/smaps_rollup", "r");
+//    while (smaps != nullptr && fgets(line, sizeof(line), smaps) != nullptr) {
+//        if (strncmp(line, "AnonHugePages:", 14) == 0) {
+//            kb = atol(line + 14);
+//        }
+//    }
+//    if (smaps != nullptr) {
+//        fclose(smaps);
+//    }
+//    return kb;
+//}
+//
+//int main() {
+//    InputVec inputVec;
+//    for (int i = 0; i < 5000; ++i) {
+//        inputVec.push_back({nullptr, new VSeed(i)});
+//    }
+//    const char* modes[] = {"off", "transparent", "hugetlb"};
+//    for (int mode = 0; mode <= 2; ++mode) {
+//        int misses = openCounter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+//                                                     (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+//                                                     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+//        ScatterClient client;
+//        OutputVec outputVec;
+//        JobConfig config;
+//        config.hugePages = mode;
+//        ioctl(misses, PERF_EVENT_IOC_ENABLE, 0);
+//        auto start = std::chrono::steady_clock::now();
+//        JobHandle job = startMapReduceJob(client, inputVec, outputVec, 2, config);
+//        waitForJob(job);
+//        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+//        ioctl(misses, PERF_EVENT_IOC_DISABLE, 0);
+//        long hugeKb = anonHugePagesKb();
+//        closeJobHandle(job);
+//
+//        long long count = 0;
+//        if (misses >= 0 && read(misses, &count, sizeof(count)) == (ssize_t)sizeof(count)) {
+//            printf("huge pages %s: %.2f s, %lld dTLB read misses, %ld kB of huge pages\n",
+//                   modes[mode], seconds, count, hugeKb);
+//        } else {
+//            printf("huge pages %s: %.2f s, dTLB read misses unavailable, %ld kB of huge pages\n",
+//                   modes[mode], seconds, hugeKb);
+//        }
+//        if (misses >= 0) {
+//            close(misses);
+//        }
+//        for (OutputPair& pair : outputVec) {
+//            delete pair.first;
+//        }
+//    }
+//    for (InputPair& pair : inputVec) {
+//        delete pair.second;
+//    }
+//    return 0;
+//}
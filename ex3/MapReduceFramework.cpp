@@ -5,16 +5,42 @@
 #include "MapReduceFramework.h"
 #include "Barrier.h"
 #include "MapReduceClient.h"
+#include "IntermediateCodec.h"
+#include "ProcessMapper.h"
+#include "NodeCluster.h"
+#include "CheckpointStore.h"
+#include "CompressedRun.h"
+#include "MemoryGovernor.h"
+#include "HugePageAllocator.h"
+#include "MapTaskLoop.h"
+#include "Sketches.h"
+#include "OutputFile.h"
 #include <atomic>
 #include <algorithm>
 #include <pthread.h>
 #include <semaphore.h>
 #include <cassert>
 #include <unordered_map>
+#include <cmath>
+#include <ctime>
+#include <unistd.h>
+#include <climits>
+#include <cerrno>
+#include <poll.h>
 
 //-------------------------------------------- USEFUL STRUCTS --------------------------------------------------//
 
 
+/**
+ * A task in the reducing queue: a group of pairs sharing a key, or with checkpoints, a whole partition.
+ */
+struct ReduceTask
+{
+    IntermediateVec pairs;
+    int partition; // the partition's index, -1 for a single group.
+};
+
+
 /**
  * This struct holds all parameters relevant to the thread.
  */
@@ -23,15 +49,46 @@ struct ThreadContext
     int _id;
     int _jid;
     pthread_t _thread;
-    IntermediateVec _mapRes; // Keeps the results of the map stage.
+    HugeIntermediateVec _mapRes; // Keeps the results of the map stage.
+    OutputVec* _localOutput; // If not null, emit3 adds to it instead of to the job's output vector.
+    CompressedRun* _run; // If not null, keeps the results of the map stage encoded, instead of mapRes.
+    MapTaskLoop* _loop;  // If not null, runs the thread's map tasks, which awaitFd suspends.
+    SketchTable* _sketches; // If not null, keeps the sketches map fed, by key, until they are moved to mapRes.
+    bool _mapping;   // with speculativeMap, the thread maps a chunk.
+    bool _abandoned; // with speculativeMap, the job's output doesn't wait for the thread, whose chunk was done by
+                     // another. it is only joined when the job is closed.
 
     /**
      * constructs a new thread context object
      * @param tid: the thread's id
      * @param jid : the id of the job to which the thread in connected
-     * @param threadObj: the thread
+     * @param pages: the pages that back the results of the map stage.
+     */
+    ThreadContext(int tid, int jid, HugePageMode pages = HUGE_PAGES_OFF):_id(tid), _jid(jid),
+                                    _mapRes(HugePageAllocator<IntermediatePair>(pages)), _localOutput(nullptr),
+                                    _run(nullptr), _loop(nullptr), _sketches(nullptr), _mapping(false),
+                                    _abandoned(false){}
+
+    /**
+     * destructs this ThreadContext.
      */
-    ThreadContext(int tid, int jid):_id(tid), _jid(jid){}
+    ~ThreadContext()
+    {
+        delete _run;
+        delete _sketches;
+    }
+};
+
+/**
+ * A chunk of the input, with speculativeMap.
+ */
+struct MapChunk
+{
+    unsigned long begin;
+    unsigned long end;
+    bool done;
+    int copies;     // the number of threads the chunk was handed to.
+    double started; // the time it was first handed out, in seconds.
 };
 
 /**
@@ -42,6 +99,12 @@ struct JobContext{
 
     std::vector<ThreadContext*> _contexts;
     const MapReduceClient* _client;
+    JobConfig _config;
+    ProcessMapper* _processMapper; // maps the input in forked processes, nullptr if the job maps in its threads.
+    NodeCluster* _cluster; // runs the job on node processes, nullptr if the job runs in its threads.
+    CheckpointStore* _checkpoint; // keeps the job's checkpoints, nullptr if the job doesn't checkpoint.
+    unsigned long _chunkSize; // with checkpoints, the input is mapped in chunks of this many elements.
+    std::atomic<unsigned long> _nextChunk;
     int _numOfWorkers;
     long _numOfElements;
 
@@ -56,14 +119,50 @@ struct JobContext{
     std::atomic<unsigned int> _firstToArrive;
     Barrier _barrier;
 
+    std::atomic<int> _mapThreads; // the threads taking part in each stage, only the first ones do.
+    std::atomic<int> _reduceThreads;
+    bool _mapThreadsChosen;       // with autoThreads, the other threads wait for the first one to choose.
+    pthread_cond_t _mapThreadsCv;
+
     const InputVec* _inputVec;
     pthread_mutex_t _inputMutex; // Used to lock the input vector when needed.
-    std::vector<IntermediateVec> _reducingQueue;
+    std::vector<ReduceTask> _reducingQueue;
     sem_t _queueSizeSem;
     pthread_mutex_t _queueMutex; //Used to lock the jobs queue
+    unsigned long _queuedPairs;    // the pairs in the reducing queue.
+    unsigned long _maxQueuedPairs; // the shuffle waits for the reducers while the queue holds more pairs.
+    pthread_cond_t _queueCv;
+
+    size_t _budget; // the memory reserved for the job with the governor.
+    size_t _spillPairs; // the map results of a thread are encoded into its run whenever they reach this many pairs.
+    RunCompression _spillCompression;
+    std::atomic<unsigned long> _spills;
+    std::atomic<unsigned long> _runBytes;    // the bytes of the threads' runs, kept by spillRun for getJobStats,
+    std::atomic<unsigned long> _rawRunBytes; // which can't read the runs while their threads append to them.
+    bool _started; // false while the job waits for the governor to admit it.
+    pthread_cond_t _threadsCv; // signals that the job started, or that a thread is done.
+    int _liveThreads;    // the threads that haven't exited yet.
+    int _pendingThreads; // the threads that haven't exited yet, and that the job waits for.
+
+    std::vector<MapChunk> _mapChunks; // with speculativeMap, the input is mapped in chunks.
+    unsigned long _nextMapChunk;
+    unsigned long _committedChunks;
+    std::vector<double> _chunkTimes; // the durations of the committed chunks.
+    pthread_mutex_t _chunkMutex;
+    pthread_cond_t _chunkCv;
+    int _shufflingThread; // the thread that shuffles, the one that committed the last chunk with speculativeMap.
+    unsigned long _speculativeChunks;
+    unsigned long _discardedChunks;
     OutputVec* _outputVec;
     pthread_mutex_t _outputMutex; //Used to lock the output vector
 
+    IncrementalState* _state; // with startIncrementalJob, the state the output is merged into, else nullptr.
+    const IncrementalClient* _incrementalClient;
+    InputVec* _deltaInput;    // with startIncrementalJob, the job's input and output are these, owned by the job...
+    OutputVec* _deltaOutput;
+    OutputVec* _finalOutput;  // ...and the merged output goes to the caller's vector.
+    bool _merged;
+
 
 
      /**
@@ -73,20 +172,35 @@ struct JobContext{
       * @param inputVec : the job's input
       * @param outputVec : the place for the job to output to.
       * @param multiThreadLevel: the job's multi thread level.
+      * @param config: the job's optional settings.
       */
     JobContext(unsigned int jid, const MapReduceClient* client,
                         const InputVec* inputVec, OutputVec* outputVec,
-                        int multiThreadLevel):
+                        int multiThreadLevel, const JobConfig& config):
                         _jid(jid),_contexts(multiThreadLevel),
-                        _client(client), _numOfWorkers(multiThreadLevel),
+                        _client(client), _config(config), _processMapper(nullptr), _cluster(nullptr),
+                        _checkpoint(nullptr), _chunkSize(0), _nextChunk(0),
+                        _numOfWorkers(multiThreadLevel),
                         _numOfElements(inputVec->size()),_stage(UNDEFINED_STAGE),
                         _numOfProcessedElements(0), _doneShuffling(false), _doneJob(false),
                         _atomicCounter(0), _firstToArrive(0), _barrier(multiThreadLevel),
+                        _mapThreads(multiThreadLevel), _reduceThreads(multiThreadLevel),
+                        _mapThreadsChosen(false), _mapThreadsCv(PTHREAD_COND_INITIALIZER),
                         _inputVec(inputVec), _outputVec(outputVec),
                         _stateMutex(PTHREAD_MUTEX_INITIALIZER),
                         _inputMutex(PTHREAD_MUTEX_INITIALIZER),
                         _queueMutex(PTHREAD_MUTEX_INITIALIZER),
-                        _outputMutex(PTHREAD_MUTEX_INITIALIZER)
+                        _queuedPairs(0), _maxQueuedPairs(ULONG_MAX), _queueCv(PTHREAD_COND_INITIALIZER),
+                        _budget(0), _spillPairs(SIZE_MAX), _spillCompression(RUN_PLAIN), _spills(0),
+                        _runBytes(0), _rawRunBytes(0),
+                        _started(false), _threadsCv(PTHREAD_COND_INITIALIZER),
+                        _liveThreads(0), _pendingThreads(0),
+                        _nextMapChunk(0), _committedChunks(0),
+                        _chunkMutex(PTHREAD_MUTEX_INITIALIZER), _chunkCv(PTHREAD_COND_INITIALIZER),
+                        _shufflingThread(0), _speculativeChunks(0), _discardedChunks(0),
+                        _outputMutex(PTHREAD_MUTEX_INITIALIZER),
+                        _state(nullptr), _incrementalClient(nullptr), _deltaInput(nullptr), _deltaOutput(nullptr),
+                        _finalOutput(nullptr), _merged(false)
     {
 
         if (sem_init(&_queueSizeSem, 0, 0))
@@ -102,6 +216,11 @@ struct JobContext{
      */
     ~JobContext()
     {
+        delete _processMapper;
+        delete _cluster;
+        delete _checkpoint;
+        delete _deltaInput;
+        delete _deltaOutput;
         sem_destroy(&_queueSizeSem);
     }
 };
@@ -121,6 +240,51 @@ static pthread_mutex_t jobsMutex = PTHREAD_MUTEX_INITIALIZER;
 /** should be non-negative and < numOfThreads */
 static int shufflingThread = 0;
 
+/** the number of threads mapping or reducing right now, over all the jobs (used by autoThreads). */
+static std::atomic<int> busyThreads(0);
+
+/** with autoThreads, the first thread maps this many elements alone to learn what an element costs. */
+static const unsigned long PROBE_ELEMENTS = 4;
+
+/** with autoThreads, a thread is worth adding to the map stage for every this many seconds of expected work. */
+static const double MAP_SECONDS_PER_THREAD = 0.002;
+
+/** with autoThreads, a thread is worth adding to the reduce stage for every this many pairs. */
+static const unsigned long PAIRS_PER_REDUCE_THREAD = 1024;
+
+/** with mapTasks, the stack of every map task, in bytes. */
+static const size_t MAP_TASK_STACK = 256 * 1024;
+
+/** with speculativeMap, the input is split into this many chunks for every thread. */
+static const unsigned long MAP_CHUNKS_PER_THREAD = 8;
+
+/** with speculativeMap, a chunk straggles once it runs this many times longer than the median chunk... */
+static const double STRAGGLER_FACTOR = 2.0;
+
+/** ...plus this many seconds. */
+static const double STRAGGLER_SLACK = 0.01;
+
+/** with speculativeMap, an idle thread looks for stragglers this often, in nanoseconds. */
+static const long STRAGGLER_POLL_NS = 2000000;
+
+/** with compressed runs, the map results of a thread are encoded whenever they reach this many pairs. */
+static const size_t SPILL_PAIRS = 1 << 16;
+
+/** the memory an intermediate pair is assumed to take, with its key and value, when budgeting a job. */
+static const size_t ESTIMATED_PAIR_BYTES = sizeof(IntermediatePair) + 64;
+
+/** the memory budget of a job that didn't declare one, for every input element. */
+static const size_t ESTIMATED_ELEMENT_BYTES = 16 * ESTIMATED_PAIR_BYTES;
+
+/** a budget never makes a thread encode its map results before they have this many pairs. */
+static const size_t MIN_SPILL_PAIRS = 1024;
+
+/** with checkpoints, the input is mapped in about this many chunks, each is checkpointed once it is mapped. */
+static const unsigned long CHECKPOINT_CHUNKS = 64;
+
+/** with checkpoints, a reduce partition holds whole groups of pairs, until it has at least this many pairs. */
+static const unsigned long CHECKPOINT_PARTITION_PAIRS = 4096;
+
 //---------------------------------------------- STATIC FUNCTIONS ------------------------------------------------//
 
 
@@ -175,254 +339,1117 @@ static bool intermediateComparator(const IntermediatePair& p1, const Intermediat
 }
 
 /**
- * This is the function each thread runs in the beginning of the Map-Reduce process. It handles the Map and Sort
- * stages, and locks the running thread until all of the rest have finished.
- * @param tc: A struct contains the inner state of a thread.
+ * The sorted results of a thread's map stage are read by the shuffle through these, whether they are kept in its
+ * mapRes or in its compressed run.
  */
-void mapSort(ThreadContext * tc)
+static size_t runSize(ThreadContext* tc)
 {
-    JobContext *jc = jobs[tc->_jid];
-    InputPair currPair;
-    K1* currElmKey = nullptr;
-    V1* currElmVal = nullptr;
-    bool notDone = false;
-
-    // checks what is the index of the next element we should map:
-    lock(&jc->_inputMutex);
-    unsigned int old_value = (jc->_atomicCounter)++;
-
-    if(old_value < (jc->_inputVec)->size()){
-        notDone = true;
-        currPair = (*(jc->_inputVec))[old_value];
-        currElmKey = currPair.first;
-        currElmVal = currPair.second;
-    }
-    unlock(&jc->_inputMutex);
+    return tc->_run != nullptr ? tc->_run->size() : tc->_mapRes.size();
+}
 
-    // While there are elements to map, map them and keep the results in mapRes.
-    while (notDone) {
-        (jc->_client)->map(currElmKey, currElmVal, tc);
-        updateProcess(jc, 1);
+static bool runEmpty(ThreadContext* tc)
+{
+    return tc->_run != nullptr ? tc->_run->empty() : tc->_mapRes.empty();
+}
 
-        // Update JobState
-        lock(&jc->_inputMutex);
-        old_value = (jc->_atomicCounter)++;
-        if(old_value < (jc->_inputVec)->size()){
-            notDone = true;
-            currPair = (*(jc->_inputVec))[old_value];
-            currElmKey = currPair.first;
-            currElmVal = currPair.second;
-        } else{
-            notDone = false;
-        }
-        unlock(&jc->_inputMutex);
-    }
+static const IntermediatePair& runBack(ThreadContext* tc)
+{
+    return tc->_run != nullptr ? tc->_run->back() : tc->_mapRes.back();
+}
 
-    // Sorts the elements in the result of the Map stage:
-    try{
-        std::sort(tc->_mapRes.begin(), tc->_mapRes.end(), intermediateComparator);
+static void runPopBack(ThreadContext* tc)
+{
+    if (tc->_run != nullptr)
+    {
+        tc->_run->pop_back();
     }
-    catch (std::bad_alloc &e)
+    else
     {
-        std::cerr << "System Error: Sorting map results had failed." << std::endl;
-        exit(1);
+        tc->_mapRes.pop_back();
     }
-
-    // Forces the thread to wait until all the others have finished the Sort phase.
-    jc->_barrier.barrier();
 }
 
+/**
+ * Moves the sketches the thread's map calls fed so far to its mapRes, a pair per key.
+ * @param tc: A struct contains the inner state of a thread.
+ */
+static void drainSketches(ThreadContext* tc)
+{
+    if (tc->_sketches == nullptr)
+    {
+        return;
+    }
+    IntermediateVec pairs;
+    tc->_sketches->release(pairs);
+    tc->_mapRes.insert(tc->_mapRes.end(), pairs.begin(), pairs.end());
+}
 
+/**
+ * Decodes a run and appends its pairs to the thread's mapRes. The pairs are new objects built by the serializer, see
+ * ProcessMapper.h for why they don't point into the run.
+ * @return false if the run is malformed.
+ */
+static bool decodeMapRes(ThreadContext* tc, const char* data, size_t size)
+{
+    IntermediateVec pairs;
+    bool decoded = decodeRun(data, size, *(jobs[tc->_jid]->_config.serializer), pairs);
+    tc->_mapRes.insert(tc->_mapRes.end(), pairs.begin(), pairs.end());
+    return decoded;
+}
 
+/**
+ * Sorts the thread's mapRes, encodes it into the thread's compressed run, and frees the pairs. The shuffle builds
+ * them back, with the serializer, when their turn comes.
+ * @param tc: A struct contains the inner state of a thread.
+ */
+static void spillRun(ThreadContext* tc)
+{
+    JobContext *jc = jobs[tc->_jid];
+    if (tc->_run == nullptr)
+    {
+        tc->_run = new CompressedRun(*(jc->_config.serializer), jc->_spillCompression);
+    }
+    ++(jc->_spills);
+    std::sort(tc->_mapRes.begin(), tc->_mapRes.end(), intermediateComparator);
+    size_t encodedBytes = tc->_run->encodedBytes();
+    size_t rawBytes = tc->_run->rawBytes();
+    tc->_run->append(tc->_mapRes.data(), tc->_mapRes.size());
+    jc->_runBytes += tc->_run->encodedBytes() - encodedBytes;
+    jc->_rawRunBytes += tc->_run->rawBytes() - rawBytes;
+    for (const IntermediatePair& pair : tc->_mapRes)
+    {
+        delete pair.first;
+        delete pair.second;
+    }
+    tc->_mapRes.clear();
+}
 
 /**
- * The shuffling functionality
- * @param tc A struct contains the inner data of a thread.
+ * @return The number of threads a stage of a job may use: the cores not busy with other work, at least one, and no
+ * more than the job has.
  */
-static void shuffle(ThreadContext* tc)
+static int availableThreads(JobContext* jc)
 {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    long available = std::max(1L, cores - busyThreads);
+    return (int)std::min(available, (long)jc->_numOfWorkers);
+}
 
-    JobContext *jc = jobs[tc->_jid];
-    K2 *maxKey;
-    IntermediateVec toReduce;
-    unsigned int moreToGo = 0;
+/**
+ * @return The time of a monotonic clock, in seconds.
+ */
+static double now()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
 
-    //set moreToGo & _numOfElements:
-    for (int j = 0; j < jc->_numOfWorkers; ++j)
+/**
+ * Takes the next element to map from the input vector.
+ * @param jc: the job's context.
+ * @param pair: set to the element taken.
+ * @return false if there are no elements left.
+ */
+static bool takeElement(JobContext* jc, InputPair& pair)
+{
+    lock(&jc->_inputMutex);
+    unsigned int old_value = (jc->_atomicCounter)++;
+    bool taken = old_value < (jc->_inputVec)->size();
+    if (taken)
     {
-        moreToGo += jc->_contexts[j]->_mapRes.size();
+        pair = (*(jc->_inputVec))[old_value];
     }
-    jc->_numOfElements = moreToGo;
+    unlock(&jc->_inputMutex);
+    return taken;
+}
 
-    while (moreToGo > 0)
+/**
+ * With autoThreads, decides if the thread takes part in the map stage. The first thread maps a few elements alone,
+ * and sets the number of map threads by what they cost, the rest of the threads wait for its decision.
+ * @param tc: A struct contains the inner state of a thread.
+ * @return true if the thread should map.
+ */
+static bool joinMapStage(ThreadContext* tc)
+{
+    JobContext *jc = jobs[tc->_jid];
+    if (tc->_id == 0)
     {
-        // finds the key for the "toReduce" vector:
-        maxKey = nullptr;
-        for (int j = 0; j < jc->_numOfWorkers; ++j)
-        {
-            if (!jc->_contexts[j]->_mapRes.empty())
-            {
-                K2 *currKey = jc->_contexts[j]->_mapRes.back().first;
-                if (maxKey == nullptr || *maxKey < *currKey)
-                {
-                    maxKey = currKey;
-                }
-            }
-        }
-
-        //pops all elements with the key, and adds them to the "toReduce" vector:
-        for (int j = 0; j < jc->_numOfWorkers; ++j)
+        ++busyThreads;
+        InputPair currPair;
+        unsigned long probed = 0;
+        double start = now();
+        while (probed < PROBE_ELEMENTS && takeElement(jc, currPair))
         {
-            assert (maxKey != nullptr);
-            while (!jc->_contexts[j]->_mapRes.empty() &&
-                   !(*maxKey < *(jc->_contexts[j]->_mapRes.back().first)) &&
-                   !(*(jc->_contexts[j]->_mapRes.back().first) < *maxKey))
-            {
-                try{
-                    toReduce.push_back(jc->_contexts[j]->_mapRes.back());
-                }
-                catch (std::bad_alloc &e)
-                {
-                    std::cerr << "system error: couldn't add the pair to the toReduce vector." << std::endl;
-                    exit(1);
-                }
-                jc->_contexts[j]->_mapRes.pop_back();
-            }
+            (jc->_client)->map(currPair.first, currPair.second, tc);
+            updateProcess(jc, 1);
+            ++probed;
         }
+        double perElement = (now() - start) / std::max(probed, 1UL);
+        --busyThreads;
 
-        //adds the vector to the queue & signal:
-        lock(&jc->_queueMutex);
-        try
-        {
-            jc->_reducingQueue.push_back(toReduce);
-        }
-        catch (std::bad_alloc &e)
+        unsigned long left = jc->_inputVec->size() - probed;
+        double wanted = std::ceil(left * perElement / MAP_SECONDS_PER_THREAD);
+        lock(&jc->_stateMutex);
+        jc->_mapThreads = (int)std::max(1.0, std::min(wanted, (double)availableThreads(jc)));
+        jc->_mapThreadsChosen = true;
+        if (pthread_cond_broadcast(&jc->_mapThreadsCv) != 0)
         {
-            std::cerr << "system error: couldn't add the vector to the reducing queue." << std::endl;
+            std::cerr << "error on pthread_cond_broadcast" << std::endl;
             exit(1);
         }
-        unlock(&jc->_queueMutex);
+        unlock(&jc->_stateMutex);
+        return true;
+    }
 
-        if (sem_post(&jc->_queueSizeSem))
+    lock(&jc->_stateMutex);
+    while (!jc->_mapThreadsChosen)
+    {
+        if (pthread_cond_wait(&jc->_mapThreadsCv, &jc->_stateMutex) != 0)
         {
-            std::cerr << "Error using sem_post." << std::endl;
+            std::cerr << "error on pthread_cond_wait" << std::endl;
             exit(1);
         }
-        moreToGo -= toReduce.size();
-        toReduce.clear();
     }
+    unlock(&jc->_stateMutex);
+    return tc->_id < jc->_mapThreads;
 }
 
 /**
- * The reducing functionality
- * @param tc a struct contains the inner data of a thread.
+ * With autoThreads, sets the number of reduce threads by the number of pairs to reduce. Called by the first thread
+ * between the sort and the shuffle, while no other thread touches the map results.
+ * @param jc: the job's context.
  */
-static void reduce(ThreadContext *tc)
+static void chooseReduceThreads(JobContext* jc)
 {
-    JobContext *jc = jobs[tc->_jid];
-    while (!(jc->_doneShuffling && jc->_reducingQueue.empty()))
-    {
-        if (sem_wait(&jc->_queueSizeSem))
-        {
-            std::cerr << "Error using sem_wait." << std::endl;
-            exit(1);
-        }
-
-        // after this thread awaken, check if there is still work to be done:
-        if (!(jc->_doneShuffling && jc->_reducingQueue.empty()))
-        {
-
-            lock(&jc->_queueMutex);
-
-            //critical code:
-            IntermediateVec pairs = jc->_reducingQueue.back();
-            jc->_reducingQueue.pop_back();
-
-            unlock(&jc->_queueMutex);
-
-            (jc->_client)->reduce(&pairs ,tc);
-            updateProcess(jc, pairs.size());
-
-        }
-    }
-    // wake them all:
-    unsigned int old_value = (jc->_firstToArrive)++;
-    if (!(old_value))
+    unsigned long pairs = 0;
+    for (int j = 0; j < jc->_numOfWorkers; ++j)
     {
-        for (int i = 0 ; i < jc->_numOfWorkers ; ++i) {
-            if (sem_post(&jc->_queueSizeSem)) {
-                std::cerr << "Error using sem_post." << std::endl;
-                exit(1);
-            }
-        }
+        pairs += runSize(jc->_contexts[j]);
     }
+    auto wanted = (long)(pairs / PAIRS_PER_REDUCE_THREAD + 1);
+    jc->_reduceThreads = (int)std::min(wanted, (long)availableThreads(jc));
 }
 
 /**
- * This is the function that all of the threads of a job should run in order to preform the map reduce process.
- * @param arg A struct contains the inner data of a thread.
- * @return nullptr.
+ * Maps the next input element the thread takes from the input vector, keeping the results in the thread's mapRes.
+ * @param arg: The context of the thread.
+ * @return false if there are no elements left.
  */
-static void* mapReduce(void *arg)
+static bool mapNext(void *arg)
 {
     auto *tc = (ThreadContext *) arg;
     JobContext *jc = jobs[tc->_jid];
-
-    // ------mapSort:
-    mapSort(tc);
-
-    // ------shuffle:
-    if (tc->_id == shufflingThread)
+    InputPair currPair;
+    if (!takeElement(jc, currPair))
     {
-        lock(&jc->_stateMutex);
-
-        //critical code:
-
-        jc->_stage = REDUCE_STAGE;
-        jc->_numOfProcessedElements = 0;
-
-        unlock(&jc->_stateMutex);
-        shuffle(tc);
-        jc->_doneShuffling = true;
+        return false;
     }
-    // ------reduce:
-
-    reduce(tc);
-
-    return nullptr;
+    (jc->_client)->map(currPair.first, currPair.second, tc);
+    updateProcess(jc, 1);
+    if (tc->_mapRes.size() >= jc->_spillPairs)
+    {
+        spillRun(tc);
+    }
+    return true;
 }
 
 /**
- * This function creates the mapping threads and activate them.
- * @param jc A struct contains the inner data of a job.
+ * Maps the input elements the thread takes from the input vector, keeping the results in the thread's mapRes.
+ * @param tc: A struct contains the inner state of a thread.
  */
-static void initThreads(JobContext* jc) {
-
-    lock(&jc->_stateMutex);
-    jc->_stage = MAP_STAGE;
-    unlock(&jc->_stateMutex);
-
-    for (int i = 0; i < jc->_numOfWorkers; ++i) {
-        //Initialize Threads contexts:
-        auto *tc = new ThreadContext(i, jc->_jid);
-        (jc->_contexts)[i] = tc;
+static void mapInput(ThreadContext * tc)
+{
+    JobContext *jc = jobs[tc->_jid];
+    if (jc->_config.autoThreads && !joinMapStage(tc))
+    {
+        return;
+    }
 
-        if (pthread_create(&tc->_thread, nullptr, mapReduce, tc))
+    // While there are elements to map, map them and keep the results in mapRes.
+    ++busyThreads;
+    if (jc->_config.mapTasks > 1)
+    {
+        MapTaskLoop loop(jc->_config.mapTasks, MAP_TASK_STACK);
+        tc->_loop = &loop;
+        loop.run(mapNext, tc);
+        tc->_loop = nullptr;
+    }
+    else
+    {
+        while (mapNext(tc))
         {
-            std::cerr << "Error using pthread_create, on thread " << i << std::endl;
-            exit(1);
         }
     }
-}
+    --busyThreads;
+    drainSketches(tc);
 
-//--------------------------------------------------PUBLIC METHODS--------------------------------------------------//
+    // Sorts the elements in the result of the Map stage:
+    try{
+        std::sort(tc->_mapRes.begin(), tc->_mapRes.end(), intermediateComparator);
+    }
+    catch (std::bad_alloc &e)
+    {
+        std::cerr << "System Error: Sorting map results had failed." << std::endl;
+        exit(1);
+    }
+}
 
 /**
- * This function produces a (K2*,V2*) pair.The context can be used to get pointers into the framework’s variables and
- * data structures.
- * @param key: The key of an intermediate element.
- * @param value: The value of an intermediate element.
- * @param context: The context of the calling thread.
+ * Maps the input in chunks, the thread takes the next chunk until there are none left. A chunk whose checkpoint
+ * exists is loaded from it, any other chunk is mapped and its sorted results are checkpointed. The results are kept
+ * in the thread's mapRes, sorted.
+ * @param tc: A struct contains the inner state of a thread.
+ */
+static void mapChunks(ThreadContext * tc)
+{
+    JobContext *jc = jobs[tc->_jid];
+    unsigned long numElements = jc->_inputVec->size();
+    unsigned long chunk;
+    while ((chunk = (jc->_nextChunk)++) * jc->_chunkSize < numElements)
+    {
+        unsigned long begin = chunk * jc->_chunkSize;
+        unsigned long end = std::min(begin + jc->_chunkSize, numElements);
+        std::string name = "run-" + std::to_string(chunk);
+        std::string data;
+        size_t sortedSize = tc->_mapRes.size();
+
+        if (jc->_checkpoint->load(name, data))
+        {
+            if (!decodeMapRes(tc, data.data(), data.size()))
+            {
+                std::cerr << "System Error: the checkpoint " << name << " is malformed." << std::endl;
+                exit(1);
+            }
+            updateProcess(jc, end - begin);
+        }
+        else
+        {
+            for (unsigned long i = begin; i < end; ++i)
+            {
+                const InputPair &pair = (*(jc->_inputVec))[i];
+                (jc->_client)->map(pair.first, pair.second, tc);
+                updateProcess(jc, 1);
+            }
+            drainSketches(tc);
+            std::sort(tc->_mapRes.begin() + sortedSize, tc->_mapRes.end(), intermediateComparator);
+            encodeRun(tc->_mapRes.data() + sortedSize, tc->_mapRes.size() - sortedSize,
+                      *(jc->_config.serializer), data);
+            jc->_checkpoint->store(name, data);
+        }
+        std::inplace_merge(tc->_mapRes.begin(), tc->_mapRes.begin() + sortedSize, tc->_mapRes.end(),
+                           intermediateComparator);
+    }
+}
+
+/**
+ * @return A chunk, handed to a single thread, that runs much longer than the median committed chunk, or -1 if
+ * there is none. Should be called with the chunk mutex held.
+ */
+static int findStraggler(JobContext* jc, double time)
+{
+    if (jc->_chunkTimes.empty())
+    {
+        return -1;
+    }
+    std::vector<double> times(jc->_chunkTimes);
+    std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+    double limit = STRAGGLER_FACTOR * times[times.size() / 2] + STRAGGLER_SLACK;
+    for (unsigned long i = 0; i < jc->_nextMapChunk; ++i)
+    {
+        const MapChunk& chunk = jc->_mapChunks[i];
+        if (!chunk.done && chunk.copies == 1 && time - chunk.started > limit)
+        {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Waits on the chunk condition for a while, to look for stragglers again. Should be called with the chunk
+ * mutex held.
+ */
+static void waitForChunks(JobContext* jc)
+{
+    timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += STRAGGLER_POLL_NS;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    int error = pthread_cond_timedwait(&jc->_chunkCv, &jc->_chunkMutex, &deadline);
+    if (error != 0 && error != ETIMEDOUT)
+    {
+        std::cerr << "error on pthread_cond_timedwait" << std::endl;
+        exit(1);
+    }
+}
+
+/**
+ * Ends the map stage of a speculative job, once its last chunk was committed by this thread: the threads still
+ * mapping copies of chunks are abandoned, and this thread, which certainly doesn't map, shuffles. Should be called
+ * with the chunk mutex held.
+ * @param tc: A struct contains the inner state of the thread that committed the last chunk.
+ */
+static void completeSpeculativeMap(ThreadContext* tc)
+{
+    JobContext *jc = jobs[tc->_jid];
+    lock(&jc->_stateMutex);
+    for (int i = 0; i < jc->_numOfWorkers; ++i)
+    {
+        ThreadContext* other = jc->_contexts[i];
+        if (other->_mapping)
+        {
+            other->_abandoned = true;
+            --(jc->_pendingThreads);
+        }
+    }
+    unlock(&jc->_stateMutex);
+    jc->_shufflingThread = tc->_id;
+    if (jc->_config.autoThreads)
+    {
+        chooseReduceThreads(jc);
+    }
+    if (pthread_cond_broadcast(&jc->_chunkCv) != 0)
+    {
+        std::cerr << "error on pthread_cond_broadcast" << std::endl;
+        exit(1);
+    }
+}
+
+/**
+ * Maps the input in chunks, where an idle thread maps another copy of a chunk that straggles. The first copy of a
+ * chunk to finish is committed into the mapRes of its thread, the pairs of the others are deleted. The thread
+ * returns once all the chunks were committed, even if others still map copies of chunks.
+ * @param tc: A struct contains the inner state of a thread.
+ */
+static void mapSpeculative(ThreadContext * tc)
+{
+    JobContext *jc = jobs[tc->_jid];
+    lock(&jc->_chunkMutex);
+    while (jc->_committedChunks < jc->_mapChunks.size())
+    {
+        double started = now();
+        int index;
+        if (jc->_nextMapChunk < jc->_mapChunks.size())
+        {
+            index = (int)(jc->_nextMapChunk)++;
+            jc->_mapChunks[index].started = started;
+        }
+        else if ((index = findStraggler(jc, started)) < 0)
+        {
+            waitForChunks(jc);
+            continue;
+        }
+        else
+        {
+            ++(jc->_speculativeChunks);
+        }
+        MapChunk& chunk = jc->_mapChunks[index];
+        ++(chunk.copies);
+        tc->_mapping = true;
+        unlock(&jc->_chunkMutex);
+
+        // Maps the chunk with a context of its own, so this thread's mapRes isn't touched by a losing copy:
+        ThreadContext chunkContext(tc->_id, tc->_jid, (HugePageMode)jc->_config.hugePages);
+        ++busyThreads;
+        for (unsigned long i = chunk.begin; i < chunk.end; ++i)
+        {
+            const InputPair &pair = (*(jc->_inputVec))[i];
+            (jc->_client)->map(pair.first, pair.second, &chunkContext);
+        }
+        --busyThreads;
+        drainSketches(&chunkContext);
+        HugeIntermediateVec& pairs = chunkContext._mapRes;
+        std::sort(pairs.begin(), pairs.end(), intermediateComparator);
+
+        lock(&jc->_chunkMutex);
+        tc->_mapping = false;
+        if (chunk.done)
+        {
+            ++(jc->_discardedChunks);
+            for (const IntermediatePair& pair : pairs)
+            {
+                delete pair.first;
+                delete pair.second;
+            }
+            continue;
+        }
+        chunk.done = true;
+        jc->_chunkTimes.push_back(now() - started);
+        unlock(&jc->_chunkMutex);
+
+        size_t sortedSize = tc->_mapRes.size();
+        tc->_mapRes.insert(tc->_mapRes.end(), pairs.begin(), pairs.end());
+        std::inplace_merge(tc->_mapRes.begin(), tc->_mapRes.begin() + sortedSize, tc->_mapRes.end(),
+                           intermediateComparator);
+        updateProcess(jc, chunk.end - chunk.begin);
+
+        lock(&jc->_chunkMutex);
+        if (++(jc->_committedChunks) == jc->_mapChunks.size())
+        {
+            completeSpeculativeMap(tc);
+        }
+    }
+    unlock(&jc->_chunkMutex);
+}
+
+/**
+ * The work of a single map process: maps a slice of the input and encodes its sorted results.
+ * Runs in a forked child, so it only touches the child's copy of the job.
+ * @param arg: The job's context.
+ * @param begin: The first input element of the slice.
+ * @param end: One past the last input element of the slice.
+ * @param progress: Counts the mapped elements, shared with the job's process.
+ * @param segment: The buffer to encode the results into.
+ */
+static void mapSlice(void *arg, unsigned long begin, unsigned long end,
+                     std::atomic<unsigned long> &progress, std::string &segment)
+{
+    auto *jc = (JobContext *) arg;
+    ThreadContext tc(0, jc->_jid);
+    for (unsigned long i = begin; i < end; ++i)
+    {
+        const InputPair &pair = (*(jc->_inputVec))[i];
+        (jc->_client)->map(pair.first, pair.second, &tc);
+        ++progress;
+    }
+    drainSketches(&tc);
+    std::sort(tc._mapRes.begin(), tc._mapRes.end(), intermediateComparator);
+    encodeRun(tc._mapRes.data(), tc._mapRes.size(), *(jc->_config.serializer), segment);
+}
+
+/**
+ * The map work of a node: maps the input elements in [begin, end) into out.
+ * @param arg: The job's context.
+ */
+static void mapRange(void *arg, unsigned long begin, unsigned long end, IntermediateVec &out)
+{
+    auto *jc = (JobContext *) arg;
+    ThreadContext tc(0, jc->_jid);
+    for (unsigned long i = begin; i < end; ++i)
+    {
+        const InputPair &pair = (*(jc->_inputVec))[i];
+        (jc->_client)->map(pair.first, pair.second, &tc);
+    }
+    drainSketches(&tc);
+    out.insert(out.end(), tc._mapRes.begin(), tc._mapRes.end());
+}
+
+/**
+ * The reduce work of a node: reduces a group of pairs sharing a key into out.
+ * @param arg: The job's context.
+ */
+static void reduceGroup(void *arg, const IntermediateVec *group, OutputVec &out)
+{
+    auto *jc = (JobContext *) arg;
+    ThreadContext tc(0, jc->_jid);
+    tc._localOutput = &out;
+    (jc->_client)->reduce(group, &tc);
+}
+
+/**
+ * Waits for the map processes and decodes the segments that fall to this thread into its mapRes, keeping it sorted.
+ * @param tc: A struct contains the inner state of a thread.
+ */
+static void loadSegments(ThreadContext * tc)
+{
+    JobContext *jc = jobs[tc->_jid];
+    if (tc->_id == shufflingThread)
+    {
+        jc->_processMapper->wait();
+    }
+    jc->_barrier.barrier();
+
+    for (int i = tc->_id; i < jc->_processMapper->numSegments(); i += jc->_numOfWorkers)
+    {
+        size_t sortedSize = tc->_mapRes.size();
+        if (!decodeMapRes(tc, jc->_processMapper->segmentData(i), jc->_processMapper->segmentSize(i)))
+        {
+            std::cerr << "System Error: a map segment is malformed." << std::endl;
+            exit(1);
+        }
+        std::inplace_merge(tc->_mapRes.begin(), tc->_mapRes.begin() + sortedSize, tc->_mapRes.end(),
+                           intermediateComparator);
+    }
+}
+
+/**
+ * This is the function each thread runs in the beginning of the Map-Reduce process. It handles the Map and Sort
+ * stages, and locks the running thread until all of the rest have finished.
+ * @param tc: A struct contains the inner state of a thread.
+ */
+void mapSort(ThreadContext * tc)
+{
+    JobContext *jc = jobs[tc->_jid];
+    if (jc->_processMapper != nullptr)
+    {
+        loadSegments(tc);
+    }
+    else if (jc->_checkpoint != nullptr)
+    {
+        mapChunks(tc);
+    }
+    else if (jc->_config.speculativeMap)
+    {
+        mapSpeculative(tc);
+    }
+    else
+    {
+        mapInput(tc);
+    }
+    if (jc->_config.runCompression != RUN_PLAIN || tc->_run != nullptr)
+    {
+        spillRun(tc);
+        HugeIntermediateVec().swap(tc->_mapRes);
+    }
+
+    // Forces the thread to wait until all the others have finished the Sort phase.
+    // With speculativeMap, waiting for all the chunks to be committed is enough.
+    if (!jc->_config.speculativeMap)
+    {
+        jc->_barrier.barrier();
+    }
+}
+
+
+
+
+/**
+ * If a reduce partition has a checkpoint, adds its output to the output vector instead of reducing it again.
+ * @param jc: the job's context.
+ * @param partition: the partition's index.
+ * @param pairs: the partition's pairs, which are deleted if the partition is loaded.
+ * @return true if the partition was loaded.
+ */
+static bool loadPartition(JobContext* jc, int partition, IntermediateVec& pairs)
+{
+    std::string name = "part-" + std::to_string(partition);
+    std::string data;
+    if (!jc->_checkpoint->load(name, data))
+    {
+        return false;
+    }
+    OutputVec output;
+    if (!decodeOutput(data.data(), data.size(), *(jc->_config.outputSerializer), output))
+    {
+        std::cerr << "System Error: the checkpoint " << name << " is malformed." << std::endl;
+        exit(1);
+    }
+    lock(&jc->_outputMutex);
+    jc->_outputVec->insert(jc->_outputVec->end(), output.begin(), output.end());
+    unlock(&jc->_outputMutex);
+
+    // The pairs were built by the framework from the map checkpoints, or emitted by map, and no reduce will get them:
+    for (const IntermediatePair& pair : pairs)
+    {
+        delete pair.first;
+        delete pair.second;
+    }
+    updateProcess(jc, pairs.size());
+    pairs.clear();
+    return true;
+}
+
+/**
+ * @return The path of an output partition's file.
+ */
+static std::string outputPartitionPath(JobContext* jc, int partition)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/part-%05d", partition);
+    return std::string(jc->_config.outputDir) + name;
+}
+
+/**
+ * Sorts the output of a partition by key and writes it to the partition's file, deleting its pairs.
+ * @param jc: the job's context.
+ * @param partition: the partition's index.
+ * @param output: the partition's output.
+ */
+static void writeOutputPartition(JobContext* jc, int partition, OutputVec& output)
+{
+    auto keyLess = [](const OutputPair& p1, const OutputPair& p2)
+    {
+        return *(p1.first) < *(p2.first);
+    };
+    // Reduce usually emits in the order it got the groups, which is key order already:
+    if (!std::is_sorted(output.begin(), output.end(), keyLess))
+    {
+        std::stable_sort(output.begin(), output.end(), keyLess);
+    }
+    OutputFileWriter writer(outputPartitionPath(jc, partition), *(jc->_config.outputSerializer));
+    for (const OutputPair& pair : output)
+    {
+        writer.write(pair);
+        delete pair.first;
+        delete pair.second;
+    }
+    writer.close();
+    output.clear();
+}
+
+/**
+ * Reduces a partition group by group. Its output is checkpointed and added to the output vector, or, with an
+ * output directory, written to the partition's file.
+ * @param tc: A struct contains the inner state of a thread.
+ * @param task: the partition, its groups follow each other.
+ */
+static void reducePartition(ThreadContext* tc, const ReduceTask& task)
+{
+    JobContext *jc = jobs[tc->_jid];
+    OutputVec output;
+    tc->_localOutput = &output;
+    // The shuffle adds the groups from the largest key down, so they are reduced from the last one, in key order:
+    auto groupEnd = task.pairs.end();
+    while (groupEnd != task.pairs.begin())
+    {
+        auto groupBegin = groupEnd - 1;
+        while (groupBegin != task.pairs.begin() && !(*(groupBegin->first) < *((groupBegin - 1)->first)) &&
+               !(*((groupBegin - 1)->first) < *(groupBegin->first)))
+        {
+            --groupBegin;
+        }
+        IntermediateVec group(groupBegin, groupEnd);
+        (jc->_client)->reduce(&group, tc);
+        groupEnd = groupBegin;
+    }
+    tc->_localOutput = nullptr;
+
+    if (jc->_config.outputDir != nullptr)
+    {
+        writeOutputPartition(jc, task.partition, output);
+        return;
+    }
+    std::string data;
+    encodeOutput(output, *(jc->_config.outputSerializer), data);
+    jc->_checkpoint->store("part-" + std::to_string(task.partition), data);
+
+    lock(&jc->_outputMutex);
+    jc->_outputVec->insert(jc->_outputVec->end(), output.begin(), output.end());
+    unlock(&jc->_outputMutex);
+}
+
+/**
+ * Counts the threads that reduce while the shuffling thread shuffles: the reducers but the shuffling thread, and but
+ * the threads a speculative map stage abandoned, which never reduce.
+ * @param tc A struct contains the inner data of the shuffling thread.
+ */
+static int drainingReducers(ThreadContext* tc)
+{
+    JobContext *jc = jobs[tc->_jid];
+    int reducers = 0;
+    lock(&jc->_stateMutex);
+    for (int i = 0; i < jc->_reduceThreads && i < jc->_numOfWorkers; ++i)
+    {
+        if (i != tc->_id && !jc->_contexts[i]->_abandoned)
+        {
+            ++reducers;
+        }
+    }
+    unlock(&jc->_stateMutex);
+    return reducers;
+}
+
+/**
+ * The shuffling functionality
+ * @param tc A struct contains the inner data of a thread.
+ */
+static void shuffle(ThreadContext* tc)
+{
+
+    JobContext *jc = jobs[tc->_jid];
+    K2 *maxKey;
+    IntermediateVec toReduce;
+    unsigned int moreToGo = 0;
+    int partition = 0;
+    int reducers = drainingReducers(tc); // the shuffle only waits for room in the queue if some thread makes it.
+
+    //set moreToGo & _numOfElements:
+    for (int j = 0; j < jc->_numOfWorkers; ++j)
+    {
+        moreToGo += runSize(jc->_contexts[j]);
+    }
+    jc->_numOfElements = moreToGo;
+
+    // With an output directory, the key space is cut into ranges of about the same number of pairs. The keys come
+    // from the largest down, so the first range is the last partition:
+    unsigned long totalPairs = moreToGo;
+    int outputPartitions = jc->_config.outputPartitions > 0 ? jc->_config.outputPartitions : jc->_numOfWorkers;
+    std::vector<bool> written(jc->_config.outputDir != nullptr ? outputPartitions : 0, false);
+    if (jc->_config.outputDir != nullptr)
+    {
+        partition = outputPartitions - 1;
+    }
+
+    while (moreToGo > 0)
+    {
+        // finds the key for the "toReduce" vector:
+        maxKey = nullptr;
+        for (int j = 0; j < jc->_numOfWorkers; ++j)
+        {
+            if (!runEmpty(jc->_contexts[j]))
+            {
+                K2 *currKey = runBack(jc->_contexts[j]).first;
+                if (maxKey == nullptr || *maxKey < *currKey)
+                {
+                    maxKey = currKey;
+                }
+            }
+        }
+
+        //pops all elements with the key, and adds them to the "toReduce" vector:
+        size_t groupStart = toReduce.size();
+        for (int j = 0; j < jc->_numOfWorkers; ++j)
+        {
+            assert (maxKey != nullptr);
+            while (!runEmpty(jc->_contexts[j]) &&
+                   !(*maxKey < *(runBack(jc->_contexts[j]).first)) &&
+                   !(*(runBack(jc->_contexts[j]).first) < *maxKey))
+            {
+                try{
+                    toReduce.push_back(runBack(jc->_contexts[j]));
+                }
+                catch (std::bad_alloc &e)
+                {
+                    std::cerr << "system error: couldn't add the pair to the toReduce vector." << std::endl;
+                    exit(1);
+                }
+                runPopBack(jc->_contexts[j]);
+            }
+        }
+
+        moreToGo -= toReduce.size() - groupStart;
+        int taskPartition = -1;
+        if (jc->_config.outputDir != nullptr)
+        {
+            // A range ends at the first group boundary past its share of the pairs:
+            auto next = (int)(outputPartitions - 1 - (totalPairs - moreToGo) * outputPartitions / totalPairs);
+            if (next == partition && moreToGo > 0)
+            {
+                continue;
+            }
+            written[partition] = true;
+            taskPartition = partition;
+            partition = next;
+        }
+        else if (jc->_checkpoint != nullptr)
+        {
+            // Partitions are cut at the first group boundary after enough pairs:
+            if (toReduce.size() < CHECKPOINT_PARTITION_PAIRS && moreToGo > 0)
+            {
+                continue;
+            }
+            if (loadPartition(jc, partition, toReduce))
+            {
+                ++partition;
+                continue;
+            }
+        }
+
+        //adds the vector to the queue & signal, once the reducers made room for it:
+        lock(&jc->_queueMutex);
+        while (reducers > 0 && !jc->_reducingQueue.empty() &&
+               jc->_queuedPairs + toReduce.size() > jc->_maxQueuedPairs)
+        {
+            if (pthread_cond_wait(&jc->_queueCv, &jc->_queueMutex) != 0)
+            {
+                std::cerr << "error on pthread_cond_wait" << std::endl;
+                exit(1);
+            }
+        }
+        jc->_queuedPairs += toReduce.size();
+        try
+        {
+            jc->_reducingQueue.push_back({std::move(toReduce), jc->_checkpoint != nullptr ? partition++ : taskPartition});
+        }
+        catch (std::bad_alloc &e)
+        {
+            std::cerr << "system error: couldn't add the vector to the reducing queue." << std::endl;
+            exit(1);
+        }
+        unlock(&jc->_queueMutex);
+
+        if (sem_post(&jc->_queueSizeSem))
+        {
+            std::cerr << "Error using sem_post." << std::endl;
+            exit(1);
+        }
+        toReduce.clear();
+    }
+
+    // A range no key fell in still gets its file, so the files cover the whole key space:
+    for (size_t i = 0; i < written.size(); ++i)
+    {
+        if (!written[i])
+        {
+            OutputFileWriter(outputPartitionPath(jc, (int)i), *(jc->_config.outputSerializer)).close();
+        }
+    }
+}
+
+/**
+ * The reducing functionality
+ * @param tc a struct contains the inner data of a thread.
+ */
+static void reduce(ThreadContext *tc)
+{
+    JobContext *jc = jobs[tc->_jid];
+    while (!(jc->_doneShuffling && jc->_reducingQueue.empty()))
+    {
+        if (sem_wait(&jc->_queueSizeSem))
+        {
+            std::cerr << "Error using sem_wait." << std::endl;
+            exit(1);
+        }
+
+        // after this thread awaken, check if there is still work to be done:
+        if (!(jc->_doneShuffling && jc->_reducingQueue.empty()))
+        {
+
+            lock(&jc->_queueMutex);
+
+            //critical code:
+            ReduceTask task = std::move(jc->_reducingQueue.back());
+            jc->_reducingQueue.pop_back();
+            jc->_queuedPairs -= task.pairs.size();
+            if (pthread_cond_signal(&jc->_queueCv) != 0)
+            {
+                std::cerr << "error on pthread_cond_signal" << std::endl;
+                exit(1);
+            }
+
+            unlock(&jc->_queueMutex);
+
+            if (task.partition < 0)
+            {
+                (jc->_client)->reduce(&task.pairs ,tc);
+            }
+            else
+            {
+                reducePartition(tc, task);
+            }
+            updateProcess(jc, task.pairs.size());
+
+        }
+    }
+    // wake them all:
+    unsigned int old_value = (jc->_firstToArrive)++;
+    if (!(old_value))
+    {
+        for (int i = 0 ; i < jc->_numOfWorkers ; ++i) {
+            if (sem_post(&jc->_queueSizeSem)) {
+                std::cerr << "Error using sem_post." << std::endl;
+                exit(1);
+            }
+        }
+    }
+}
+
+/**
+ * Runs the map reduce process in one of the threads of a job.
+ * @param tc A struct contains the inner data of a thread.
+ */
+static void runJob(ThreadContext *tc)
+{
+    JobContext *jc = jobs[tc->_jid];
+
+    // ------on nodes, the whole job is coordinated by this (single) thread:
+    if (jc->_cluster != nullptr)
+    {
+        jc->_cluster->run(*(jc->_outputVec), &jc->_outputMutex);
+        return;
+    }
+
+    // ------mapSort:
+    mapSort(tc);
+    if (tc->_abandoned)
+    {
+        return;
+    }
+    if (jc->_config.autoThreads && !jc->_config.speculativeMap)
+    {
+        if (tc->_id == jc->_shufflingThread)
+        {
+            chooseReduceThreads(jc);
+        }
+        jc->_barrier.barrier();
+    }
+
+    // ------shuffle:
+    if (tc->_id == jc->_shufflingThread)
+    {
+        lock(&jc->_stateMutex);
+
+        //critical code:
+
+        jc->_stage = REDUCE_STAGE;
+        jc->_numOfProcessedElements = 0;
+
+        unlock(&jc->_stateMutex);
+        shuffle(tc);
+        jc->_doneShuffling = true;
+    }
+    // ------reduce:
+    if (tc->_id < jc->_reduceThreads)
+    {
+        ++busyThreads;
+        reduce(tc);
+        --busyThreads;
+    }
+}
+
+/**
+ * This is the function that all of the threads of a job should run in order to preform the map reduce process.
+ * @param arg A struct contains the inner data of a thread.
+ * @return nullptr.
+ */
+static void* mapReduce(void *arg)
+{
+    auto *tc = (ThreadContext *) arg;
+    JobContext *jc = jobs[tc->_jid];
+    runJob(tc);
+
+    lock(&jc->_stateMutex);
+    --(jc->_liveThreads);
+    if (!tc->_abandoned)
+    {
+        --(jc->_pendingThreads);
+    }
+    bool last = jc->_liveThreads == 0;
+    if (pthread_cond_broadcast(&jc->_threadsCv) != 0)
+    {
+        std::cerr << "error on pthread_cond_broadcast" << std::endl;
+        exit(1);
+    }
+    unlock(&jc->_stateMutex);
+
+    // The last thread to finish gives the job's memory back:
+    if (last)
+    {
+        MemoryGovernor::instance().release(jc->_budget);
+    }
+    return nullptr;
+}
+
+/**
+ * This function creates the mapping threads and activate them.
+ * @param jc A struct contains the inner data of a job.
+ */
+static void initThreads(JobContext* jc) {
+
+    lock(&jc->_stateMutex);
+    jc->_stage = MAP_STAGE;
+    unlock(&jc->_stateMutex);
+
+    // The map processes are forked before the job has threads of its own. getJobState may read the mapper and the
+    // cluster as soon as the stage is set, so they're only handed to the job once started:
+    ProcessMapper* processMapper = nullptr;
+    NodeCluster* cluster = nullptr;
+    if (jc->_config.mapProcesses > 0)
+    {
+        processMapper = new ProcessMapper(jc->_config.mapProcesses, jc->_inputVec->size(), mapSlice, jc);
+        processMapper->start();
+    }
+    if (jc->_config.nodes > 0)
+    {
+        cluster = new NodeCluster(jc->_config.nodes, jc->_inputVec->size(), jc->_config.serializer,
+                                  jc->_config.outputSerializer, mapRange, reduceGroup, jc);
+        cluster->start();
+    }
+
+    lock(&jc->_stateMutex);
+    jc->_processMapper = processMapper;
+    jc->_cluster = cluster;
+    jc->_liveThreads = jc->_numOfWorkers;
+    jc->_pendingThreads = jc->_numOfWorkers;
+    unlock(&jc->_stateMutex);
+
+    // A speculative map stage may end before all the contexts exist, so the threads wait for them:
+    lock(&jc->_chunkMutex);
+    for (int i = 0; i < jc->_numOfWorkers; ++i) {
+        //Initialize Threads contexts:
+        auto *tc = new ThreadContext(i, jc->_jid, (HugePageMode)jc->_config.hugePages);
+        (jc->_contexts)[i] = tc;
+
+        if (pthread_create(&tc->_thread, nullptr, mapReduce, tc))
+        {
+            std::cerr << "Error using pthread_create, on thread " << i << std::endl;
+            exit(1);
+        }
+    }
+    unlock(&jc->_chunkMutex);
+
+    lock(&jc->_stateMutex);
+    jc->_started = true;
+    if (pthread_cond_broadcast(&jc->_threadsCv) != 0)
+    {
+        std::cerr << "error on pthread_cond_broadcast" << std::endl;
+        exit(1);
+    }
+    unlock(&jc->_stateMutex);
+}
+
+/**
+ * Starts a job the memory governor admitted.
+ * @param job: The job's context.
+ */
+static void startAdmitted(void *job)
+{
+    initThreads((JobContext *) job);
+}
+
+/**
+ * Sets the memory budget of a job, and how the job keeps to it: the map results of a thread are encoded into a
+ * compressed run once they take their share of half the budget, and the shuffle waits for the reducers while the
+ * reducing queue takes more than the other half. A job without a serializer can't encode its map results, so the
+ * budget only decides when it is admitted.
+ * @param jc: the job's context.
+ */
+static void setBudget(JobContext *jc)
+{
+    size_t limit = MemoryGovernor::instance().limit();
+    const JobConfig &config = jc->_config;
+    jc->_budget = config.memoryBudget;
+    if (jc->_budget == 0)
+    {
+        jc->_budget = jc->_inputVec->size() * ESTIMATED_ELEMENT_BYTES;
+        if (limit > 0)
+        {
+            jc->_budget = std::min(jc->_budget, limit);
+        }
+    }
+
+    if (config.runCompression != RUN_PLAIN)
+    {
+        jc->_spillPairs = SPILL_PAIRS;
+        jc->_spillCompression = (RunCompression)config.runCompression;
+    }
+    bool enforced = config.memoryBudget > 0 || limit > 0;
+    // Only a job that asked for runCompression has its pairs deleted once encoded, the others keep to the budget
+    // by the admission and the shuffle's backpressure alone:
+    if (enforced && config.runCompression != RUN_PLAIN)
+    {
+        size_t share = jc->_budget / 2 / (jc->_numOfWorkers * ESTIMATED_PAIR_BYTES);
+        jc->_spillPairs = std::min(jc->_spillPairs, std::max(share, MIN_SPILL_PAIRS));
+    }
+    if (enforced)
+    {
+        jc->_maxQueuedPairs = std::max(jc->_budget / 2 / ESTIMATED_PAIR_BYTES, (size_t)MIN_SPILL_PAIRS);
+    }
+}
+
+//--------------------------------------------------PUBLIC METHODS--------------------------------------------------//
+
+/**
+ * This function produces a (K2*,V2*) pair.The context can be used to get pointers into the framework’s variables and
+ * data structures.
+ * @param key: The key of an intermediate element.
+ * @param value: The value of an intermediate element.
+ * @param context: The context of the calling thread.
  */
 void emit2(K2 *key, V2 *value, void *context) {
     // Converting context to the right type:
@@ -448,6 +1475,11 @@ void emit2(K2 *key, V2 *value, void *context) {
  */
 void emit3(K3 *key, V3 *value, void *context) {
     auto *tc = (ThreadContext *) context;
+    if (tc->_localOutput != nullptr)
+    {
+        tc->_localOutput->push_back(OutputPair(key, value));
+        return;
+    }
     JobContext *jc = jobs[tc->_jid];
 
     // Converting context to the right type:
@@ -465,6 +1497,156 @@ void emit3(K3 *key, V3 *value, void *context) {
     unlock(&jc->_outputMutex);
 }
 
+/**
+ * This function produces count (K2*,V2*) pairs, as count calls to emit2 would.
+ * @param pairs: The intermediate pairs.
+ * @param count: The number of pairs.
+ * @param context: The context of the calling thread.
+ */
+void emit2Batch(const IntermediatePair *pairs, size_t count, void *context) {
+    auto *tc = (ThreadContext *) context;
+    try{
+        tc->_mapRes.insert(tc->_mapRes.end(), pairs, pairs + count);
+    }
+    catch (std::bad_alloc &e)
+    {
+        std::cerr << "system error: couldn't add to the IntermediatePairs vector." << std::endl;
+        exit(1);
+    }
+}
+
+/**
+ * This function produces count (K3*,V3*) pairs, as count calls to emit3 would, locking the output vector once.
+ * @param pairs: The output pairs.
+ * @param count: The number of pairs.
+ * @param context: The context of the calling thread.
+ */
+void emit3Batch(const OutputPair *pairs, size_t count, void *context) {
+    auto *tc = (ThreadContext *) context;
+    OutputVec *output = tc->_localOutput;
+    JobContext *jc = nullptr;
+    if (output == nullptr)
+    {
+        jc = jobs[tc->_jid];
+        output = jc->_outputVec;
+        lock(&jc->_outputMutex);
+    }
+
+    try{
+        output->insert(output->end(), pairs, pairs + count);
+    }
+    catch (std::bad_alloc &e)
+    {
+        std::cerr << "system error: couldn't to the output vector." << std::endl;
+        exit(1);
+    }
+
+    if (jc != nullptr)
+    {
+        unlock(&jc->_outputMutex);
+    }
+}
+
+/**
+ * This function waits, in a map call, until a file descriptor is ready. With mapTasks the thread maps other
+ * elements meanwhile.
+ * @param fd: The descriptor.
+ * @param events: The epoll events to wait for.
+ * @param context: The context of the calling thread.
+ * @return The events the descriptor is ready for, or -1 if it can't be waited for.
+ */
+int awaitFd(int fd, uint32_t events, void *context) {
+    auto *tc = (ThreadContext *) context;
+    if (tc->_loop != nullptr)
+    {
+        return tc->_loop->wait(fd, events);
+    }
+    // The epoll events that can be waited for are the same bits as the poll ones:
+    pollfd request = {fd, (short)events, 0};
+    int ready;
+    while ((ready = poll(&request, 1, -1)) < 0 && errno == EINTR)
+    {
+    }
+    return ready < 0 || (request.revents & POLLNVAL) ? -1 : (int)request.revents;
+}
+
+/**
+ * @return The sketches of a key in the calling thread's table, which keeps the key or deletes it.
+ */
+static SketchValue* findSketch(K2 *key, void *context)
+{
+    auto *tc = (ThreadContext *) context;
+    try
+    {
+        if (tc->_sketches == nullptr)
+        {
+            tc->_sketches = new SketchTable();
+        }
+        return tc->_sketches->find(key);
+    }
+    catch (std::bad_alloc &e)
+    {
+        std::cerr << "system error: couldn't allocate a sketch." << std::endl;
+        exit(1);
+    }
+}
+
+/**
+ * This function adds an item to the distinct items sketch of a key, in a map call.
+ * @param key: The key, owned by the framework from now on.
+ * @param item: The item, or a hash of it.
+ * @param context: The context of the calling thread.
+ */
+void sketchDistinct(K2 *key, uint64_t item, void *context) {
+    SketchValue *sketch = findSketch(key, context);
+    if (sketch->distinct == nullptr)
+    {
+        sketch->distinct = new HyperLogLog();
+    }
+    sketch->distinct->add(item);
+}
+
+/**
+ * This function adds occurrences of an item to the frequent items sketch of a key, in a map call.
+ * @param key: The key, owned by the framework from now on.
+ * @param item: The item, or a hash of it.
+ * @param count: The number of occurrences.
+ * @param context: The context of the calling thread.
+ */
+void sketchFrequency(K2 *key, uint64_t item, uint64_t count, void *context) {
+    SketchValue *sketch = findSketch(key, context);
+    if (sketch->frequent == nullptr)
+    {
+        sketch->frequent = new CountMinSketch();
+    }
+    sketch->frequent->add(item, count);
+}
+
+/**
+ * This function adds a value to the quantiles sketch of a key, in a map call.
+ * @param key: The key, owned by the framework from now on.
+ * @param value: The value.
+ * @param context: The context of the calling thread.
+ */
+void sketchQuantile(K2 *key, double value, void *context) {
+    SketchValue *sketch = findSketch(key, context);
+    if (sketch->quantiles == nullptr)
+    {
+        sketch->quantiles = new KllSketch();
+    }
+    sketch->quantiles->add(value);
+}
+
+/**
+ * This function gets the side input of the job a map or reduce call belongs to.
+ * @param context: The context of the calling thread.
+ * @return The job's side input, nullptr if it has none.
+ */
+const SideInput* getSideInput(void *context) {
+    auto *tc = (ThreadContext *) context;
+    return jobs[tc->_jid]->_config.sideInput;
+}
+
 void waitForJob(JobHandle job) {
     auto *jc = (JobContext *) job;
 
@@ -472,13 +1654,47 @@ void waitForJob(JobHandle job) {
     // If we called wait once (hence the job is done: don't wait)
     if(!jc->_inputVec->empty() && !jc->_doneJob){
         jc->_doneJob = true;
+
+        // A job waiting for memory has no threads yet:
+        lock(&jc->_stateMutex);
+        // Neither has a job whose output is complete but a thread of which still maps an abandoned chunk:
+        while (!jc->_started || jc->_pendingThreads > 0)
+        {
+            if (pthread_cond_wait(&jc->_threadsCv, &jc->_stateMutex) != 0)
+            {
+                std::cerr << "error on pthread_cond_wait" << std::endl;
+                exit(1);
+            }
+        }
+        unlock(&jc->_stateMutex);
         for (int i = 0; i < jc->_numOfWorkers; ++i) {
+            if (jc->_contexts[i]->_abandoned)
+            {
+                continue;
+            }
             if(pthread_join(jc->_contexts[i]->_thread, nullptr)){
                 std::cerr << "Error using pthread_join." << i << std::endl;
                 exit(1);
             }
         }
     }
+
+    // An incremental job's output is complete once the new input's output is merged into the state:
+    if (jc->_state != nullptr && !jc->_merged)
+    {
+        jc->_merged = true;
+        jc->_state->merge(*jc->_deltaOutput, *jc->_incrementalClient, jc->_deltaInput->size());
+        try
+        {
+            jc->_finalOutput->insert(jc->_finalOutput->end(), jc->_state->pairs().begin(),
+                                     jc->_state->pairs().end());
+        }
+        catch (std::bad_alloc &e)
+        {
+            std::cerr << "system error: couldn't output the incremental state." << std::endl;
+            exit(1);
+        }
+    }
 }
 
 /**
@@ -492,8 +1708,20 @@ void getJobState(JobHandle job, JobState *state) {
         lock(&jc->_stateMutex);
 
         //critical code:
-        state->percentage = (float)(jc->_numOfProcessedElements * (100.0 / jc->_numOfElements));
+        unsigned long processed = jc->_numOfProcessedElements;
+        unsigned long total = jc->_numOfElements;
         state->stage = jc->_stage;
+        if (jc->_stage == MAP_STAGE && jc->_processMapper != nullptr)
+        {
+            processed = jc->_processMapper->progress();
+        }
+        if (jc->_cluster != nullptr)
+        {
+            state->stage = jc->_cluster->reducing() ? REDUCE_STAGE : MAP_STAGE;
+            processed = jc->_cluster->reducing() ? jc->_cluster->reducedPairs() : jc->_cluster->mappedElements();
+            total = jc->_cluster->reducing() ? jc->_cluster->totalPairs() : jc->_inputVec->size();
+        }
+        state->percentage = total == 0 ? 100 : (float)(processed * (100.0 / total));
 
         unlock(&jc->_stateMutex);
     }
@@ -511,6 +1739,37 @@ void getJobState(JobHandle job, JobState *state) {
 
 }
 
+/**
+ * this function gets a job handle and fills its counters in a given JobStats struct.
+ * @param job: A pointer to the job struct.
+ * @param stats: A pointer to a stats object to be filled with the job's counters.
+ */
+void getJobStats(JobHandle job, JobStats *stats) {
+    auto *jc = (JobContext *) job;
+    *stats = JobStats();
+    stats->threads = jc->_numOfWorkers;
+    stats->mapThreads = jc->_mapThreads;
+    stats->reduceThreads = jc->_reduceThreads;
+    stats->spills = jc->_spills;
+    stats->runBytes = jc->_runBytes;
+    stats->rawRunBytes = jc->_rawRunBytes;
+    lock(&jc->_chunkMutex);
+    stats->speculativeChunks = jc->_speculativeChunks;
+    stats->discardedChunks = jc->_discardedChunks;
+    unlock(&jc->_chunkMutex);
+    // A job the governor hasn't admitted yet has no cluster:
+    lock(&jc->_stateMutex);
+    if (jc->_started && jc->_cluster != nullptr)
+    {
+        stats->networkBytes = jc->_cluster->wireBytes();
+        stats->rawNetworkBytes = jc->_cluster->rawBytes();
+        stats->networkMessages = jc->_cluster->messages();
+        stats->speculativeChunks = jc->_cluster->speculativeChunks();
+        stats->discardedChunks = jc->_cluster->discardedChunks();
+    }
+    unlock(&jc->_stateMutex);
+}
+
 /**
  * Releasing all resources of a job, after the job was done. After using this function the jobHandle will be invalid.
  * @param job: A pointer to the job's context.
@@ -519,6 +1778,14 @@ void closeJobHandle(JobHandle job) {
     auto *jc = (JobContext *) job;
     waitForJob(job);
 
+    // Abandoned threads may still map, with the client and the input:
+    for (int i = 0; i < jc->_numOfWorkers && !jc->_inputVec->empty(); ++i) {
+        if (jc->_contexts[i]->_abandoned && pthread_join(jc->_contexts[i]->_thread, nullptr)) {
+            std::cerr << "Error using pthread_join." << i << std::endl;
+            exit(1);
+        }
+    }
+
     for(int i = 0; i < jc->_numOfWorkers ; ++i){
         delete(jc->_contexts[i]);
     }
@@ -536,11 +1803,95 @@ void closeJobHandle(JobHandle job) {
 JobHandle startMapReduceJob(const MapReduceClient &client,
                             const InputVec &inputVec, OutputVec &outputVec,
                             int multiThreadLevel) {
+    return startMapReduceJob(client, inputVec, outputVec, multiThreadLevel, JobConfig());
+}
+
+/**
+ * This function creates a new job with the given settings, and starts running the MapReduce algorithm for it.
+ * @param client:  a map-reduce client.
+ * @param inputVec: A vector containing the input values.
+ * @param outputVec: A vector into which we insert the result of the map-reduce process.
+ * @param multiThreadLevel: The number of threads to participate in the map-reduce process.
+ * @param config: The job's optional settings.
+ * @param resume: true to keep the checkpoints of a previous run of the job.
+ * @return A job handler which is a pointer to the new job's context.
+ */
+static JobHandle startJob(const MapReduceClient &client,
+                          const InputVec &inputVec, OutputVec &outputVec,
+                          int multiThreadLevel, const JobConfig &config, bool resume) {
 
     assert(multiThreadLevel >= 0);
+    if (config.mapProcesses > 0 && config.serializer == nullptr)
+    {
+        std::cerr << "MapReduce error: map processes require an intermediate serializer." << std::endl;
+        exit(1);
+    }
+    if (config.nodes > 0 && (config.serializer == nullptr || config.outputSerializer == nullptr ||
+                             config.mapProcesses > 0))
+    {
+        std::cerr << "MapReduce error: nodes require both serializers, and can't be mixed with map processes."
+                  << std::endl;
+        exit(1);
+    }
+    if (config.runCompression != RUN_PLAIN && (config.serializer == nullptr || config.nodes > 0))
+    {
+        std::cerr << "MapReduce error: compressed runs require an intermediate serializer, and can't be mixed "
+                     "with nodes." << std::endl;
+        exit(1);
+    }
+    if (config.mapTasks > 1 && (config.mapProcesses > 0 || config.nodes > 0 || config.checkpointDir != nullptr ||
+                                config.speculativeMap))
+    {
+        std::cerr << "MapReduce error: map tasks can't be mixed with map processes, nodes, checkpoints or "
+                     "speculative map." << std::endl;
+        exit(1);
+    }
+    if (config.outputDir != nullptr && (config.outputSerializer == nullptr || config.nodes > 0 ||
+                                        config.checkpointDir != nullptr))
+    {
+        std::cerr << "MapReduce error: an output directory requires an output serializer, and can't be mixed with "
+                     "nodes or checkpoints." << std::endl;
+        exit(1);
+    }
+    if (config.hugePages < HUGE_PAGES_OFF || config.hugePages > HUGE_PAGES_HUGETLB)
+    {
+        std::cerr << "MapReduce error: unknown huge pages mode " << config.hugePages << "." << std::endl;
+        exit(1);
+    }
+    if (config.sideInput != nullptr && !config.sideInput->frozen())
+    {
+        std::cerr << "MapReduce error: a side input should be frozen before the job starts." << std::endl;
+        exit(1);
+    }
+    if (config.speculativeMap && (config.mapProcesses > 0 || config.nodes > 0 || config.checkpointDir != nullptr ||
+                                  config.runCompression != RUN_PLAIN))
+    {
+        std::cerr << "MapReduce error: speculative map can't be mixed with map processes, nodes, checkpoints or "
+                     "compressed runs." << std::endl;
+        exit(1);
+    }
+    if (config.checkpointDir != nullptr && (config.serializer == nullptr || config.outputSerializer == nullptr ||
+                                            config.mapProcesses > 0 || config.nodes > 0))
+    {
+        std::cerr << "MapReduce error: checkpoints require both serializers, and can't be mixed with map processes "
+                     "or nodes." << std::endl;
+        exit(1);
+    }
+    if (config.nodes > 0)
+    {
+        multiThreadLevel = 1; // the single coordinating thread.
+    }
+    else if (config.autoThreads)
+    {
+        // No stage can use more threads than there are cores or input elements:
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        long cap = multiThreadLevel > 0 ? multiThreadLevel : cores;
+        multiThreadLevel = (int)std::max(1L, std::min(std::min(cap, cores), (long)inputVec.size()));
+    }
 
     //Initialize The JobContext:
-    auto * jc = new JobContext((int)jobs.size(), &client, &inputVec, &outputVec, multiThreadLevel);
+    auto * jc = new JobContext((int)jobs.size(), &client, &inputVec, &outputVec, multiThreadLevel, config);
+    jc->_shufflingThread = shufflingThread;
 
     //Add the new job to the job's vector:
     lock(&jobsMutex);
@@ -556,10 +1907,124 @@ JobHandle startMapReduceJob(const MapReduceClient &client,
     }
     unlock(&jobsMutex);
 
+    if (config.checkpointDir != nullptr)
+    {
+        // The checkpoints are only valid for the same input and chunking. The input is opaque, so it's told apart
+        // by its size and the caller's name for it:
+        jc->_chunkSize = std::max(1UL, (inputVec.size() + CHECKPOINT_CHUNKS - 1) / CHECKPOINT_CHUNKS);
+        jc->_checkpoint = new CheckpointStore(config.checkpointDir);
+        std::string id = config.checkpointId != nullptr ? config.checkpointId : "";
+        jc->_checkpoint->open("id " + std::to_string(id.size()) + " " + id + "\nelements " +
+                              std::to_string(inputVec.size()) + "\nchunk " + std::to_string(jc->_chunkSize) +
+                              "\npartition " + std::to_string(CHECKPOINT_PARTITION_PAIRS) + "\n", resume);
+    }
+
+    if (config.speculativeMap)
+    {
+        unsigned long chunks = (unsigned long)multiThreadLevel * MAP_CHUNKS_PER_THREAD;
+        unsigned long chunkSize = std::max(1UL, (inputVec.size() + chunks - 1) / chunks);
+        for (unsigned long begin = 0; begin < inputVec.size(); begin += chunkSize)
+        {
+            jc->_mapChunks.push_back({begin, std::min(begin + chunkSize, inputVec.size()), false, 0, 0});
+        }
+    }
+
     if(!inputVec.empty()){
-        initThreads(jc);
+        setBudget(jc);
+        MemoryGovernor::instance().admit(jc->_budget, startAdmitted, jc);
+    }
+
+    return jc;
+}
+
+/**
+ * This function creates a new job with the given settings, and starts running the MapReduce algorithm for it.
+ * @param client:  a map-reduce client.
+ * @param inputVec: A vector containing the input values.
+ * @param outputVec: A vector into which we insert the result of the map-reduce process.
+ * @param multiThreadLevel: The number of threads to participate in the map-reduce process.
+ * @param config: The job's optional settings.
+ * @return A job handler which is a pointer to the new job's context.
+ */
+JobHandle startMapReduceJob(const MapReduceClient &client,
+                            const InputVec &inputVec, OutputVec &outputVec,
+                            int multiThreadLevel, const JobConfig &config) {
+    return startJob(client, inputVec, outputVec, multiThreadLevel, config, false);
+}
+
+/**
+ * Sets the memory all the running jobs of the process may use together, 0 for no limit.
+ * @param bytes: The limit.
+ */
+void setMapReduceMemoryLimit(size_t bytes) {
+    MemoryGovernor::instance().setLimit(bytes);
+}
+
+/**
+ * This function continues a job from its checkpoints, or starts it if there are none.
+ * @param client:  a map-reduce client.
+ * @param inputVec: A vector containing the input values, the same as the job was started with.
+ * @param outputVec: A vector into which we insert the result of the map-reduce process.
+ * @param multiThreadLevel: The number of threads to participate in the map-reduce process.
+ * @param config: The job's optional settings, with the checkpoint directory of the job.
+ * @return A job handler which is a pointer to the new job's context.
+ */
+JobHandle resumeMapReduceJob(const MapReduceClient &client,
+                             const InputVec &inputVec, OutputVec &outputVec,
+                             int multiThreadLevel, const JobConfig &config) {
+    if (config.checkpointDir == nullptr)
+    {
+        std::cerr << "MapReduce error: resuming a job requires its checkpoint directory." << std::endl;
+        exit(1);
+    }
+    return startJob(client, inputVec, outputVec, multiThreadLevel, config, true);
+}
+
+/**
+ * This function creates a job that maps only the input elements appended since the state's previous runs, and
+ * merges their output into the state.
+ * @param client:  a map-reduce client whose reduce is associative and commutative.
+ * @param inputVec: A vector containing the input values, those of the previous runs followed by the new ones.
+ * @param outputVec: A vector into which we insert the whole merged output, owned by the state.
+ * @param multiThreadLevel: The number of threads to participate in the map-reduce process.
+ * @param state: The state of the previous runs, empty for a first run.
+ * @param config: The job's optional settings.
+ * @return A job handler which is a pointer to the new job's context.
+ */
+JobHandle startIncrementalJob(const IncrementalClient &client,
+                              const InputVec &inputVec, OutputVec &outputVec,
+                              int multiThreadLevel, IncrementalState &state, const JobConfig &config) {
+    if (config.outputDir != nullptr)
+    {
+        std::cerr << "MapReduce error: an incremental job's output is merged in memory, not written to files."
+                  << std::endl;
+        exit(1);
+    }
+    if (inputVec.size() < state.processedElements())
+    {
+        std::cerr << "MapReduce error: an incremental job's input can only grow." << std::endl;
+        exit(1);
+    }
+    InputVec* deltaInput = nullptr;
+    OutputVec* deltaOutput = nullptr;
+    try
+    {
+        deltaInput = new InputVec(inputVec.begin() + state.processedElements(), inputVec.end());
+        deltaOutput = new OutputVec();
+    }
+    catch (std::bad_alloc &e)
+    {
+        std::cerr << "system error: couldn't start the incremental job." << std::endl;
+        exit(1);
     }
 
+    // The state is only touched once the job is waited for, so it can be set after the threads start:
+    auto *jc = (JobContext *) startJob(client, *deltaInput, *deltaOutput, multiThreadLevel, config, false);
+    jc->_state = &state;
+    jc->_incrementalClient = &client;
+    jc->_deltaInput = deltaInput;
+    jc->_deltaOutput = deltaOutput;
+    jc->_finalOutput = &outputVec;
     return jc;
 }
 
@@ -2,6 +2,11 @@
 #define MAPREDUCEFRAMEWORK_H
 
 #include "MapReduceClient.h"
+#include "MapReduceSerializer.h"
+#include "SideInput.h"
+#include "IncrementalState.h"
+#include <cstddef>
+#include <cstdint>
 
 typedef void* JobHandle;
 
@@ -12,15 +17,171 @@ typedef struct {
     float percentage;
 } JobState;
 
+/**
+ * Optional settings of a job. A default constructed config runs the whole job in the threads of this process.
+ */
+struct JobConfig {
+    // the number of forked processes doing the map stage, 0 maps in the job's threads.
+    // a crash in the client's map kills only its process, whose slice is then mapped again.
+    int mapProcesses;
+
+    // encodes the intermediate pairs leaving the map processes, required when mapProcesses > 0.
+    // the pairs handed to reduce are built by it, the pairs emitted by map stay in the map processes.
+    const IntermediateSerializer* serializer;
+
+    // the number of local node processes the job runs on, 0 runs it in the job's threads.
+    // the nodes map chunks of the input, exchange the intermediate pairs partitioned by key over unix
+    // sockets and reduce the partitions, the job's process only coordinates them with a single thread.
+    // requires serializer and outputSerializer, the pairs emitted by map and reduce stay in the nodes.
+    int nodes;
+
+    // encodes the output pairs sent back from the nodes, the pairs added to the output vector are built by it.
+    const OutputSerializer* outputSerializer;
+
+    // lets the framework choose the number of threads: multiThreadLevel only caps it (0 for no cap), and
+    // every stage uses as many of the threads as its work, the cores and the other running jobs leave room for.
+    bool autoThreads;
+
+    // a local directory to keep checkpoints of the job in, nullptr for none. the sorted results of every chunk of
+    // the input and the output of every reduce partition are written there once complete, so a job that was killed
+    // can continue with resumeMapReduceJob. requires serializer and outputSerializer, can't be mixed with
+    // mapProcesses or nodes. the job's map and reduce should be deterministic for the checkpoints to be reused.
+    const char* checkpointDir;
+
+    // names the input and the client of a job with checkpointDir, nullptr for none. the framework can't look into
+    // the input, so the checkpoints are only told apart by this name and the input's size: a job resumed with
+    // another name fails, but one resumed under the same name with a different input of the same size would merge
+    // the old checkpoints into its output. a name that changes with the input, such as a hash of the files it was
+    // read from, rules that out.
+    const char* checkpointId;
+
+    // keeps the sorted results of the map stage encoded in memory until the shuffle reaches them (see
+    // CompressedRun.h): 0 keeps the pairs as they are, 1 prefix compresses the keys, 2 also compresses with the
+    // LZ codec, saving more memory for more CPU. requires serializer. the pairs emitted by map are deleted once
+    // encoded, and the pairs handed to reduce are built by the serializer.
+    int runCompression;
+
+    // the memory, in bytes, the job's intermediate pairs may take, 0 to have it estimated from the input's size.
+    // the job waits to start while its budget doesn't fit in the limit of setMapReduceMemoryLimit. a job with a
+    // budget, or under a limit, keeps to it by holding the shuffle back while the reducers fall behind, and, if it
+    // has runCompression, by encoding its map results more often.
+    size_t memoryBudget;
+
+    // declares that the client's map has no side effects, so the framework may map an element more than once.
+    // the input is mapped in chunks, and a chunk that runs far longer than the median chunk is mapped again by an
+    // idle thread. the first copy to finish is kept and the pairs of the other are deleted. the job goes on
+    // without waiting for the losing copy: waitForJob returns once the output is complete, and only
+    // closeJobHandle waits for the losing copy to return. can't be mixed with mapProcesses, nodes,
+    // checkpointDir or runCompression.
+    bool speculativeMap;
+
+    // a frozen table every map and reduce call of the job can read, with getSideInput, nullptr for none.
+    // it is only read, never copied, so it should stay alive and unchanged until the job's handle is closed.
+    const SideInput* sideInput;
+
+    // backs the map results of the job's threads, which are sorted and merged, with 2MB pages to spare TLB
+    // misses (see HugePageAllocator.h): 0 uses the heap, 1 transparent huge pages, 2 the hugetlbfs pool, falling
+    // back to transparent huge pages when the pool is empty. the pairs handed to reduce stay on the heap.
+    int hugePages;
+
+    // the number of map calls every thread keeps in flight, each on its own stack, for a map that waits on file
+    // descriptors with awaitFd (see MapTaskLoop.h). 0 or 1 maps an element at a time. the calls of a thread
+    // only switch inside awaitFd, so they needn't lock anything against each other, but shouldn't throw.
+    // every call runs on a stack of 256KB, with a guard page below it: a map that recurses deeper crashes.
+    // can't be mixed with mapProcesses, nodes, checkpointDir or speculativeMap.
+    int mapTasks;
+
+    // writes the output to files in this directory, which should exist, instead of to the output vector:
+    // part-00000 to part-N, one per partition, each sorted by key and written by the thread that reduced it (see
+    // OutputFile.h). the partitions are disjoint ranges of the intermediate keys, in order, so the files follow
+    // each other in key order as well if reduce emits keys that sort as the intermediate keys do.
+    // requires outputSerializer, can't be mixed with nodes or checkpointDir.
+    const char* outputDir;
+
+    // the number of output files with outputDir, 0 for one per thread.
+    int outputPartitions;
+
+    JobConfig() : mapProcesses(0), serializer(nullptr), nodes(0), outputSerializer(nullptr), autoThreads(false),
+                  checkpointDir(nullptr), checkpointId(nullptr), runCompression(0), memoryBudget(0), speculativeMap(false),
+                  sideInput(nullptr), hugePages(0),
+                  mapTasks(0), outputDir(nullptr), outputPartitions(0) {}
+};
+
+/**
+ * Counters of a job, for benchmarking it.
+ */
+typedef struct {
+    unsigned long networkBytes;      // bytes sent between the nodes, as they were sent.
+    unsigned long rawNetworkBytes;   // the same bytes before compression.
+    unsigned long networkMessages;
+    unsigned long speculativeChunks; // chunks of input handed to a second worker since the first one straggled.
+    unsigned long discardedChunks;   // results of chunks thrown away since another worker had finished them first.
+    int threads;                     // the number of threads the job had created.
+    int mapThreads;                  // the number of them that took part in the map stage.
+    int reduceThreads;               // the number of them that took part in the reduce stage.
+    unsigned long runBytes;          // bytes the compressed runs of the map results took.
+    unsigned long rawRunBytes;       // the same results serialized, without compression.
+    unsigned long spills;            // the times map results were encoded to keep to the budget or compression.
+} JobStats;
+
 void emit2 (K2* key, V2* value, void* context);
 void emit3 (K3* key, V3* value, void* context);
 
+// emit a span of count pairs at once, as count calls to emit2 or emit3 would, but with the framework's work done
+// once for the whole span: a single allocation for emit2Batch, and a single lock of the output for emit3Batch.
+void emit2Batch (const IntermediatePair* pairs, size_t count, void* context);
+void emit3Batch (const OutputPair* pairs, size_t count, void* context);
+
+// waits until a file descriptor is ready for the given epoll events (EPOLLIN, EPOLLOUT...), given a map call's
+// context, and returns the events it is ready for, or -1 if it can't be waited for, like a regular file.
+// with config.mapTasks, the thread runs its other map calls meanwhile.
+int awaitFd (int fd, uint32_t events, void* context);
+
+// feed items to the sketches of a key, in a map call, instead of emitting a pair per item (see Sketches.h).
+// the thread keeps a single sketch per key, emitted as a (key, SketchValue) pair once it's done mapping, so the
+// key is owned by the framework, which deletes it if the thread has it already. items that aren't integers can
+// be fed by their sketchHash. a job whose pairs are serialized should have a serializer for SketchValue as well.
+void sketchDistinct (K2* key, uint64_t item, void* context);
+void sketchFrequency (K2* key, uint64_t item, uint64_t count, void* context);
+void sketchQuantile (K2* key, double value, void* context);
+
+// the side input of the job a map or reduce call belongs to, given the call's context, nullptr if it has none.
+const SideInput* getSideInput (void* context);
+
 JobHandle startMapReduceJob(const MapReduceClient& client,
                             const InputVec& inputVec, OutputVec& outputVec,
                             int multiThreadLevel);
 
+JobHandle startMapReduceJob(const MapReduceClient& client,
+                            const InputVec& inputVec, OutputVec& outputVec,
+                            int multiThreadLevel, const JobConfig& config);
+
+// continues a job that was started with the same input, config.checkpointDir and config.checkpointId, skipping the
+// chunks of the input and the reduce partitions its checkpoints cover. only the size of the input and the
+// checkpointId are checked against the checkpoints, so the input should be the one they were made of. the output of the skipped partitions is built by
+// config.outputSerializer. starts the job from scratch if the directory has no checkpoints.
+JobHandle resumeMapReduceJob(const MapReduceClient& client,
+                             const InputVec& inputVec, OutputVec& outputVec,
+                             int multiThreadLevel, const JobConfig& config);
+
+// runs a job over only the input elements appended since the previous runs of the state (see IncrementalState.h),
+// and merges their output into it. the input elements of the previous runs should come first, unchanged.
+// once the job is waited for, outputVec gets the whole merged output, sorted by key; its pairs are owned by the
+// state, and stay valid until the state's next run or destruction, so they shouldn't be deleted by the caller.
+// the state should outlive the job's handle, and take part in a single job at a time.
+JobHandle startIncrementalJob(const IncrementalClient& client,
+                              const InputVec& inputVec, OutputVec& outputVec,
+                              int multiThreadLevel, IncrementalState& state, const JobConfig& config);
+
+// limits the memory of all the jobs running in the process together, 0 (the default) for no limit.
+// a job whose budget doesn't fit waits, in order of submission, for the running jobs to finish.
+// the limit doesn't change who owns the pairs of a job: only a job with runCompression has the pairs emitted by
+// map deleted once encoded, the pairs of the others are kept as emitted, as without a limit.
+void setMapReduceMemoryLimit(size_t bytes);
+
 void waitForJob(JobHandle job);
 void getJobState(JobHandle job, JobState* state);
+void getJobStats(JobHandle job, JobStats* stats);
 void closeJobHandle(JobHandle job);
 
 
@@ -0,0 +1,42 @@
+#ifndef MAPREDUCESERIALIZER_H
+#define MAPREDUCESERIALIZER_H
+
+#include <string>   //std::string
+#include <cstddef>  //size_t
+#include "MapReduceClient.h"
+
+// intermediate key and value serializer.
+// used by the job modes in which intermediate pairs leave the address space they were emitted in.
+// equal keys are expected to be written as equal bytes.
+class IntermediateSerializer {
+public:
+    virtual ~IntermediateSerializer() {}
+
+    // appends the encoding of key (value) to out.
+    virtual void writeKey(const K2* key, std::string& out) const = 0;
+    virtual void writeValue(const V2* value, std::string& out) const = 0;
+
+    // builds a new key (value) out of the size bytes at data, as written by writeKey (writeValue).
+    // data points straight into the framework's buffers and is valid only during the call.
+    virtual K2* readKey(const char* data, size_t size) const = 0;
+    virtual V2* readValue(const char* data, size_t size) const = 0;
+};
+
+// output key and value serializer.
+// used by the job modes in which output pairs are produced outside of the job's process.
+class OutputSerializer {
+public:
+    virtual ~OutputSerializer() {}
+
+    // appends the encoding of key (value) to out.
+    virtual void writeKey(const K3* key, std::string& out) const = 0;
+    virtual void writeValue(const V3* value, std::string& out) const = 0;
+
+    // builds a new key (value) out of the size bytes at data, as written by writeKey (writeValue).
+    // data is valid only during the call.
+    virtual K3* readKey(const char* data, size_t size) const = 0;
+    virtual V3* readValue(const char* data, size_t size) const = 0;
+};
+
+
+#endif //MAPREDUCESERIALIZER_H
@@ -0,0 +1,136 @@
+#include "MapTaskLoop.h"
+#include <iostream>
+#include <cstdlib>
+#include <cerrno>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/** the number of ready descriptors taken from epoll at once. */
+static const int MAX_EVENTS = 64;
+
+MapTaskLoop::MapTaskLoop(int numTasks, size_t stackSize)
+        : _pageSize((size_t)sysconf(_SC_PAGESIZE)), _stackSize((stackSize + _pageSize - 1) / _pageSize * _pageSize),
+          _tasks(numTasks), _running(-1), _waiting(0), _step(nullptr), _arg(nullptr)
+{
+    _epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (_epoll < 0)
+    {
+        std::cerr << "system error: epoll_create1 failed." << std::endl;
+        exit(1);
+    }
+    // Every stack is mapped with a guard page below it, so a task that overflows its stack faults instead of
+    // writing over the memory below:
+    for (Task& task : _tasks)
+    {
+        void* mapping = mmap(nullptr, _pageSize + _stackSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                             -1, 0);
+        if (mapping == MAP_FAILED || mprotect(mapping, _pageSize, PROT_NONE) != 0)
+        {
+            std::cerr << "system error: couldn't map the stack of a map task." << std::endl;
+            exit(1);
+        }
+        task.stack = static_cast<char*>(mapping) + _pageSize;
+        task.done = false;
+        task.events = 0;
+    }
+}
+
+MapTaskLoop::~MapTaskLoop()
+{
+    for (Task& task : _tasks)
+    {
+        munmap(task.stack - _pageSize, _pageSize + _stackSize);
+    }
+    close(_epoll);
+}
+
+void MapTaskLoop::taskMain(unsigned int loopHigh, unsigned int loopLow)
+{
+    auto* loop = reinterpret_cast<MapTaskLoop*>(((uintptr_t)loopHigh << 32) | (uintptr_t)loopLow);
+    while (loop->_step(loop->_arg))
+    {
+    }
+    loop->_tasks[loop->_running].done = true;
+    // Returns to the loop through uc_link.
+}
+
+void MapTaskLoop::run(TaskStep step, void* arg)
+{
+    _step = step;
+    _arg = arg;
+    auto address = reinterpret_cast<uintptr_t>(this);
+    for (size_t i = 0; i < _tasks.size(); ++i)
+    {
+        Task& task = _tasks[i];
+        if (getcontext(&task.context) != 0)
+        {
+            std::cerr << "system error: getcontext failed." << std::endl;
+            exit(1);
+        }
+        task.context.uc_stack.ss_sp = task.stack;
+        task.context.uc_stack.ss_size = _stackSize;
+        task.context.uc_link = &_loopContext;
+        task.done = false;
+        makecontext(&task.context, (void (*)())taskMain, 2, (unsigned int)(address >> 32),
+                    (unsigned int)(address & 0xffffffffu));
+        _ready.push_back((int)i);
+    }
+
+    epoll_event events[MAX_EVENTS];
+    while (!_ready.empty() || _waiting > 0)
+    {
+        while (!_ready.empty())
+        {
+            _running = _ready.front();
+            _ready.pop_front();
+            if (swapcontext(&_loopContext, &_tasks[_running].context) != 0)
+            {
+                std::cerr << "system error: swapcontext failed." << std::endl;
+                exit(1);
+            }
+            _running = -1;
+        }
+        if (_waiting == 0)
+        {
+            break;
+        }
+        int ready = epoll_wait(_epoll, events, MAX_EVENTS, -1);
+        if (ready < 0 && errno != EINTR)
+        {
+            std::cerr << "system error: epoll_wait failed." << std::endl;
+            exit(1);
+        }
+        for (int i = 0; i < ready; ++i)
+        {
+            auto id = (int)events[i].data.u32;
+            _tasks[id].events = events[i].events;
+            _ready.push_back(id);
+        }
+    }
+}
+
+int MapTaskLoop::wait(int fd, uint32_t events)
+{
+    int id = _running;
+    if (id < 0)
+    {
+        return -1;
+    }
+    epoll_event event = epoll_event();
+    event.events = events;
+    event.data.u32 = (uint32_t)id;
+    if (epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &event) != 0)
+    {
+        return -1;
+    }
+    ++_waiting;
+    if (swapcontext(&_tasks[id].context, &_loopContext) != 0)
+    {
+        std::cerr << "system error: swapcontext failed." << std::endl;
+        exit(1);
+    }
+    --_waiting;
+    epoll_ctl(_epoll, EPOLL_CTL_DEL, fd, nullptr);
+    return (int)_tasks[id].events;
+}
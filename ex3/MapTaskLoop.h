@@ -0,0 +1,74 @@
+#ifndef MAPTASKLOOP_H
+#define MAPTASKLOOP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <ucontext.h>
+
+// runs a few map tasks on a single thread, for clients whose map waits on file descriptors (a socket to a cache
+// daemon, a pipe) rather than computing. every task has its own stack, and when it waits for a descriptor it
+// gives the thread to the next ready task, until the thread's epoll instance reports the descriptor ready.
+// the tasks are switched only when they wait, so they share the thread's state without locks.
+
+class MapTaskLoop {
+public:
+    /**
+     * The work of a task, called again and again until it returns false.
+     */
+    typedef bool (*TaskStep)(void* arg);
+
+    /**
+     * Creates a new loop object.
+     * @param numTasks: The number of tasks to keep in flight.
+     * @param stackSize: The stack of every task, in bytes, rounded up to whole pages. A guard page below every
+     * stack makes a task that overflows it crash rather than corrupt the heap.
+     */
+    MapTaskLoop(int numTasks, size_t stackSize);
+    ~MapTaskLoop();
+
+    /**
+     * Runs the tasks until all of them are done.
+     * @param step: The work of every task.
+     * @param arg: An argument to hand to step.
+     */
+    void run(TaskStep step, void* arg);
+
+    /**
+     * Suspends the running task until the descriptor is ready for the given epoll events. Should be called from
+     * a task of this loop. A descriptor may be waited for by a single task at a time.
+     * @return The events the descriptor is ready for, or -1 if it can't be waited for (a regular file, which is
+     * always ready, or an invalid descriptor).
+     */
+    int wait(int fd, uint32_t events);
+
+private:
+    MapTaskLoop(const MapTaskLoop&);
+    MapTaskLoop& operator=(const MapTaskLoop&);
+
+    struct Task {
+        ucontext_t context;
+        char* stack; // above a guard page, in a mapping of its own.
+        bool done;
+        uint32_t events; // the events the task was woken up for.
+    };
+
+    /**
+     * The entry of every task, whose address is split in two ints as makecontext requires.
+     */
+    static void taskMain(unsigned int loopHigh, unsigned int loopLow);
+
+    int _epoll;
+    size_t _pageSize;
+    size_t _stackSize;
+    std::vector<Task> _tasks;
+    std::deque<int> _ready;
+    int _running;  // the task running now, -1 in the loop itself.
+    int _waiting;  // the tasks waiting for descriptors.
+    TaskStep _step;
+    void* _arg;
+    ucontext_t _loopContext;
+};
+
+#endif //MAPTASKLOOP_H
@@ -0,0 +1,110 @@
+#include "MemoryGovernor.h"
+#include <iostream>
+#include <cstdlib>
+
+/**
+ * Locks the mutex, exits on failure.
+ */
+static void lockOrExit(pthread_mutex_t* mutex)
+{
+    if (pthread_mutex_lock(mutex) != 0)
+    {
+        std::cerr << "error on pthread_mutex_lock" << std::endl;
+        exit(1);
+    }
+}
+
+/**
+ * Unlocks the mutex, exits on failure.
+ */
+static void unlockOrExit(pthread_mutex_t* mutex)
+{
+    if (pthread_mutex_unlock(mutex) != 0)
+    {
+        std::cerr << "error on pthread_mutex_unlock" << std::endl;
+        exit(1);
+    }
+}
+
+MemoryGovernor::MemoryGovernor() : _mutex(PTHREAD_MUTEX_INITIALIZER), _limit(0), _reserved(0), _running(0)
+{
+}
+
+MemoryGovernor& MemoryGovernor::instance()
+{
+    static MemoryGovernor governor;
+    return governor;
+}
+
+void MemoryGovernor::setLimit(size_t bytes)
+{
+    std::deque<Waiting> admitted;
+    lockOrExit(&_mutex);
+    _limit = bytes;
+    takeAdmitted(admitted);
+    unlockOrExit(&_mutex);
+    startAll(admitted);
+}
+
+size_t MemoryGovernor::limit()
+{
+    lockOrExit(&_mutex);
+    size_t bytes = _limit;
+    unlockOrExit(&_mutex);
+    return bytes;
+}
+
+void MemoryGovernor::admit(size_t budget, JobStarter start, void* job)
+{
+    std::deque<Waiting> admitted;
+    lockOrExit(&_mutex);
+    try
+    {
+        _waiting.push_back({budget, start, job});
+    }
+    catch (std::bad_alloc &e)
+    {
+        std::cerr << "system error: couldn't queue the job." << std::endl;
+        exit(1);
+    }
+    takeAdmitted(admitted);
+    unlockOrExit(&_mutex);
+    startAll(admitted);
+}
+
+void MemoryGovernor::release(size_t budget)
+{
+    std::deque<Waiting> admitted;
+    lockOrExit(&_mutex);
+    _reserved -= budget;
+    --_running;
+    takeAdmitted(admitted);
+    unlockOrExit(&_mutex);
+    startAll(admitted);
+}
+
+void MemoryGovernor::takeAdmitted(std::deque<Waiting>& admitted)
+{
+    // Jobs are admitted in order, so a big job isn't passed over forever by small ones:
+    while (!_waiting.empty())
+    {
+        const Waiting& next = _waiting.front();
+        bool fits = _limit == 0 || _reserved + next.budget <= _limit || _running == 0;
+        if (!fits)
+        {
+            break;
+        }
+        _reserved += next.budget;
+        ++_running;
+        admitted.push_back(next);
+        _waiting.pop_front();
+    }
+}
+
+void MemoryGovernor::startAll(const std::deque<Waiting>& admitted)
+{
+    for (const Waiting& job : admitted)
+    {
+        job.start(job.job);
+    }
+}
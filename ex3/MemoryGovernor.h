@@ -0,0 +1,73 @@
+#ifndef MEMORYGOVERNOR_H
+#define MEMORYGOVERNOR_H
+
+#include <cstddef>
+#include <deque>
+#include <pthread.h>
+
+// a process wide limit on the memory of the running MapReduce jobs.
+// every job reserves its budget before it starts. a job whose budget doesn't fit in what is left of the limit
+// waits in a queue, in the order the jobs were submitted, and is started once the jobs before it released theirs.
+// a job bigger than the whole limit is started alone, so it doesn't wait forever.
+
+class MemoryGovernor {
+public:
+    /**
+     * Starts a job that was admitted.
+     */
+    typedef void (*JobStarter)(void* job);
+
+    /**
+     * @return The governor of the process.
+     */
+    static MemoryGovernor& instance();
+
+    /**
+     * Sets the limit, 0 for no limit. Jobs waiting for room that fit in the new limit are started.
+     */
+    void setLimit(size_t bytes);
+
+    /** @return The limit, 0 if there is none. */
+    size_t limit();
+
+    /**
+     * Reserves the budget of a job and starts it, or queues it until there is room for it.
+     * @param budget: The bytes the job may use.
+     * @param start: Starts the job, called without the governor's lock held, maybe by another job's thread.
+     * @param job: An argument to hand to start.
+     */
+    void admit(size_t budget, JobStarter start, void* job);
+
+    /**
+     * Releases the budget of a job that is done, and starts the jobs waiting for room that fit now.
+     */
+    void release(size_t budget);
+
+private:
+    struct Waiting {
+        size_t budget;
+        JobStarter start;
+        void* job;
+    };
+
+    MemoryGovernor();
+
+    /**
+     * Removes the jobs at the head of the queue that fit now from it, and reserves their budget.
+     * Should be called with the lock held.
+     */
+    void takeAdmitted(std::deque<Waiting>& admitted);
+
+    /**
+     * Starts the admitted jobs. Should be called without the lock held.
+     */
+    static void startAll(const std::deque<Waiting>& admitted);
+
+    pthread_mutex_t _mutex;
+    size_t _limit;
+    size_t _reserved;
+    int _running;
+    std::deque<Waiting> _waiting;
+};
+
+#endif //MEMORYGOVERNOR_H
@@ -0,0 +1,796 @@
+#include "NodeCluster.h"
+#include "IntermediateCodec.h"
+#include "LzCodec.h"
+#include <iostream>
+#include <algorithm>
+#include <map>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+/** the number of chunks the input is cut into, per node. */
+static const unsigned long CHUNKS_PER_NODE = 8;
+
+/** the number of key partitions, per node. */
+static const int PARTITIONS_PER_NODE = 2;
+
+/** runs are batched into messages of about this many bytes when partitions are sent to the reducing nodes. */
+static const size_t BATCH_BYTES = 64 * 1024;
+
+/** messages smaller than this are sent uncompressed. */
+static const size_t COMPRESS_MIN_BYTES = 512;
+
+/** a chunk straggles once it runs this many times longer than the median chunk, plus STRAGGLER_SLACK seconds. */
+static const double STRAGGLER_FACTOR = 2.0;
+static const double STRAGGLER_SLACK = 0.01;
+
+/** the coordinator wakes up at least this often to look for stragglers. */
+static const int POLL_TIMEOUT_MS = 10;
+
+enum MessageType {
+    MSG_CHUNK = 1,     // coordinator -> node: map a chunk.
+    MSG_MAPPED = 2,    // node -> coordinator: the partitioned results of a chunk.
+    MSG_PARTITION = 3, // coordinator -> node: a batch of runs of a partition.
+    MSG_REDUCE = 4,    // coordinator -> node: all the runs of a partition were sent, reduce it.
+    MSG_OUTPUT = 5,    // node -> coordinator: the output of a partition.
+    MSG_EXIT = 6       // coordinator -> node: the job is done.
+};
+
+struct MessageHeader {
+    uint32_t type;
+    uint32_t compressed;
+    uint64_t size;
+    uint64_t rawSize;
+};
+
+//---------------------------------------------- STATIC FUNCTIONS ------------------------------------------------//
+
+/**
+ * Prints the error and exits.
+ */
+static void systemError(const std::string& msg)
+{
+    std::cerr << "System Error: " << msg << std::endl;
+    exit(1);
+}
+
+/**
+ * @return The time of a monotonic clock, in seconds.
+ */
+static double now()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * FNV-1a, over the encoding of a key.
+ */
+static uint64_t hashBytes(const std::string& bytes)
+{
+    uint64_t h = 14695981039346656037ull;
+    for (unsigned char c : bytes)
+    {
+        h = (h ^ c) * 1099511628211ull;
+    }
+    return h;
+}
+
+template <typename T>
+static void putInt(std::string& out, T value)
+{
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+static bool getInt(const std::string& in, size_t& pos, T& value)
+{
+    if (in.size() - pos < sizeof(T))
+    {
+        return false;
+    }
+    memcpy(&value, in.data() + pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+}
+
+/**
+ * Reads a length prefixed blob at pos into blob.
+ */
+static bool getBlob(const std::string& in, size_t& pos, std::string& blob)
+{
+    uint64_t len;
+    if (!getInt(in, pos, len) || in.size() - pos < len)
+    {
+        return false;
+    }
+    blob.assign(in, pos, len);
+    pos += len;
+    return true;
+}
+
+static bool sendAll(int fd, const char* data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+static bool recvAll(int fd, char* data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t got = recv(fd, data, size, 0);
+        if (got <= 0)
+        {
+            if (got < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        data += got;
+        size -= got;
+    }
+    return true;
+}
+
+/**
+ * Sends a message, compressing its payload if it is worth it.
+ * @param wire: if not null, the bytes the message took on the socket are added to it.
+ * @param raw: if not null, the bytes the message would take uncompressed are added to it.
+ * @return false if the other side is gone.
+ */
+static bool sendMessage(int fd, unsigned int type, const std::string& payload,
+                        std::atomic<unsigned long>* wire, std::atomic<unsigned long>* raw)
+{
+    MessageHeader header = {type, 0, payload.size(), payload.size()};
+    const std::string* body = &payload;
+    std::string compressed;
+    if (payload.size() >= COMPRESS_MIN_BYTES)
+    {
+        lzCompress(payload.data(), payload.size(), compressed);
+        if (compressed.size() < payload.size())
+        {
+            header.compressed = 1;
+            header.size = compressed.size();
+            body = &compressed;
+        }
+    }
+    if (wire != nullptr)
+    {
+        *wire += sizeof(header) + header.size;
+        *raw += sizeof(header) + header.rawSize;
+    }
+    return sendAll(fd, (const char*)&header, sizeof(header)) && sendAll(fd, body->data(), body->size());
+}
+
+/**
+ * Receives a message, see sendMessage.
+ * @return false if the other side is gone or the message is malformed.
+ */
+static bool recvMessage(int fd, unsigned int& type, std::string& payload,
+                        std::atomic<unsigned long>* wire, std::atomic<unsigned long>* raw)
+{
+    MessageHeader header;
+    if (!recvAll(fd, (char*)&header, sizeof(header)))
+    {
+        return false;
+    }
+    std::string body(header.size, '\0');
+    if (!recvAll(fd, &body[0], body.size()))
+    {
+        return false;
+    }
+    type = header.type;
+    payload.clear();
+    if (header.compressed)
+    {
+        if (!lzDecompress(body.data(), body.size(), header.rawSize, payload))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        payload.swap(body);
+    }
+    if (wire != nullptr)
+    {
+        *wire += sizeof(header) + header.size;
+        *raw += sizeof(header) + header.rawSize;
+    }
+    return true;
+}
+
+//----------------------------------------------- CONSTRUCTION ------------------------------------------------//
+
+NodeCluster::NodeCluster(int numNodes, unsigned long numElements, const IntermediateSerializer* serializer,
+                         const OutputSerializer* outputSerializer, RangeMapper mapRange, GroupReducer reduceGroup,
+                         void* arg)
+        : _numNodes(numNodes), _numPartitions(numNodes * PARTITIONS_PER_NODE), _numElements(numElements),
+          _serializer(serializer), _outputSerializer(outputSerializer), _mapRange(mapRange),
+          _reduceGroup(reduceGroup), _arg(arg), _nodes(numNodes), _doneChunks(0), _partitions(_numPartitions),
+          _donePartitions(0), _reducing(false), _mappedElements(0), _reducedPairs(0), _totalPairs(0),
+          _wireBytes(0), _rawBytes(0), _messages(0), _speculativeChunks(0), _discardedChunks(0)
+{
+    unsigned long numChunks = std::min(numElements, (unsigned long)numNodes * CHUNKS_PER_NODE);
+    for (unsigned long i = 0; i < numChunks; ++i)
+    {
+        Chunk chunk = {numElements * i / numChunks, numElements * (i + 1) / numChunks, false, 0, 0};
+        _chunks.push_back(chunk);
+        _pendingChunks.push_back((int)i);
+    }
+    for (Partition& partition : _partitions)
+    {
+        partition.pairs = 0;
+        partition.done = false;
+    }
+}
+
+NodeCluster::~NodeCluster()
+{
+    for (Node& node : _nodes)
+    {
+        if (node.alive)
+        {
+            close(node.fd);
+        }
+    }
+}
+
+void NodeCluster::start()
+{
+    std::vector<int> childEnds(_numNodes);
+    for (int i = 0; i < _numNodes; ++i)
+    {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv))
+        {
+            systemError("socketpair had failed.");
+        }
+        _nodes[i].fd = sv[0];
+        childEnds[i] = sv[1];
+    }
+    for (int i = 0; i < _numNodes; ++i)
+    {
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            systemError("fork had failed.");
+        }
+        if (pid == 0)
+        {
+            for (int j = 0; j < _numNodes; ++j)
+            {
+                close(_nodes[j].fd);
+                if (j != i)
+                {
+                    close(childEnds[j]);
+                }
+            }
+            nodeMain(childEnds[i]);
+        }
+        Node& node = _nodes[i];
+        node.pid = pid;
+        node.alive = true;
+        node.idle = true;
+        node.partition = -1;
+    }
+    for (int fd : childEnds)
+    {
+        close(fd);
+    }
+}
+
+//----------------------------------------------- NODE SIDE ------------------------------------------------//
+
+void NodeCluster::nodeMain(int fd)
+{
+    std::map<int, std::vector<std::string>> runs; // the runs received so far, by partition.
+    unsigned int type;
+    std::string payload;
+    while (recvMessage(fd, type, payload, nullptr, nullptr))
+    {
+        size_t pos = 0;
+        uint32_t partition;
+        switch (type)
+        {
+            case MSG_CHUNK:
+                nodeMapChunk(fd, payload);
+                break;
+            case MSG_PARTITION:
+                if (!getInt(payload, pos, partition))
+                {
+                    _exit(1);
+                }
+                while (pos < payload.size())
+                {
+                    runs[partition].push_back(std::string());
+                    if (!getBlob(payload, pos, runs[partition].back()))
+                    {
+                        _exit(1);
+                    }
+                }
+                break;
+            case MSG_REDUCE:
+                if (!getInt(payload, pos, partition))
+                {
+                    _exit(1);
+                }
+                nodeReducePartition(fd, partition, runs[partition]);
+                runs.erase(partition);
+                break;
+            default:
+                _exit(0);
+        }
+    }
+    _exit(0);
+}
+
+void NodeCluster::nodeMapChunk(int fd, const std::string& request)
+{
+    size_t pos = 0;
+    uint32_t chunkId;
+    uint64_t begin, end;
+    if (!getInt(request, pos, chunkId) || !getInt(request, pos, begin) || !getInt(request, pos, end))
+    {
+        _exit(1);
+    }
+
+    IntermediateVec pairs;
+    _mapRange(_arg, begin, end, pairs);
+
+    // Partitions the pairs by the hash of their encoded keys:
+    std::vector<IntermediateVec> parts(_numPartitions);
+    std::string keyBytes;
+    for (const IntermediatePair& pair : pairs)
+    {
+        keyBytes.clear();
+        _serializer->writeKey(pair.first, keyBytes);
+        parts[hashBytes(keyBytes) % _numPartitions].push_back(pair);
+    }
+
+    std::string reply;
+    putInt<uint32_t>(reply, chunkId);
+    std::string run;
+    for (IntermediateVec& part : parts)
+    {
+        std::sort(part.begin(), part.end(), [](const IntermediatePair& p1, const IntermediatePair& p2) {
+            return *(p1.first) < *(p2.first);
+        });
+        run.clear();
+        encodeRun(part, *_serializer, run);
+        putInt<uint64_t>(reply, part.size());
+        putInt<uint64_t>(reply, run.size());
+        reply.append(run);
+    }
+
+    // The pairs never leave the node, only their encoding does:
+    for (IntermediatePair& pair : pairs)
+    {
+        delete pair.first;
+        delete pair.second;
+    }
+    if (!sendMessage(fd, MSG_MAPPED, reply, nullptr, nullptr))
+    {
+        _exit(1);
+    }
+}
+
+void NodeCluster::nodeReducePartition(int fd, int partition, std::vector<std::string>& runs)
+{
+    IntermediateVec pairs;
+    for (const std::string& run : runs)
+    {
+        size_t sortedSize = pairs.size();
+        if (!decodeRun(run.data(), run.size(), *_serializer, pairs))
+        {
+            _exit(1);
+        }
+        std::inplace_merge(pairs.begin(), pairs.begin() + sortedSize, pairs.end(),
+                           [](const IntermediatePair& p1, const IntermediatePair& p2) {
+                               return *(p1.first) < *(p2.first);
+                           });
+    }
+    runs.clear();
+
+    OutputVec output;
+    IntermediateVec group;
+    for (size_t i = 0; i < pairs.size(); ++i)
+    {
+        group.push_back(pairs[i]);
+        if (i + 1 == pairs.size() || *(pairs[i].first) < *(pairs[i + 1].first))
+        {
+            _reduceGroup(_arg, &group, output);
+            group.clear();
+        }
+    }
+
+    std::string reply;
+    putInt<uint32_t>(reply, partition);
+    encodeOutput(output, *_outputSerializer, reply);
+    for (OutputPair& pair : output)
+    {
+        delete pair.first;
+        delete pair.second;
+    }
+    if (!sendMessage(fd, MSG_OUTPUT, reply, nullptr, nullptr))
+    {
+        _exit(1);
+    }
+}
+
+//----------------------------------------------- COORDINATOR SIDE ------------------------------------------------//
+
+bool NodeCluster::sendToNode(Node& node, unsigned int type, const std::string& payload)
+{
+    ++_messages;
+    return sendMessage(node.fd, type, payload, &_wireBytes, &_rawBytes);
+}
+
+int NodeCluster::findStraggler(double time) const
+{
+    if (_chunkTimes.empty())
+    {
+        return -1;
+    }
+    std::vector<double> times(_chunkTimes);
+    std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+    double limit = times[times.size() / 2] * STRAGGLER_FACTOR + STRAGGLER_SLACK;
+
+    int straggler = -1;
+    for (size_t i = 0; i < _chunks.size(); ++i)
+    {
+        const Chunk& chunk = _chunks[i];
+        if (!chunk.done && chunk.copies == 1 && time - chunk.started > limit &&
+            (straggler == -1 || chunk.started < _chunks[straggler].started))
+        {
+            straggler = (int)i;
+        }
+    }
+    return straggler;
+}
+
+void NodeCluster::assignChunks()
+{
+    for (Node& node : _nodes)
+    {
+        if (!node.alive || !node.idle)
+        {
+            continue;
+        }
+        int chunkId;
+        double time = now();
+        if (!_pendingChunks.empty())
+        {
+            chunkId = _pendingChunks.front();
+            _pendingChunks.pop_front();
+        }
+        else
+        {
+            chunkId = findStraggler(time);
+            if (chunkId < 0)
+            {
+                return;
+            }
+            ++_speculativeChunks;
+        }
+
+        Chunk& chunk = _chunks[chunkId];
+        if (chunk.copies++ == 0)
+        {
+            chunk.started = time;
+        }
+        node.idle = false;
+        node.chunks.insert(chunkId);
+
+        std::string request;
+        putInt<uint32_t>(request, chunkId);
+        putInt<uint64_t>(request, chunk.begin);
+        putInt<uint64_t>(request, chunk.end);
+        if (!sendToNode(node, MSG_CHUNK, request))
+        {
+            handleDeadNode(node);
+        }
+    }
+}
+
+void NodeCluster::assignPartitions()
+{
+    for (Node& node : _nodes)
+    {
+        if (!node.alive || !node.idle || _pendingPartitions.empty())
+        {
+            continue;
+        }
+        int partitionId = _pendingPartitions.front();
+        _pendingPartitions.pop_front();
+        node.idle = false;
+        node.partition = partitionId;
+
+        // Sends the runs in batches, then the order to reduce them:
+        std::string batch;
+        putInt<uint32_t>(batch, partitionId);
+        size_t emptyBatch = batch.size();
+        bool sent = true;
+        for (const std::string& run : _partitions[partitionId].runs)
+        {
+            putInt<uint64_t>(batch, run.size());
+            batch.append(run);
+            if (batch.size() >= BATCH_BYTES)
+            {
+                sent = sent && sendToNode(node, MSG_PARTITION, batch);
+                batch.resize(emptyBatch);
+            }
+        }
+        if (batch.size() > emptyBatch)
+        {
+            sent = sent && sendToNode(node, MSG_PARTITION, batch);
+        }
+        batch.resize(emptyBatch);
+        if (!sent || !sendToNode(node, MSG_REDUCE, batch))
+        {
+            handleDeadNode(node);
+        }
+    }
+}
+
+void NodeCluster::handleDeadNode(Node& node)
+{
+    if (!node.alive)
+    {
+        return;
+    }
+    std::cerr << "node " << &node - &_nodes[0] << " had died, its work is handed to the other nodes." << std::endl;
+    node.alive = false;
+    close(node.fd);
+    waitpid(node.pid, nullptr, 0);
+
+    for (int chunkId : node.chunks)
+    {
+        Chunk& chunk = _chunks[chunkId];
+        if (!chunk.done && --chunk.copies == 0)
+        {
+            _pendingChunks.push_front(chunkId);
+        }
+    }
+    node.chunks.clear();
+    if (node.partition >= 0 && !_partitions[node.partition].done)
+    {
+        _pendingPartitions.push_front(node.partition);
+    }
+    node.partition = -1;
+
+    for (const Node& other : _nodes)
+    {
+        if (other.alive)
+        {
+            return;
+        }
+    }
+    systemError("all the nodes of the cluster had died.");
+}
+
+void NodeCluster::handleMessage(Node& node, unsigned int type, const std::string& payload, OutputVec& output,
+                                pthread_mutex_t* outputMutex)
+{
+    size_t pos = 0;
+    if (type == MSG_MAPPED)
+    {
+        uint32_t chunkId;
+        if (!getInt(payload, pos, chunkId) || chunkId >= _chunks.size())
+        {
+            systemError("a node had sent a malformed message.");
+        }
+        node.chunks.erase(chunkId);
+        node.idle = true;
+        Chunk& chunk = _chunks[chunkId];
+        if (chunk.done)
+        {
+            ++_discardedChunks;
+            return;
+        }
+
+        std::vector<std::string> runs(_numPartitions);
+        std::vector<uint64_t> counts(_numPartitions);
+        for (int p = 0; p < _numPartitions; ++p)
+        {
+            if (!getInt(payload, pos, counts[p]) || !getBlob(payload, pos, runs[p]))
+            {
+                systemError("a node had sent a malformed message.");
+            }
+        }
+        for (int p = 0; p < _numPartitions; ++p)
+        {
+            if (counts[p] > 0)
+            {
+                _partitions[p].runs.push_back(std::string());
+                _partitions[p].runs.back().swap(runs[p]);
+                _partitions[p].pairs += counts[p];
+            }
+        }
+        chunk.done = true;
+        ++_doneChunks;
+        _chunkTimes.push_back(now() - chunk.started);
+        _mappedElements += chunk.end - chunk.begin;
+    }
+    else if (type == MSG_OUTPUT)
+    {
+        uint32_t partitionId;
+        OutputVec pairs;
+        if (!getInt(payload, pos, partitionId) || (int)partitionId != node.partition ||
+            !decodeOutput(payload.data() + pos, payload.size() - pos, *_outputSerializer, pairs))
+        {
+            systemError("a node had sent a malformed message.");
+        }
+        if (pthread_mutex_lock(outputMutex) != 0)
+        {
+            systemError("error on pthread_mutex_lock");
+        }
+        output.insert(output.end(), pairs.begin(), pairs.end());
+        if (pthread_mutex_unlock(outputMutex) != 0)
+        {
+            systemError("error on pthread_mutex_unlock");
+        }
+
+        Partition& partition = _partitions[partitionId];
+        partition.done = true;
+        std::vector<std::string>().swap(partition.runs);
+        ++_donePartitions;
+        _reducedPairs += partition.pairs;
+        node.partition = -1;
+        node.idle = true;
+    }
+    else
+    {
+        systemError("a node had sent an unexpected message.");
+    }
+}
+
+void NodeCluster::pollNodes(OutputVec& output, pthread_mutex_t* outputMutex)
+{
+    std::vector<pollfd> fds;
+    std::vector<Node*> polled;
+    for (Node& node : _nodes)
+    {
+        if (node.alive)
+        {
+            fds.push_back({node.fd, POLLIN, 0});
+            polled.push_back(&node);
+        }
+    }
+    if (poll(fds.data(), fds.size(), POLL_TIMEOUT_MS) < 0 && errno != EINTR)
+    {
+        systemError("poll had failed.");
+    }
+    for (size_t i = 0; i < fds.size(); ++i)
+    {
+        if (fds[i].revents == 0)
+        {
+            continue;
+        }
+        unsigned int type;
+        std::string payload;
+        ++_messages;
+        if (!recvMessage(fds[i].fd, type, payload, &_wireBytes, &_rawBytes))
+        {
+            handleDeadNode(*polled[i]);
+            continue;
+        }
+        handleMessage(*polled[i], type, payload, output, outputMutex);
+    }
+}
+
+void NodeCluster::run(OutputVec& output, pthread_mutex_t* outputMutex)
+{
+    // ------map:
+    while (_doneChunks < _chunks.size())
+    {
+        assignChunks();
+        pollNodes(output, outputMutex);
+    }
+
+    // ------reduce:
+    unsigned long totalPairs = 0;
+    for (int p = 0; p < _numPartitions; ++p)
+    {
+        if (_partitions[p].pairs > 0)
+        {
+            _pendingPartitions.push_back(p);
+            totalPairs += _partitions[p].pairs;
+        }
+    }
+    unsigned long numPartitions = _pendingPartitions.size();
+    _totalPairs = totalPairs;
+    _reducing = true;
+    while (_donePartitions < numPartitions)
+    {
+        assignPartitions();
+        pollNodes(output, outputMutex);
+    }
+
+    // ------shut down:
+    for (Node& node : _nodes)
+    {
+        if (node.alive)
+        {
+            if (!node.chunks.empty())
+            {
+                // Still on a chunk another node had finished, no reason to wait for it.
+                kill(node.pid, SIGKILL);
+            }
+            sendToNode(node, MSG_EXIT, std::string());
+            close(node.fd);
+            waitpid(node.pid, nullptr, 0);
+            node.alive = false;
+        }
+    }
+}
+
+//----------------------------------------------- ACCOUNTING ------------------------------------------------//
+
+bool NodeCluster::reducing() const
+{
+    return _reducing;
+}
+
+unsigned long NodeCluster::mappedElements() const
+{
+    return _mappedElements;
+}
+
+unsigned long NodeCluster::reducedPairs() const
+{
+    return _reducedPairs;
+}
+
+unsigned long NodeCluster::totalPairs() const
+{
+    return _totalPairs;
+}
+
+unsigned long NodeCluster::wireBytes() const
+{
+    return _wireBytes;
+}
+
+unsigned long NodeCluster::rawBytes() const
+{
+    return _rawBytes;
+}
+
+unsigned long NodeCluster::messages() const
+{
+    return _messages;
+}
+
+unsigned long NodeCluster::speculativeChunks() const
+{
+    return _speculativeChunks;
+}
+
+unsigned long NodeCluster::discardedChunks() const
+{
+    return _discardedChunks;
+}
@@ -0,0 +1,182 @@
+#ifndef NODECLUSTER_H
+#define NODECLUSTER_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <deque>
+#include <set>
+#include <pthread.h>
+#include <sys/types.h>
+#include "MapReduceClient.h"
+#include "MapReduceSerializer.h"
+
+// runs a job on a cluster of local node processes, coordinated by the job's thread.
+// the coordinator hands out chunks of the input to the nodes, the nodes map them and send back
+// their results hash partitioned by key, and then every partition is sent to a single node which
+// reduces it and sends back its output. all the traffic goes over unix domain sockets, in batched
+// and compressed messages, so the cluster behaves like one spread over a network.
+
+class NodeCluster {
+public:
+    /**
+     * Maps the input elements in [begin, end) into out. Runs in a node.
+     */
+    typedef void (*RangeMapper)(void* arg, unsigned long begin, unsigned long end, IntermediateVec& out);
+
+    /**
+     * Reduces a group of pairs sharing a key into out. Runs in a node.
+     */
+    typedef void (*GroupReducer)(void* arg, const IntermediateVec* group, OutputVec& out);
+
+    /**
+     * Creates a new cluster object.
+     * @param numNodes: The number of node processes.
+     * @param numElements: The size of the input.
+     * @param serializer: Encodes the intermediate pairs sent between the nodes.
+     * @param outputSerializer: Encodes the output pairs sent back from the nodes.
+     * @param mapRange: The map work of a node.
+     * @param reduceGroup: The reduce work of a node.
+     * @param arg: An argument to hand to mapRange and reduceGroup.
+     */
+    NodeCluster(int numNodes, unsigned long numElements, const IntermediateSerializer* serializer,
+                const OutputSerializer* outputSerializer, RangeMapper mapRange, GroupReducer reduceGroup, void* arg);
+    ~NodeCluster();
+
+    /**
+     * Creates the sockets and forks the nodes. Should be called before the job creates its threads.
+     */
+    void start();
+
+    /**
+     * Coordinates the nodes until the whole output was gathered, then lets the nodes exit.
+     * @param output: The vector to add the output pairs to.
+     * @param outputMutex: Locks the output vector.
+     */
+    void run(OutputVec& output, pthread_mutex_t* outputMutex);
+
+    /** @return true once all the input was mapped. */
+    bool reducing() const;
+
+    /** @return The number of input elements mapped so far. */
+    unsigned long mappedElements() const;
+
+    /** @return The number of intermediate pairs reduced so far, out of totalPairs(). */
+    unsigned long reducedPairs() const;
+    unsigned long totalPairs() const;
+
+    /** traffic accounting, of all the messages sent in both directions. */
+    unsigned long wireBytes() const;
+    unsigned long rawBytes() const;
+    unsigned long messages() const;
+
+    /** @return The number of chunks handed to a second node because the first one straggled. */
+    unsigned long speculativeChunks() const;
+
+    /** @return The number of chunk results thrown away since another node had finished the chunk first. */
+    unsigned long discardedChunks() const;
+
+private:
+    struct Chunk {
+        unsigned long begin;
+        unsigned long end;
+        bool done;
+        int copies;     // the number of nodes the chunk was handed to.
+        double started; // the time it was first handed out, in seconds.
+    };
+
+    struct Partition {
+        std::vector<std::string> runs; // an encoded run from every chunk that had pairs in this partition.
+        unsigned long pairs;
+        bool done;
+    };
+
+    struct Node {
+        int fd;
+        pid_t pid;
+        bool alive;
+        bool idle;            // waits for the coordinator to hand it work.
+        std::set<int> chunks; // the chunks it is mapping.
+        int partition;        // the partition it is reducing, -1 if none.
+    };
+
+    /**
+     * The work of a node process, never returns.
+     */
+    void nodeMain(int fd);
+
+    /**
+     * Maps a chunk in a node and sends the results, partitioned.
+     */
+    void nodeMapChunk(int fd, const std::string& request);
+
+    /**
+     * Reduces a partition in a node and sends its output.
+     */
+    void nodeReducePartition(int fd, int partition, std::vector<std::string>& runs);
+
+    /**
+     * Waits for messages from the nodes and handles them.
+     * @param output: The vector to add the output pairs to.
+     * @param outputMutex: Locks the output vector.
+     */
+    void pollNodes(OutputVec& output, pthread_mutex_t* outputMutex);
+
+    /**
+     * Handles a message from a node, in the coordinator.
+     */
+    void handleMessage(Node& node, unsigned int type, const std::string& payload, OutputVec& output,
+                       pthread_mutex_t* outputMutex);
+
+    /**
+     * Gives the work of a node that died back to the others.
+     */
+    void handleDeadNode(Node& node);
+
+    /**
+     * Hands the next chunk, or a straggling one, to the idle nodes.
+     */
+    void assignChunks();
+
+    /**
+     * Hands the next partition to the idle nodes.
+     */
+    void assignPartitions();
+
+    /**
+     * @return A running chunk that takes much longer than the chunks completed so far, or -1 if there is none.
+     */
+    int findStraggler(double now) const;
+
+    bool sendToNode(Node& node, unsigned int type, const std::string& payload);
+
+    int _numNodes;
+    int _numPartitions;
+    unsigned long _numElements;
+    const IntermediateSerializer* _serializer;
+    const OutputSerializer* _outputSerializer;
+    RangeMapper _mapRange;
+    GroupReducer _reduceGroup;
+    void* _arg;
+
+    std::vector<Node> _nodes;
+    std::vector<Chunk> _chunks;
+    std::deque<int> _pendingChunks;
+    std::vector<double> _chunkTimes; // the durations of the completed chunks.
+    unsigned long _doneChunks;
+    std::vector<Partition> _partitions;
+    std::deque<int> _pendingPartitions;
+    unsigned long _donePartitions;
+
+    std::atomic<bool> _reducing;
+    std::atomic<unsigned long> _mappedElements;
+    std::atomic<unsigned long> _reducedPairs;
+    std::atomic<unsigned long> _totalPairs;
+    std::atomic<unsigned long> _wireBytes;
+    std::atomic<unsigned long> _rawBytes;
+    std::atomic<unsigned long> _messages;
+    std::atomic<unsigned long> _speculativeChunks;
+    std::atomic<unsigned long> _discardedChunks;
+};
+
+#endif //NODECLUSTER_H
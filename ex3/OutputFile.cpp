@@ -0,0 +1,161 @@
+#include "OutputFile.h"
+#include <iostream>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+/** the buffer is written to the file whenever it grows past this many bytes. */
+static const size_t BUFFER_BYTES = 1 << 20;
+
+/**
+ * Prints the error and exits.
+ */
+static void systemError(const std::string& msg)
+{
+    std::cerr << "System Error: " << msg << std::endl;
+    exit(1);
+}
+
+/**
+ * Starts a length prefixed field by writing a placeholder length.
+ * @return the position of the length, to hand to endField once the field was appended.
+ */
+static size_t beginField(std::string& out)
+{
+    uint32_t len = 0;
+    out.append(reinterpret_cast<const char*>(&len), sizeof(len));
+    return out.size() - sizeof(len);
+}
+
+/**
+ * Patches the length of a field started by beginField.
+ */
+static void endField(std::string& out, size_t lenPos)
+{
+    auto len = (uint32_t)(out.size() - lenPos - sizeof(uint32_t));
+    memcpy(&out[lenPos], &len, sizeof(len));
+}
+
+OutputFileWriter::OutputFileWriter(const std::string& path, const OutputSerializer& serializer) :
+        _path(path), _serializer(serializer)
+{
+    _fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (_fd < 0)
+    {
+        systemError("couldn't create the output file " + path + ".");
+    }
+    _buffer.reserve(BUFFER_BYTES + BUFFER_BYTES / 4);
+}
+
+OutputFileWriter::~OutputFileWriter()
+{
+    if (_fd >= 0)
+    {
+        close();
+    }
+}
+
+void OutputFileWriter::write(const OutputPair& pair)
+{
+    size_t lenPos = beginField(_buffer);
+    _serializer.writeKey(pair.first, _buffer);
+    endField(_buffer, lenPos);
+    lenPos = beginField(_buffer);
+    _serializer.writeValue(pair.second, _buffer);
+    endField(_buffer, lenPos);
+    if (_buffer.size() >= BUFFER_BYTES)
+    {
+        flush();
+    }
+}
+
+void OutputFileWriter::close()
+{
+    flush();
+    if (::close(_fd) != 0)
+    {
+        systemError("couldn't close the output file " + _path + ".");
+    }
+    _fd = -1;
+}
+
+void OutputFileWriter::flush()
+{
+    const char* next = _buffer.data();
+    size_t left = _buffer.size();
+    while (left > 0)
+    {
+        ssize_t written = ::write(_fd, next, left);
+        if (written < 0 && errno != EINTR)
+        {
+            systemError("couldn't write the output file " + _path + ".");
+        }
+        if (written > 0)
+        {
+            next += written;
+            left -= written;
+        }
+    }
+    _buffer.clear();
+}
+
+bool readOutputFile(const std::string& path, const OutputSerializer& serializer, OutputVec& out)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+    std::string data;
+    char buffer[1 << 16];
+    ssize_t bytes;
+    while ((bytes = read(fd, buffer, sizeof(buffer))) != 0)
+    {
+        if (bytes < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            ::close(fd);
+            return false;
+        }
+        data.append(buffer, bytes);
+    }
+    ::close(fd);
+
+    size_t pos = 0;
+    while (pos < data.size())
+    {
+        uint32_t keyLen, valLen;
+        if (data.size() - pos < sizeof(keyLen))
+        {
+            return false;
+        }
+        memcpy(&keyLen, data.data() + pos, sizeof(keyLen));
+        pos += sizeof(keyLen);
+        if (data.size() - pos < keyLen)
+        {
+            return false;
+        }
+        size_t keyPos = pos;
+        pos += keyLen;
+        if (data.size() - pos < sizeof(valLen))
+        {
+            return false;
+        }
+        memcpy(&valLen, data.data() + pos, sizeof(valLen));
+        pos += sizeof(valLen);
+        if (data.size() - pos < valLen)
+        {
+            return false;
+        }
+        out.push_back(OutputPair(serializer.readKey(data.data() + keyPos, keyLen),
+                                 serializer.readValue(data.data() + pos, valLen)));
+        pos += valLen;
+    }
+    return true;
+}
@@ -0,0 +1,49 @@
+#ifndef OUTPUTFILE_H
+#define OUTPUTFILE_H
+
+#include <string>
+#include "MapReduceClient.h"
+#include "MapReduceSerializer.h"
+
+// a local file of output pairs, written sequentially through a buffer.
+// every record is a 32 bit key length, the key bytes, a 32 bit value length and the value bytes, as the
+// client's output serializer wrote them, up to the end of the file.
+
+class OutputFileWriter {
+public:
+    /**
+     * Creates the file, replacing any file of that name. Exits on failure.
+     * @param path: The file's path.
+     * @param serializer: Encodes the pairs.
+     */
+    OutputFileWriter(const std::string& path, const OutputSerializer& serializer);
+
+    /** Flushes and closes the file, if close wasn't called. */
+    ~OutputFileWriter();
+
+    /** Appends a pair to the file. The pair is left to the caller. */
+    void write(const OutputPair& pair);
+
+    /** Flushes the buffer and closes the file. Exits on failure. */
+    void close();
+
+private:
+    OutputFileWriter(const OutputFileWriter&);
+    OutputFileWriter& operator=(const OutputFileWriter&);
+
+    /** Writes the buffer to the file and empties it. */
+    void flush();
+
+    std::string _path;
+    const OutputSerializer& _serializer;
+    int _fd;
+    std::string _buffer;
+};
+
+/**
+ * Reads the pairs of an output file and appends them to out, built by the serializer.
+ * @return false if the file can't be read or is malformed (out may hold a prefix of the file in this case).
+ */
+bool readOutputFile(const std::string& path, const OutputSerializer& serializer, OutputVec& out);
+
+#endif //OUTPUTFILE_H
@@ -0,0 +1,178 @@
+#include "ProcessMapper.h"
+#include <iostream>
+#include <new>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/** the number of times a slice is forked before its crash fails the job. */
+static const int MAX_SLICE_ATTEMPTS = 2;
+
+/**
+ * Prints the error and exits.
+ */
+static void systemError(const std::string& msg)
+{
+    std::cerr << "System Error: " << msg << std::endl;
+    exit(1);
+}
+
+/**
+ * Writes the whole buffer to fd.
+ * @return false on failure.
+ */
+static bool writeAll(int fd, const char* data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t written = write(fd, data, size);
+        if (written < 0)
+        {
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+ProcessMapper::ProcessMapper(int numProcesses, unsigned long numElements, SliceMapper mapSlice, void* arg)
+        : _numProcesses(numProcesses), _numElements(numElements), _mapSlice(mapSlice), _arg(arg),
+          _progress(nullptr), _fds(numProcesses, -1), _pids(numProcesses, -1), _attempts(numProcesses, 0),
+          _data(numProcesses, nullptr), _sizes(numProcesses, 0)
+{
+}
+
+ProcessMapper::~ProcessMapper()
+{
+    for (int i = 0; i < _numProcesses; ++i)
+    {
+        if (_data[i] != nullptr)
+        {
+            munmap((void*)_data[i], _sizes[i]);
+        }
+        if (_fds[i] >= 0)
+        {
+            close(_fds[i]);
+        }
+    }
+    if (_progress != nullptr)
+    {
+        munmap(_progress, sizeof(std::atomic<unsigned long>) * _numProcesses);
+    }
+}
+
+void ProcessMapper::start()
+{
+    void* shared = mmap(nullptr, sizeof(std::atomic<unsigned long>) * _numProcesses, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED)
+    {
+        systemError("couldn't map the progress counters.");
+    }
+    _progress = (std::atomic<unsigned long>*)shared;
+    for (int i = 0; i < _numProcesses; ++i)
+    {
+        new (&_progress[i]) std::atomic<unsigned long>(0);
+        _fds[i] = memfd_create("mapreduce-run", MFD_CLOEXEC);
+        if (_fds[i] < 0)
+        {
+            systemError("memfd_create had failed.");
+        }
+    }
+    for (int i = 0; i < _numProcesses; ++i)
+    {
+        forkSlice(i);
+    }
+}
+
+void ProcessMapper::forkSlice(int slice)
+{
+    ++_attempts[slice];
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        systemError("fork had failed.");
+    }
+    if (pid == 0)
+    {
+        unsigned long begin = _numElements * slice / _numProcesses;
+        unsigned long end = _numElements * (slice + 1) / _numProcesses;
+        std::string segment;
+        _progress[slice] = 0;
+        _mapSlice(_arg, begin, end, _progress[slice], segment);
+        if (ftruncate(_fds[slice], 0) || lseek(_fds[slice], 0, SEEK_SET) < 0 ||
+            !writeAll(_fds[slice], segment.data(), segment.size()))
+        {
+            _exit(1);
+        }
+        _exit(0);
+    }
+    _pids[slice] = pid;
+}
+
+void ProcessMapper::wait()
+{
+    for (int i = 0; i < _numProcesses; ++i)
+    {
+        int status;
+        if (waitpid(_pids[i], &status, 0) < 0)
+        {
+            systemError("waitpid had failed.");
+        }
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            if (_attempts[i] >= MAX_SLICE_ATTEMPTS)
+            {
+                systemError("a map process had crashed " + std::to_string(_attempts[i]) + " times.");
+            }
+            std::cerr << "map process of slice " << i << " had crashed, forking it again." << std::endl;
+            forkSlice(i);
+            --i;
+            continue;
+        }
+
+        struct stat st;
+        if (fstat(_fds[i], &st))
+        {
+            systemError("fstat had failed on a map segment.");
+        }
+        _sizes[i] = st.st_size;
+        if (_sizes[i] > 0)
+        {
+            void* data = mmap(nullptr, _sizes[i], PROT_READ, MAP_SHARED, _fds[i], 0);
+            if (data == MAP_FAILED)
+            {
+                systemError("couldn't map a map segment.");
+            }
+            _data[i] = (const char*)data;
+        }
+    }
+}
+
+unsigned long ProcessMapper::progress() const
+{
+    unsigned long sum = 0;
+    for (int i = 0; i < _numProcesses; ++i)
+    {
+        sum += _progress[i];
+    }
+    return sum;
+}
+
+int ProcessMapper::numSegments() const
+{
+    return _numProcesses;
+}
+
+const char* ProcessMapper::segmentData(int slice) const
+{
+    return _data[slice];
+}
+
+size_t ProcessMapper::segmentSize(int slice) const
+{
+    return _sizes[slice];
+}
@@ -0,0 +1,78 @@
+#ifndef PROCESSMAPPER_H
+#define PROCESSMAPPER_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+// runs the map stage of a job in forked processes.
+// every process maps a contiguous slice of the input and leaves its encoded, sorted run
+// in its own memfd segment, which the job's process maps back read only.
+// the segments cross no pipe or buffer: the serializer reads every key and value straight out of the mapping.
+// the reduce pairs are still built as new K2 and V2 objects, not handed out as views into the mapping, since
+// they're the client's own polymorphic types, which only its serializer can build, and which reduce may keep or
+// delete as it does with the pairs it emitted itself.
+
+class ProcessMapper {
+public:
+    /**
+     * The work of a single process: maps the input elements in [begin, end), counting every mapped element in
+     * progress, and fills segment with the bytes the job's process should get back.
+     */
+    typedef void (*SliceMapper)(void* arg, unsigned long begin, unsigned long end,
+                                std::atomic<unsigned long>& progress, std::string& segment);
+
+    /**
+     * Creates a new process mapper object.
+     * @param numProcesses: The number of processes to fork.
+     * @param numElements: The size of the input.
+     * @param mapSlice: The function each process runs.
+     * @param arg: An argument to hand to mapSlice.
+     */
+    ProcessMapper(int numProcesses, unsigned long numElements, SliceMapper mapSlice, void* arg);
+    ~ProcessMapper();
+
+    /**
+     * Creates the segments and forks the processes. Should be called before the job creates its threads.
+     */
+    void start();
+
+    /**
+     * Waits for all the processes to exit, forking a slice again if its process crashed, and maps the segments.
+     */
+    void wait();
+
+    /**
+     * @return The number of elements the processes had mapped so far.
+     */
+    unsigned long progress() const;
+
+    int numSegments() const;
+
+    /**
+     * The segment of a slice, valid after wait() returned.
+     */
+    const char* segmentData(int slice) const;
+    size_t segmentSize(int slice) const;
+
+private:
+    /**
+     * Forks the process of a single slice.
+     */
+    void forkSlice(int slice);
+
+    int _numProcesses;
+    unsigned long _numElements;
+    SliceMapper _mapSlice;
+    void* _arg;
+
+    std::atomic<unsigned long>* _progress; // one counter per slice, shared with the processes.
+    std::vector<int> _fds;
+    std::vector<pid_t> _pids;
+    std::vector<int> _attempts;
+    std::vector<const char*> _data;
+    std::vector<size_t> _sizes;
+};
+
+#endif //PROCESSMAPPER_H
@@ -0,0 +1,191 @@
+#include "SideInput.h"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+
+/** marks an empty slot of the hash table. */
+static const uint32_t EMPTY = UINT32_MAX;
+
+/**
+ * @return The FNV-1a hash of the bytes.
+ */
+static uint64_t hashBytes(const char* data, size_t size)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * Compares two byte strings, as std::string would.
+ */
+static int compareBytes(const char* a, size_t aSize, const char* b, size_t bSize)
+{
+    int result = memcmp(a, b, std::min(aSize, bSize));
+    if (result != 0)
+    {
+        return result;
+    }
+    return aSize < bSize ? -1 : (aSize > bSize ? 1 : 0);
+}
+
+SideInput::SideInput(SideInputLayout layout) : _layout(layout), _frozen(false), _mask(0), _size(0)
+{
+}
+
+void SideInput::add(const std::string& key, const std::string& value)
+{
+    if (_frozen)
+    {
+        std::cerr << "MapReduce error: a side input can't change once it was frozen." << std::endl;
+        exit(1);
+    }
+    if (_bytes.size() + key.size() + value.size() > UINT32_MAX)
+    {
+        std::cerr << "MapReduce error: a side input is limited to 4GB." << std::endl;
+        exit(1);
+    }
+    Entry entry;
+    entry.hash = hashBytes(key.data(), key.size());
+    entry.keyOffset = (uint32_t)_bytes.size();
+    entry.keySize = (uint32_t)key.size();
+    _bytes.append(key);
+    entry.valueOffset = (uint32_t)_bytes.size();
+    entry.valueSize = (uint32_t)value.size();
+    _bytes.append(value);
+    try
+    {
+        _entries.push_back(entry);
+    }
+    catch (std::bad_alloc &e)
+    {
+        std::cerr << "system error: couldn't add to the side input." << std::endl;
+        exit(1);
+    }
+}
+
+void SideInput::freeze()
+{
+    if (_frozen)
+    {
+        return;
+    }
+    _frozen = true;
+    _bytes.shrink_to_fit();
+    if (_layout == SIDE_SORTED)
+    {
+        // A stable sort keeps the first value added of a key first, and the later ones are dropped:
+        auto less = [this](const Entry& a, const Entry& b) {
+            return compareBytes(_bytes.data() + a.keyOffset, a.keySize,
+                                _bytes.data() + b.keyOffset, b.keySize) < 0;
+        };
+        std::stable_sort(_entries.begin(), _entries.end(), less);
+        _entries.erase(std::unique(_entries.begin(), _entries.end(), [&](const Entry& a, const Entry& b) {
+            return !less(a, b) && !less(b, a);
+        }), _entries.end());
+        _entries.shrink_to_fit();
+        _size = _entries.size();
+        return;
+    }
+
+    // The entries are kept in the slots themselves, at most half full, so a probe sequence is short and mostly
+    // stays in one cache line:
+    size_t capacity = 16;
+    while (capacity < 2 * _entries.size())
+    {
+        capacity *= 2;
+    }
+    Entry empty = {0, EMPTY, 0, 0, 0};
+    std::vector<Entry> table(capacity, empty);
+    _mask = capacity - 1;
+    for (const Entry& entry : _entries)
+    {
+        size_t slot = entry.hash & _mask;
+        bool duplicate = false;
+        while (table[slot].keyOffset != EMPTY && !duplicate)
+        {
+            duplicate = matches(table[slot], _bytes.data() + entry.keyOffset, entry.keySize);
+            slot = (slot + 1) & _mask;
+        }
+        if (!duplicate)
+        {
+            table[slot] = entry;
+            ++_size;
+        }
+    }
+    _entries.swap(table);
+}
+
+bool SideInput::frozen() const
+{
+    return _frozen;
+}
+
+bool SideInput::matches(const Entry& entry, const char* key, size_t keySize) const
+{
+    return entry.keySize == keySize && memcmp(_bytes.data() + entry.keyOffset, key, keySize) == 0;
+}
+
+bool SideInput::find(const char* key, size_t keySize, const char*& value, size_t& valueSize) const
+{
+    const Entry* found = nullptr;
+    if (!_frozen)
+    {
+        return false;
+    }
+    if (_layout == SIDE_SORTED)
+    {
+        auto it = std::lower_bound(_entries.begin(), _entries.end(), 0, [&](const Entry& entry, int) {
+            return compareBytes(_bytes.data() + entry.keyOffset, entry.keySize, key, keySize) < 0;
+        });
+        if (it != _entries.end() && matches(*it, key, keySize))
+        {
+            found = &*it;
+        }
+    }
+    else
+    {
+        uint64_t hash = hashBytes(key, keySize);
+        for (size_t slot = hash & _mask; _entries[slot].keyOffset != EMPTY; slot = (slot + 1) & _mask)
+        {
+            const Entry& entry = _entries[slot];
+            if (entry.hash == hash && matches(entry, key, keySize))
+            {
+                found = &entry;
+                break;
+            }
+        }
+    }
+    if (found == nullptr)
+    {
+        return false;
+    }
+    value = _bytes.data() + found->valueOffset;
+    valueSize = found->valueSize;
+    return true;
+}
+
+const char* SideInput::find(const std::string& key, size_t* valueSize) const
+{
+    const char* value;
+    size_t size;
+    if (!find(key.data(), key.size(), value, size))
+    {
+        return nullptr;
+    }
+    if (valueSize != nullptr)
+    {
+        *valueSize = size;
+    }
+    return value;
+}
+
+size_t SideInput::size() const
+{
+    return _frozen ? _size : _entries.size();
+}
@@ -0,0 +1,79 @@
+#ifndef SIDEINPUT_H
+#define SIDEINPUT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// a small read only table broadcast to every map and reduce call of a job, for map side joins.
+// the table is built once, with add, and frozen before the job starts. from then on it is never written, so the
+// threads of the job (and its map processes or nodes, which inherit it when they are forked) read it without locks.
+// keys and values are bytes. all of them are kept in one buffer, and looked up either in an open addressing hash
+// table or by a binary search over the keys, sorted.
+
+enum SideInputLayout {SIDE_HASH=0, SIDE_SORTED=1};
+
+class SideInput {
+public:
+    /**
+     * Creates a new, empty, side input object.
+     * @param layout: SIDE_HASH for lookups in about a single cache miss, SIDE_SORTED for a more compact table
+     * which is also looked up in key order.
+     */
+    explicit SideInput(SideInputLayout layout = SIDE_HASH);
+
+    /**
+     * Adds an entry. If the key was added before, the first value added is the one found.
+     * Can only be called before the table is frozen.
+     */
+    void add(const std::string& key, const std::string& value);
+
+    /**
+     * Builds the lookup structure. The table can't change after this, and a job can only get a frozen table.
+     */
+    void freeze();
+
+    /** @return true once the table was frozen. */
+    bool frozen() const;
+
+    /**
+     * Looks a key up.
+     * @param key: the key's bytes.
+     * @param keySize: the number of bytes in the key.
+     * @param value: set to the start of the value's bytes, which stay valid as long as the table does.
+     * @param valueSize: set to the number of bytes in the value.
+     * @return false if the key isn't in the table.
+     */
+    bool find(const char* key, size_t keySize, const char*& value, size_t& valueSize) const;
+
+    /**
+     * Looks a key up.
+     * @return the value, or nullptr if the key isn't in the table. The value stays valid as long as the table does.
+     */
+    const char* find(const std::string& key, size_t* valueSize = nullptr) const;
+
+    /** @return The number of keys in the table (before it is frozen, the number of entries added). */
+    size_t size() const;
+
+private:
+    struct Entry {
+        uint64_t hash;
+        uint32_t keyOffset;
+        uint32_t keySize;
+        uint32_t valueOffset;
+        uint32_t valueSize;
+    };
+
+    bool matches(const Entry& entry, const char* key, size_t keySize) const;
+
+    SideInputLayout _layout;
+    bool _frozen;
+    std::string _bytes;          // the keys and values, back to back.
+    std::vector<Entry> _entries; // in the order added. once frozen, sorted by key for SIDE_SORTED, or the slots of
+                                 // the hash table for SIDE_HASH.
+    size_t _mask;
+    size_t _size;
+};
+
+#endif //SIDEINPUT_H
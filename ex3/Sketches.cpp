@@ -0,0 +1,363 @@
+#include "Sketches.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+/** the registers of a HyperLogLog are picked by this many bits of the hash. */
+static const int HLL_PRECISION = 12;
+
+/** the rows and columns of a Count-Min sketch, which overestimates by at most e / width of the total. */
+static const size_t CM_DEPTH = 4;
+static const size_t CM_WIDTH = 1024;
+
+/** the candidate frequent items a Count-Min sketch keeps. */
+static const size_t CM_TOP_ITEMS = 16;
+
+/** the capacity of the top level of a KLL sketch, and how much smaller every level under it is. */
+static const size_t KLL_K = 200;
+static const double KLL_SHRINK = 2.0 / 3.0;
+
+/**
+ * Mixes the bits of a value, so that close values get unrelated hashes.
+ */
+static uint64_t mix(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+uint64_t sketchHash(const void* data, size_t size)
+{
+    auto bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return mix(hash);
+}
+
+//------------------------------------------------- HYPERLOGLOG -------------------------------------------------//
+
+HyperLogLog::HyperLogLog() : _registers((size_t)1 << HLL_PRECISION, 0)
+{
+}
+
+void HyperLogLog::add(uint64_t hash)
+{
+    uint64_t h = mix(hash);
+    size_t index = h >> (64 - HLL_PRECISION);
+    // The rest of the bits, with a stop bit so the rank is bounded:
+    uint64_t rest = (h << HLL_PRECISION) | ((uint64_t)1 << (HLL_PRECISION - 1));
+    auto rank = (uint8_t)(__builtin_clzll(rest) + 1);
+    _registers[index] = std::max(_registers[index], rank);
+}
+
+void HyperLogLog::merge(const HyperLogLog& other)
+{
+    for (size_t i = 0; i < _registers.size(); ++i)
+    {
+        _registers[i] = std::max(_registers[i], other._registers[i]);
+    }
+}
+
+double HyperLogLog::estimate() const
+{
+    auto m = (double)_registers.size();
+    double sum = 0;
+    size_t zeros = 0;
+    for (uint8_t reg : _registers)
+    {
+        sum += std::ldexp(1.0, -reg);
+        zeros += reg == 0;
+    }
+    double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    // Few items leave many registers empty, which linear counting estimates better:
+    if (estimate <= 2.5 * m && zeros > 0)
+    {
+        estimate = m * std::log(m / zeros);
+    }
+    return estimate;
+}
+
+//------------------------------------------------ COUNT-MIN SKETCH ---------------------------------------------//
+
+CountMinSketch::CountMinSketch() : _counters(CM_DEPTH * CM_WIDTH, 0), _total(0)
+{
+}
+
+void CountMinSketch::add(uint64_t item, uint64_t count)
+{
+    uint64_t h1 = mix(item);
+    uint64_t h2 = mix(h1) | 1;
+    uint64_t estimate = std::numeric_limits<uint64_t>::max();
+    for (size_t row = 0; row < CM_DEPTH; ++row)
+    {
+        uint32_t& counter = _counters[row * CM_WIDTH + (h1 + row * h2) % CM_WIDTH];
+        counter = (uint32_t)std::min<uint64_t>((uint64_t)counter + count, UINT32_MAX);
+        estimate = std::min<uint64_t>(estimate, counter);
+    }
+    _total += count;
+    offer(item, estimate);
+}
+
+void CountMinSketch::merge(const CountMinSketch& other)
+{
+    for (size_t i = 0; i < _counters.size(); ++i)
+    {
+        _counters[i] = (uint32_t)std::min<uint64_t>((uint64_t)_counters[i] + other._counters[i], UINT32_MAX);
+    }
+    _total += other._total;
+
+    // The estimates of both candidate lists went up with the merge:
+    std::vector<std::pair<uint64_t, uint64_t> > candidates(_top);
+    candidates.insert(candidates.end(), other._top.begin(), other._top.end());
+    _top.clear();
+    for (const auto& candidate : candidates)
+    {
+        offer(candidate.first, estimate(candidate.first));
+    }
+}
+
+uint64_t CountMinSketch::estimate(uint64_t item) const
+{
+    uint64_t h1 = mix(item);
+    uint64_t h2 = mix(h1) | 1;
+    uint64_t estimate = std::numeric_limits<uint64_t>::max();
+    for (size_t row = 0; row < CM_DEPTH; ++row)
+    {
+        estimate = std::min<uint64_t>(estimate, _counters[row * CM_WIDTH + (h1 + row * h2) % CM_WIDTH]);
+    }
+    return estimate;
+}
+
+std::vector<std::pair<uint64_t, uint64_t> > CountMinSketch::topItems() const
+{
+    std::vector<std::pair<uint64_t, uint64_t> > top(_top);
+    std::sort(top.begin(), top.end(), [](const std::pair<uint64_t, uint64_t>& a,
+                                         const std::pair<uint64_t, uint64_t>& b)
+    {
+        return a.second > b.second;
+    });
+    return top;
+}
+
+uint64_t CountMinSketch::total() const
+{
+    return _total;
+}
+
+void CountMinSketch::offer(uint64_t item, uint64_t estimate)
+{
+    size_t lowest = 0;
+    for (size_t i = 0; i < _top.size(); ++i)
+    {
+        if (_top[i].first == item)
+        {
+            _top[i].second = estimate;
+            return;
+        }
+        if (_top[i].second < _top[lowest].second)
+        {
+            lowest = i;
+        }
+    }
+    if (_top.size() < CM_TOP_ITEMS)
+    {
+        _top.push_back({item, estimate});
+    }
+    else if (_top[lowest].second < estimate)
+    {
+        _top[lowest] = {item, estimate};
+    }
+}
+
+//--------------------------------------------------- KLL SKETCH ------------------------------------------------//
+
+KllSketch::KllSketch() : _levels(1), _count(0), _coin(0x5DEECE66DULL)
+{
+}
+
+void KllSketch::add(double value)
+{
+    _levels[0].push_back(value);
+    ++_count;
+    if (_levels[0].size() >= capacity(0))
+    {
+        compress();
+    }
+}
+
+void KllSketch::merge(const KllSketch& other)
+{
+    if (_levels.size() < other._levels.size())
+    {
+        _levels.resize(other._levels.size());
+    }
+    for (size_t level = 0; level < other._levels.size(); ++level)
+    {
+        _levels[level].insert(_levels[level].end(), other._levels[level].begin(), other._levels[level].end());
+    }
+    _count += other._count;
+    compress();
+}
+
+double KllSketch::quantile(double rank) const
+{
+    std::vector<std::pair<double, uint64_t> > weighted;
+    for (size_t level = 0; level < _levels.size(); ++level)
+    {
+        for (double value : _levels[level])
+        {
+            weighted.push_back({value, (uint64_t)1 << level});
+        }
+    }
+    if (weighted.empty())
+    {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    std::sort(weighted.begin(), weighted.end());
+    uint64_t weight = 0;
+    for (const auto& value : weighted)
+    {
+        weight += value.second;
+    }
+    auto target = (uint64_t)std::ceil(std::max(0.0, std::min(1.0, rank)) * weight);
+    uint64_t seen = 0;
+    for (const auto& value : weighted)
+    {
+        seen += value.second;
+        if (seen >= target)
+        {
+            return value.first;
+        }
+    }
+    return weighted.back().first;
+}
+
+uint64_t KllSketch::count() const
+{
+    return _count;
+}
+
+size_t KllSketch::capacity(size_t level) const
+{
+    double depth = (double)(_levels.size() - 1 - level);
+    return std::max((size_t)2, (size_t)std::ceil(KLL_K * std::pow(KLL_SHRINK, depth)));
+}
+
+void KllSketch::compress()
+{
+    for (size_t level = 0; level < _levels.size(); ++level)
+    {
+        if (_levels[level].size() < capacity(level))
+        {
+            continue;
+        }
+        if (level + 1 == _levels.size())
+        {
+            _levels.emplace_back();
+        }
+        std::vector<double>& values = _levels[level];
+        std::sort(values.begin(), values.end());
+
+        // Every other value is kept, starting from a random one of the first two, and stands for both:
+        _coin = mix(_coin);
+        size_t kept = values.size() % 2;
+        for (size_t i = kept + (_coin & 1); i < values.size(); i += 2)
+        {
+            _levels[level + 1].push_back(values[i]);
+        }
+        values.resize(kept);
+    }
+}
+
+//------------------------------------------------- SKETCH VALUE ------------------------------------------------//
+
+SketchValue::SketchValue() : distinct(nullptr), frequent(nullptr), quantiles(nullptr)
+{
+}
+
+SketchValue::~SketchValue()
+{
+    delete distinct;
+    delete frequent;
+    delete quantiles;
+}
+
+void SketchValue::merge(const SketchValue& other)
+{
+    if (other.distinct != nullptr)
+    {
+        if (distinct == nullptr)
+        {
+            distinct = new HyperLogLog();
+        }
+        distinct->merge(*other.distinct);
+    }
+    if (other.frequent != nullptr)
+    {
+        if (frequent == nullptr)
+        {
+            frequent = new CountMinSketch();
+        }
+        frequent->merge(*other.frequent);
+    }
+    if (other.quantiles != nullptr)
+    {
+        if (quantiles == nullptr)
+        {
+            quantiles = new KllSketch();
+        }
+        quantiles->merge(*other.quantiles);
+    }
+}
+
+//------------------------------------------------- SKETCH TABLE ------------------------------------------------//
+
+SketchTable::~SketchTable()
+{
+    for (auto& entry : _sketches)
+    {
+        delete entry.first;
+        delete entry.second;
+    }
+}
+
+SketchValue* SketchTable::find(K2* key)
+{
+    auto found = _sketches.find(key);
+    if (found != _sketches.end())
+    {
+        delete key;
+        return found->second;
+    }
+    auto* sketch = new SketchValue();
+    _sketches.insert({key, sketch});
+    return sketch;
+}
+
+void SketchTable::release(IntermediateVec& out)
+{
+    for (auto& entry : _sketches)
+    {
+        out.push_back(IntermediatePair(entry.first, entry.second));
+    }
+    _sketches.clear();
+}
+
+//----------------------------------------------- SKETCHING CLIENT ----------------------------------------------//
+
+void SketchingClient::reduce(const IntermediateVec* pairs, void* context) const
+{
+    SketchValue merged;
+    for (const IntermediatePair& pair : *pairs)
+    {
+        merged.merge(*static_cast<const SketchValue*>(pair.second));
+    }
+    emitSketch(pairs, merged, context);
+}
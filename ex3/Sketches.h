@@ -0,0 +1,147 @@
+#ifndef SKETCHES_H
+#define SKETCHES_H
+
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <vector>
+#include "MapReduceClient.h"
+
+// approximate aggregations, for queries that can do with estimates of a key's distinct items, frequent items or
+// quantiles. map feeds items to a key with sketchDistinct, sketchFrequency and sketchQuantile (see
+// MapReduceFramework.h) instead of emitting a pair per item. every thread keeps a sketch per key, and emits a
+// single pair per key once it's done mapping, so the map results and the shuffle grow with the number of keys
+// rather than the number of items. a SketchingClient merges the sketches of every key in reduce.
+
+class HyperLogLog {
+public:
+    HyperLogLog();
+
+    /** Adds an item, given by its hash. */
+    void add(uint64_t hash);
+
+    void merge(const HyperLogLog& other);
+
+    /** @return The estimated number of distinct items added, within about 1.6%. */
+    double estimate() const;
+
+private:
+    std::vector<uint8_t> _registers;
+};
+
+class CountMinSketch {
+public:
+    CountMinSketch();
+
+    /** Adds count occurrences of an item. */
+    void add(uint64_t item, uint64_t count);
+
+    void merge(const CountMinSketch& other);
+
+    /** @return The estimated occurrences of an item, never below the real ones. */
+    uint64_t estimate(uint64_t item) const;
+
+    /** @return The items estimated to occur the most, with their estimates, most frequent first. */
+    std::vector<std::pair<uint64_t, uint64_t> > topItems() const;
+
+    /** @return The occurrences of all the items together. */
+    uint64_t total() const;
+
+private:
+    /** Keeps the item among the top candidates if its estimate is high enough. */
+    void offer(uint64_t item, uint64_t estimate);
+
+    std::vector<uint32_t> _counters;
+    std::vector<std::pair<uint64_t, uint64_t> > _top; // the candidate frequent items, with their estimates.
+    uint64_t _total;
+};
+
+class KllSketch {
+public:
+    KllSketch();
+
+    void add(double value);
+
+    void merge(const KllSketch& other);
+
+    /**
+     * @param rank: A fraction between 0 and 1.
+     * @return A value whose rank among the values added is about the given one, NaN if none were added.
+     */
+    double quantile(double rank) const;
+
+    /** @return The number of values added. */
+    uint64_t count() const;
+
+private:
+    /** @return The number of values a level may hold before it's compacted. */
+    size_t capacity(size_t level) const;
+
+    /** Compacts the full levels, halving each into the level above. */
+    void compress();
+
+    std::vector<std::vector<double> > _levels; // the values of level h each stand for 2^h values added.
+    uint64_t _count;
+    uint64_t _coin; // decides which half of a compacted level is kept.
+};
+
+// the sketches of a key. a key only gets the sketches map fed it.
+class SketchValue : public V2 {
+public:
+    SketchValue();
+    ~SketchValue() override;
+
+    /** Adds the sketches of other to this one's. */
+    void merge(const SketchValue& other);
+
+    HyperLogLog* distinct;    // nullptr if the key got no distinct items.
+    CountMinSketch* frequent; // nullptr if the key got no frequency items.
+    KllSketch* quantiles;     // nullptr if the key got no quantile values.
+
+private:
+    SketchValue(const SketchValue&);
+    SketchValue& operator=(const SketchValue&);
+};
+
+/**
+ * @return A hash of the bytes, for feeding items that aren't integers to sketchDistinct or sketchFrequency.
+ */
+uint64_t sketchHash(const void* data, size_t size);
+
+// the sketches a thread keeps while it maps, by key.
+class SketchTable {
+public:
+    ~SketchTable();
+
+    /**
+     * @return The sketches of the key. The key is kept by the table, or deleted if the table already has it.
+     */
+    SketchValue* find(K2* key);
+
+    /**
+     * Moves the keys and their sketches out as pairs, and empties the table.
+     */
+    void release(IntermediateVec& out);
+
+private:
+    struct KeyLess {
+        bool operator()(const K2* a, const K2* b) const
+        {
+            return *a < *b;
+        }
+    };
+
+    std::map<K2*, SketchValue*, KeyLess> _sketches;
+};
+
+class SketchingClient : public MapReduceClient {
+public:
+    // merges the sketches of the key and hands the result to emitSketch.
+    void reduce(const IntermediateVec* pairs, void* context) const override;
+
+    // gets the pairs of a key and their merged sketches, calls emit3 with the result.
+    // the pairs, whose values are the sketches of every thread, are still owned by the client, as in reduce.
+    virtual void emitSketch(const IntermediateVec* pairs, const SketchValue& sketch, void* context) const = 0;
+};
+
+#endif //SKETCHES_H